@@ -0,0 +1,1223 @@
+#include "corpus.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <queue>
+
+typedef struct JpegHuffTable {
+    uint16_t code[256];
+    uint8_t size[256];
+} JpegHuffTable;
+
+typedef struct JpegComponent {
+    int blocks_x;
+    int blocks_y;
+    int quant_id;
+    std::vector<int16_t> coeff; // quantized, zigzag order, 64 per block
+} JpegComponent;
+
+typedef struct BitWriter {
+    std::vector<uint8_t> *out;
+    uint32_t buffer;
+    int bits;
+} BitWriter;
+
+// deflate packs bits LSB first (and never stuffs bytes)
+typedef struct DeflateWriter {
+    std::vector<uint8_t> *out;
+    uint64_t buffer;
+    int bits;
+} DeflateWriter;
+
+typedef struct LzToken {
+    uint16_t length;   // 0: literal
+    uint16_t value;    // literal byte or match distance
+} LzToken;
+
+static uint32_t NextRandom(uint32_t *state);
+static void BuildHuffTable(const uint8_t *bits, const uint8_t *values, JpegHuffTable *table);
+static void ScaleQuantTable(const uint8_t *base, int quality, uint8_t *table);
+static void ForwardDct(const float *samples, const uint8_t *quant, int16_t *zigzag);
+static void QuantizePlane(const std::vector<float>& plane, int stride, const uint8_t *quant, JpegComponent *comp);
+static void PutBits(BitWriter *bw, uint32_t code, int length);
+static void FlushBits(BitWriter *bw);
+static void EncodeValue(BitWriter *bw, const JpegHuffTable& table, int run, int value);
+static void EncodeBlock(BitWriter *bw, const int16_t *zigzag, int *dc_pred, const JpegHuffTable& dc, const JpegHuffTable& ac);
+static void EncodeAcBand(BitWriter *bw, const int16_t *zigzag, int start, int end, const JpegHuffTable& ac);
+static void PutScanHeader(std::vector<uint8_t>& out, int num_comps, const int *comps, int start, int end);
+static void PutMarker(std::vector<uint8_t>& out, uint8_t marker, int length);
+static void PutHuffSegment(std::vector<uint8_t>& out, int table_class, int id, const uint8_t *bits, const uint8_t *values);
+static int FilterRow(const uint8_t *row, const uint8_t *prior, int length, int bpp, int filter, uint8_t *out);
+static std::vector<uint8_t> ZlibCompress(const std::vector<uint8_t>& data);
+static void FindMatches(const std::vector<uint8_t>& data, std::vector<LzToken> *tokens);
+static void WriteDeflateBlock(DeflateWriter *dw, const LzToken *tokens, size_t count, bool final);
+static void BuildHuffLengths(const uint32_t *freq, int num, int max_length, uint8_t *lengths);
+static void BuildDeflateCodes(const uint8_t *lengths, int num, uint16_t *codes);
+static int LengthSymbol(int length, int *extra_bits, int *extra);
+static int DistanceSymbol(int distance, int *extra_bits, int *extra);
+static void PutBitsLsb(DeflateWriter *dw, uint32_t value, int length);
+static uint32_t Crc32(const uint8_t *data, size_t length, uint32_t crc);
+static void PutChunk(std::vector<uint8_t>& out, const char *type, const uint8_t *data, size_t length);
+static void PutBigEndian32(std::vector<uint8_t>& out, uint32_t value);
+static void PutRgbeRun(std::vector<uint8_t>& out, const uint8_t *values, int count);
+
+// zigzag index -> natural (row-major) index
+static const uint8_t kZigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// JPEG spec Annex K tables (natural order)
+static const uint8_t kQuantLuma[64] = {
+    16, 11, 10, 16, 24, 40, 51, 61,   12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56,   14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68,109,103, 77,   24, 35, 55, 64, 81,104,113, 92,
+    49, 64, 78, 87,103,121,120,101,   72, 92, 95, 98,112,100,103, 99
+};
+static const uint8_t kQuantChroma[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99,   18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,   47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,   99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,   99, 99, 99, 99, 99, 99, 99, 99
+};
+
+static const uint8_t kDcLumaBits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t kDcChromaBits[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t kDcValues[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static const uint8_t kAcLumaBits[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const uint8_t kAcLumaValues[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+static const uint8_t kAcChromaBits[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t kAcChromaValues[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+std::vector<uint8_t> GenerateTestImage(int width, int height, int channels, uint32_t seed)
+{
+    std::vector<uint8_t> pixels((size_t)width * height * channels);
+    uint32_t state = seed * 2654435761u + 1;
+
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t *row = pixels.data() + (size_t)y * width * channels;
+        for (int x = 0; x < width; x++)
+        {
+            // large smooth gradients, a grid of hard edges (planks / tiles)
+            // and a little per-pixel grain so the entropy coder has work to do
+            int grid = (((x >> 6) ^ (y >> 6)) & 1) ? 48 : 0;
+            int grain = (int)(NextRandom(&state) >> 28) - 8;
+            for (int c = 0; c < channels; c++)
+            {
+                int value;
+                if (c == 3)
+                {
+                    value = 255 - ((x + y) & 0x3f);
+                }
+                else
+                {
+                    int gradient = (c == 0) ? (x * 255 / width) : (c == 1) ? (y * 255 / height) : ((x + y) * 127 / (width + height));
+                    value = gradient / 2 + 64 + grid + grain;
+                }
+                row[x * channels + c] = (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+            }
+        }
+    }
+
+    return pixels;
+}
+
+std::vector<float> GenerateTestImageHdr(int width, int height, uint32_t seed)
+{
+    std::vector<uint8_t> ldr = GenerateTestImage(width, height, 3, seed);
+    std::vector<float> rgb((size_t)width * height * 3);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            // -4 to +6 stops across the diagonal
+            float exposure = exp2f(10.0f * (float)(x + y) / (float)(width + height) - 4.0f);
+            size_t i = ((size_t)y * width + x) * 3;
+            for (int c = 0; c < 3; c++)
+            {
+                float v = ldr[i + c] / 255.0f;
+                rgb[i + c] = v * v * exposure;
+            }
+        }
+    }
+
+    return rgb;
+}
+
+std::vector<uint8_t> EncodeJpeg(const uint8_t *rgb, int width, int height, int quality, bool progressive)
+{
+    JpegHuffTable dc_luma, dc_chroma, ac_luma, ac_chroma;
+    BuildHuffTable(kDcLumaBits, kDcValues, &dc_luma);
+    BuildHuffTable(kDcChromaBits, kDcValues, &dc_chroma);
+    BuildHuffTable(kAcLumaBits, kAcLumaValues, &ac_luma);
+    BuildHuffTable(kAcChromaBits, kAcChromaValues, &ac_chroma);
+
+    uint8_t quant[2][64];
+    ScaleQuantTable(kQuantLuma, quality, quant[0]);
+    ScaleQuantTable(kQuantChroma, quality, quant[1]);
+
+    // color convert into planes padded to whole 16x16 MCUs (edge replicated),
+    // chroma averaged 2x2
+    int mcus_x = (width + 15) / 16;
+    int mcus_y = (height + 15) / 16;
+    int luma_w = mcus_x * 16;
+    int luma_h = mcus_y * 16;
+    int chroma_w = mcus_x * 8;
+    int chroma_h = mcus_y * 8;
+    std::vector<float> plane_y((size_t)luma_w * luma_h);
+    std::vector<float> plane_cb((size_t)chroma_w * chroma_h, 0.0f);
+    std::vector<float> plane_cr((size_t)chroma_w * chroma_h, 0.0f);
+    for (int y = 0; y < luma_h; y++)
+    {
+        const uint8_t *row = rgb + (size_t)(y < height ? y : height - 1) * width * 3;
+        for (int x = 0; x < luma_w; x++)
+        {
+            const uint8_t *px = row + (x < width ? x : width - 1) * 3;
+            float r = px[0];
+            float g = px[1];
+            float b = px[2];
+            size_t c = (size_t)(y / 2) * chroma_w + (x / 2);
+            plane_y[(size_t)y * luma_w + x] = 0.299f * r + 0.587f * g + 0.114f * b;
+            plane_cb[c] += 0.25f * (-0.168736f * r - 0.331264f * g + 0.5f * b + 128.0f);
+            plane_cr[c] += 0.25f * (0.5f * r - 0.418688f * g - 0.081312f * b + 128.0f);
+        }
+    }
+
+    JpegComponent comps[3];
+    comps[0].blocks_x = mcus_x * 2;
+    comps[0].blocks_y = mcus_y * 2;
+    comps[0].quant_id = 0;
+    for (int c = 1; c < 3; c++)
+    {
+        comps[c].blocks_x = mcus_x;
+        comps[c].blocks_y = mcus_y;
+        comps[c].quant_id = 1;
+    }
+    QuantizePlane(plane_y, luma_w, quant[0], &comps[0]);
+    QuantizePlane(plane_cb, chroma_w, quant[1], &comps[1]);
+    QuantizePlane(plane_cr, chroma_w, quant[1], &comps[2]);
+
+    std::vector<uint8_t> out;
+    out.reserve((size_t)width * height / 2);
+
+    // SOI + JFIF APP0
+    out.push_back(0xff);
+    out.push_back(0xd8);
+    static const uint8_t jfif[14] = {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0};
+    PutMarker(out, 0xe0, 2 + sizeof(jfif));
+    out.insert(out.end(), jfif, jfif + sizeof(jfif));
+
+    // DQT (stored in zigzag order)
+    for (int t = 0; t < 2; t++)
+    {
+        PutMarker(out, 0xdb, 2 + 65);
+        out.push_back((uint8_t)t);
+        for (int k = 0; k < 64; k++)
+        {
+            out.push_back(quant[t][kZigzag[k]]);
+        }
+    }
+
+    // SOF0 / SOF2
+    PutMarker(out, progressive ? 0xc2 : 0xc0, 2 + 6 + 3 * 3);
+    out.push_back(8);
+    out.push_back((uint8_t)(height >> 8));
+    out.push_back((uint8_t)height);
+    out.push_back((uint8_t)(width >> 8));
+    out.push_back((uint8_t)width);
+    out.push_back(3);
+    for (int c = 0; c < 3; c++)
+    {
+        out.push_back((uint8_t)(c + 1));
+        out.push_back(c == 0 ? 0x22 : 0x11);
+        out.push_back((uint8_t)comps[c].quant_id);
+    }
+
+    // DHT
+    PutHuffSegment(out, 0, 0, kDcLumaBits, kDcValues);
+    PutHuffSegment(out, 1, 0, kAcLumaBits, kAcLumaValues);
+    PutHuffSegment(out, 0, 1, kDcChromaBits, kDcValues);
+    PutHuffSegment(out, 1, 1, kAcChromaBits, kAcChromaValues);
+
+    // SOS, all three components interleaved; a progressive file only sends
+    // the DC coefficients in this scan
+    static const int all_comps[3] = {0, 1, 2};
+    PutScanHeader(out, 3, all_comps, 0, progressive ? 0 : 63);
+
+    BitWriter bw;
+    bw.out = &out;
+    bw.buffer = 0;
+    bw.bits = 0;
+    int dc_pred[3] = {0, 0, 0};
+    for (int my = 0; my < mcus_y; my++)
+    {
+        for (int mx = 0; mx < mcus_x; mx++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                int blocks = (c == 0) ? 2 : 1;
+                for (int by = 0; by < blocks; by++)
+                {
+                    for (int bx = 0; bx < blocks; bx++)
+                    {
+                        size_t block = (size_t)(my * blocks + by) * comps[c].blocks_x + (mx * blocks + bx);
+                        const int16_t *zigzag = &comps[c].coeff[block * 64];
+                        if (progressive)
+                        {
+                            EncodeValue(&bw, c == 0 ? dc_luma : dc_chroma, 0, zigzag[0] - dc_pred[c]);
+                            dc_pred[c] = zigzag[0];
+                        }
+                        else
+                        {
+                            EncodeBlock(&bw, zigzag, &dc_pred[c], c == 0 ? dc_luma : dc_chroma, c == 0 ? ac_luma : ac_chroma);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    FlushBits(&bw);
+
+    // progressive AC: spectral selection only (no successive approximation),
+    // a low and a high band per component, as in libjpeg's simplest scripts.
+    // single-component scans cover the component's own block grid, not the
+    // MCU-padded one
+    static const int bands[2][2] = {{1, 5}, {6, 63}};
+    for (int b = 0; progressive && b < 2; b++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            PutScanHeader(out, 1, &c, bands[b][0], bands[b][1]);
+            int comp_w = (c == 0) ? width : (width + 1) / 2;
+            int comp_h = (c == 0) ? height : (height + 1) / 2;
+            for (int by = 0; by < (comp_h + 7) / 8; by++)
+            {
+                for (int bx = 0; bx < (comp_w + 7) / 8; bx++)
+                {
+                    size_t block = (size_t)by * comps[c].blocks_x + bx;
+                    EncodeAcBand(&bw, &comps[c].coeff[block * 64], bands[b][0], bands[b][1], c == 0 ? ac_luma : ac_chroma);
+                }
+            }
+            FlushBits(&bw);
+        }
+    }
+
+    // EOI
+    out.push_back(0xff);
+    out.push_back(0xd9);
+
+    return out;
+}
+
+std::vector<uint8_t> EncodePng(const uint8_t *pixels, int width, int height, int channels, int bit_depth)
+{
+    static const uint8_t color_types[5] = {0, 0, 4, 2, 6};
+    int bpp = channels * bit_depth / 8;
+    int row_bytes = width * bpp;
+
+    // filter each row with whichever filter leaves the smallest residuals
+    // (the usual libpng heuristic), so all five filter types show up
+    std::vector<uint8_t> filtered((size_t)(row_bytes + 1) * height);
+    std::vector<uint8_t> zero_row(row_bytes, 0);
+    std::vector<uint8_t> candidate(row_bytes);
+    for (int y = 0; y < height; y++)
+    {
+        const uint8_t *row = pixels + (size_t)y * row_bytes;
+        const uint8_t *prior = (y > 0) ? row - row_bytes : zero_row.data();
+        uint8_t *out = filtered.data() + (size_t)y * (row_bytes + 1);
+        int best_cost = -1;
+        for (int filter = 0; filter < 5; filter++)
+        {
+            int cost = FilterRow(row, prior, row_bytes, bpp, filter, candidate.data());
+            if (best_cost < 0 || cost < best_cost)
+            {
+                best_cost = cost;
+                out[0] = (uint8_t)filter;
+                memcpy(out + 1, candidate.data(), row_bytes);
+            }
+        }
+    }
+
+    std::vector<uint8_t> out;
+    static const uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    out.insert(out.end(), signature, signature + 8);
+
+    std::vector<uint8_t> ihdr;
+    PutBigEndian32(ihdr, (uint32_t)width);
+    PutBigEndian32(ihdr, (uint32_t)height);
+    ihdr.push_back((uint8_t)bit_depth);
+    ihdr.push_back(color_types[channels]);
+    ihdr.push_back(0); // deflate
+    ihdr.push_back(0); // adaptive filtering
+    ihdr.push_back(0); // not interlaced
+    PutChunk(out, "IHDR", ihdr.data(), ihdr.size());
+
+    std::vector<uint8_t> idat = ZlibCompress(filtered);
+    PutChunk(out, "IDAT", idat.data(), idat.size());
+    PutChunk(out, "IEND", NULL, 0);
+
+    return out;
+}
+
+std::vector<uint8_t> EncodeHdr(const float *rgb, int width, int height)
+{
+    std::vector<uint8_t> out;
+    char header[128];
+    int length = snprintf(header, sizeof(header), "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", height, width);
+    out.insert(out.end(), header, header + length);
+
+    // scanlines outside 8..32767 pixels can't be run-length encoded
+    bool rle = width >= 8 && width < 32768;
+    std::vector<uint8_t> rgbe((size_t)width * 4);
+    std::vector<uint8_t> channel(width);
+    for (int y = 0; y < height; y++)
+    {
+        const float *row = rgb + (size_t)y * width * 3;
+        for (int x = 0; x < width; x++)
+        {
+            float v = std::max(row[x * 3], std::max(row[x * 3 + 1], row[x * 3 + 2]));
+            uint8_t *px = &rgbe[x * 4];
+            if (v < 1.0e-32f)
+            {
+                px[0] = px[1] = px[2] = px[3] = 0;
+                continue;
+            }
+            int exponent;
+            float scale = frexpf(v, &exponent) * 256.0f / v;
+            px[0] = (uint8_t)(row[x * 3] * scale);
+            px[1] = (uint8_t)(row[x * 3 + 1] * scale);
+            px[2] = (uint8_t)(row[x * 3 + 2] * scale);
+            px[3] = (uint8_t)(exponent + 128);
+        }
+
+        if (!rle)
+        {
+            out.insert(out.end(), rgbe.begin(), rgbe.end());
+            continue;
+        }
+        out.push_back(2);
+        out.push_back(2);
+        out.push_back((uint8_t)(width >> 8));
+        out.push_back((uint8_t)width);
+        for (int c = 0; c < 4; c++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                channel[x] = rgbe[x * 4 + c];
+            }
+            PutRgbeRun(out, channel.data(), width);
+        }
+    }
+
+    return out;
+}
+
+std::vector<uint8_t> EncodeGif(const uint8_t *rgb, int width, int height)
+{
+    std::vector<uint8_t> out;
+    static const char signature[6] = {'G', 'I', 'F', '8', '9', 'a'};
+    out.insert(out.end(), signature, signature + 6);
+    out.push_back((uint8_t)width);
+    out.push_back((uint8_t)(width >> 8));
+    out.push_back((uint8_t)height);
+    out.push_back((uint8_t)(height >> 8));
+    out.push_back(0xf7); // global color table, 8 bits per primary, 256 entries
+    out.push_back(0);    // background index
+    out.push_back(0);    // aspect ratio
+
+    // 6x7x6 color cube (green gets the extra level), padded with black
+    for (int i = 0; i < 256; i++)
+    {
+        bool used = i < 6 * 7 * 6;
+        out.push_back(used ? (uint8_t)(i / 42 * 255 / 5) : 0);
+        out.push_back(used ? (uint8_t)(i / 6 % 7 * 255 / 6) : 0);
+        out.push_back(used ? (uint8_t)(i % 6 * 255 / 5) : 0);
+    }
+
+    // image descriptor: whole canvas, no local color table, not interlaced
+    out.push_back(0x2c);
+    for (int i = 0; i < 4; i++)
+    {
+        out.push_back(0);
+    }
+    out.push_back((uint8_t)width);
+    out.push_back((uint8_t)(width >> 8));
+    out.push_back((uint8_t)height);
+    out.push_back((uint8_t)(height >> 8));
+    out.push_back(0);
+
+    // LZW: (prefix code, next index) -> code in an open-addressed hash
+    // table, wiped at every clear code
+    const int clear_code = 256;
+    const int hash_size = 8192;
+    std::vector<uint32_t> hash_key(hash_size);
+    std::vector<uint16_t> hash_code(hash_size);
+    std::vector<uint8_t> codes;
+    DeflateWriter dw;   // GIF packs codes LSB first as well
+    dw.out = &codes;
+    dw.buffer = 0;
+    dw.bits = 0;
+    int next_code = clear_code + 2;
+    int code_size = 9;
+    std::fill(hash_key.begin(), hash_key.end(), 0);
+    PutBitsLsb(&dw, clear_code, code_size);
+
+    size_t num_pixels = (size_t)width * height;
+    int prefix = -1;
+    for (size_t p = 0; p < num_pixels; p++)
+    {
+        const uint8_t *px = rgb + p * 3;
+        int index = ((px[0] * 5 + 127) / 255 * 7 + (px[1] * 6 + 127) / 255) * 6 + (px[2] * 5 + 127) / 255;
+        if (prefix < 0)
+        {
+            prefix = index;
+            continue;
+        }
+        uint32_t key = ((uint32_t)prefix << 8 | (uint32_t)index) + 1;
+        uint32_t slot = (key * 2654435761u) >> 19;
+        while (hash_key[slot] != 0 && hash_key[slot] != key)
+        {
+            slot = (slot + 1) & (hash_size - 1);
+        }
+        if (hash_key[slot] == key)
+        {
+            prefix = hash_code[slot];
+            continue;
+        }
+
+        PutBitsLsb(&dw, prefix, code_size);
+        if (next_code < 4096)
+        {
+            hash_key[slot] = key;
+            hash_code[slot] = (uint16_t)next_code++;
+            // the decoder adds its entry one code later, and widens its
+            // codes once it holds 1 << code_size of them
+            if (next_code > (1 << code_size) && code_size < 12)
+            {
+                code_size++;
+            }
+        }
+        else
+        {
+            PutBitsLsb(&dw, clear_code, code_size);
+            std::fill(hash_key.begin(), hash_key.end(), 0);
+            next_code = clear_code + 2;
+            code_size = 9;
+        }
+        prefix = index;
+    }
+    if (prefix >= 0)
+    {
+        PutBitsLsb(&dw, prefix, code_size);
+    }
+    PutBitsLsb(&dw, clear_code + 1, code_size);
+    if (dw.bits > 0)
+    {
+        PutBitsLsb(&dw, 0, 8 - dw.bits);
+    }
+
+    out.push_back(8); // LZW minimum code size
+    for (size_t i = 0; i < codes.size(); i += 255)
+    {
+        size_t count = std::min((size_t)255, codes.size() - i);
+        out.push_back((uint8_t)count);
+        out.insert(out.end(), codes.begin() + i, codes.begin() + i + count);
+    }
+    out.push_back(0);
+    out.push_back(0x3b);
+
+    return out;
+}
+
+
+// Auxillary functions
+uint32_t NextRandom(uint32_t *state)
+{
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+void BuildHuffTable(const uint8_t *bits, const uint8_t *values, JpegHuffTable *table)
+{
+    memset(table, 0, sizeof(JpegHuffTable));
+    uint16_t code = 0;
+    int k = 0;
+    for (int length = 1; length <= 16; length++)
+    {
+        for (int i = 0; i < bits[length - 1]; i++)
+        {
+            table->code[values[k]] = code;
+            table->size[values[k]] = (uint8_t)length;
+            code++;
+            k++;
+        }
+        code <<= 1;
+    }
+}
+
+void ScaleQuantTable(const uint8_t *base, int quality, uint8_t *table)
+{
+    // IJG quality scaling
+    if (quality < 1) quality = 1;
+    if (quality > 100) quality = 100;
+    int scale = (quality < 50) ? (5000 / quality) : (200 - quality * 2);
+    for (int i = 0; i < 64; i++)
+    {
+        int q = (base[i] * scale + 50) / 100;
+        table[i] = (uint8_t)(q < 1 ? 1 : (q > 255 ? 255 : q));
+    }
+}
+
+void ForwardDct(const float *samples, const uint8_t *quant, int16_t *zigzag)
+{
+    static float basis[8][8];
+    static bool basis_ready = false;
+    if (!basis_ready)
+    {
+        for (int u = 0; u < 8; u++)
+        {
+            float scale = (u == 0) ? (float)M_SQRT1_2 * 0.5f : 0.5f;
+            for (int x = 0; x < 8; x++)
+            {
+                basis[u][x] = scale * (float)cos((2.0 * x + 1.0) * u * M_PI / 16.0);
+            }
+        }
+        basis_ready = true;
+    }
+
+    // separable 2D DCT: rows then columns
+    float tmp[64];
+    float coeff[64];
+    for (int y = 0; y < 8; y++)
+    {
+        for (int u = 0; u < 8; u++)
+        {
+            float sum = 0.0f;
+            for (int x = 0; x < 8; x++)
+            {
+                sum += basis[u][x] * (samples[y * 8 + x] - 128.0f);
+            }
+            tmp[y * 8 + u] = sum;
+        }
+    }
+    for (int u = 0; u < 8; u++)
+    {
+        for (int v = 0; v < 8; v++)
+        {
+            float sum = 0.0f;
+            for (int y = 0; y < 8; y++)
+            {
+                sum += basis[v][y] * tmp[y * 8 + u];
+            }
+            coeff[v * 8 + u] = sum;
+        }
+    }
+
+    for (int k = 0; k < 64; k++)
+    {
+        int n = kZigzag[k];
+        // baseline Huffman categories top out at 11 bits (DC) / 10 bits (AC)
+        int limit = (k == 0) ? 2047 : 1023;
+        int q = (int)lrintf(coeff[n] / quant[n]);
+        zigzag[k] = (int16_t)(q < -limit ? -limit : (q > limit ? limit : q));
+    }
+}
+
+void QuantizePlane(const std::vector<float>& plane, int stride, const uint8_t *quant, JpegComponent *comp)
+{
+    comp->coeff.resize((size_t)comp->blocks_x * comp->blocks_y * 64);
+    float samples[64];
+    for (int by = 0; by < comp->blocks_y; by++)
+    {
+        for (int bx = 0; bx < comp->blocks_x; bx++)
+        {
+            for (int y = 0; y < 8; y++)
+            {
+                memcpy(samples + y * 8, &plane[(size_t)(by * 8 + y) * stride + bx * 8], 8 * sizeof(float));
+            }
+            size_t block = (size_t)by * comp->blocks_x + bx;
+            ForwardDct(samples, quant, &comp->coeff[block * 64]);
+        }
+    }
+}
+
+void PutBits(BitWriter *bw, uint32_t code, int length)
+{
+    bw->buffer = (bw->buffer << length) | (code & ((1u << length) - 1));
+    bw->bits += length;
+    while (bw->bits >= 8)
+    {
+        uint8_t byte = (uint8_t)(bw->buffer >> (bw->bits - 8));
+        bw->out->push_back(byte);
+        if (byte == 0xff)
+        {
+            bw->out->push_back(0x00);
+        }
+        bw->bits -= 8;
+    }
+}
+
+void FlushBits(BitWriter *bw)
+{
+    // pad the final byte with 1s
+    if (bw->bits > 0)
+    {
+        PutBits(bw, 0x7f, 8 - bw->bits);
+    }
+    bw->buffer = 0;
+}
+
+void EncodeValue(BitWriter *bw, const JpegHuffTable& table, int run, int value)
+{
+    int magnitude = value < 0 ? -value : value;
+    int category = 0;
+    while (magnitude >> category)
+    {
+        category++;
+    }
+    int symbol = (run << 4) | category;
+    PutBits(bw, table.code[symbol], table.size[symbol]);
+    if (category > 0)
+    {
+        PutBits(bw, value < 0 ? (uint32_t)(value - 1) : (uint32_t)value, category);
+    }
+}
+
+void EncodeBlock(BitWriter *bw, const int16_t *zigzag, int *dc_pred, const JpegHuffTable& dc, const JpegHuffTable& ac)
+{
+    EncodeValue(bw, dc, 0, zigzag[0] - *dc_pred);
+    *dc_pred = zigzag[0];
+
+    int run = 0;
+    for (int k = 1; k < 64; k++)
+    {
+        if (zigzag[k] == 0)
+        {
+            run++;
+            continue;
+        }
+        while (run > 15)
+        {
+            PutBits(bw, ac.code[0xf0], ac.size[0xf0]);
+            run -= 16;
+        }
+        EncodeValue(bw, ac, run, zigzag[k]);
+        run = 0;
+    }
+    if (run > 0)
+    {
+        PutBits(bw, ac.code[0x00], ac.size[0x00]);
+    }
+}
+
+void EncodeAcBand(BitWriter *bw, const int16_t *zigzag, int start, int end, const JpegHuffTable& ac)
+{
+    // the standard tables have no EOB run symbols, so every block that ends
+    // in zeros gets its own EOB (an EOBRUN of 1)
+    int run = 0;
+    for (int k = start; k <= end; k++)
+    {
+        if (zigzag[k] == 0)
+        {
+            run++;
+            continue;
+        }
+        while (run > 15)
+        {
+            PutBits(bw, ac.code[0xf0], ac.size[0xf0]);
+            run -= 16;
+        }
+        EncodeValue(bw, ac, run, zigzag[k]);
+        run = 0;
+    }
+    if (run > 0)
+    {
+        PutBits(bw, ac.code[0x00], ac.size[0x00]);
+    }
+}
+
+void PutScanHeader(std::vector<uint8_t>& out, int num_comps, const int *comps, int start, int end)
+{
+    // component 0 uses the luma tables (0), the others the chroma tables (1)
+    PutMarker(out, 0xda, 2 + 1 + num_comps * 2 + 3);
+    out.push_back((uint8_t)num_comps);
+    for (int i = 0; i < num_comps; i++)
+    {
+        out.push_back((uint8_t)(comps[i] + 1));
+        out.push_back(comps[i] == 0 ? 0x00 : 0x11);
+    }
+    out.push_back((uint8_t)start);
+    out.push_back((uint8_t)end);
+    out.push_back(0);
+}
+
+void PutMarker(std::vector<uint8_t>& out, uint8_t marker, int length)
+{
+    out.push_back(0xff);
+    out.push_back(marker);
+    out.push_back((uint8_t)(length >> 8));
+    out.push_back((uint8_t)length);
+}
+
+void PutHuffSegment(std::vector<uint8_t>& out, int table_class, int id, const uint8_t *bits, const uint8_t *values)
+{
+    int count = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        count += bits[i];
+    }
+    PutMarker(out, 0xc4, 2 + 1 + 16 + count);
+    out.push_back((uint8_t)((table_class << 4) | id));
+    out.insert(out.end(), bits, bits + 16);
+    out.insert(out.end(), values, values + count);
+}
+
+int FilterRow(const uint8_t *row, const uint8_t *prior, int length, int bpp, int filter, uint8_t *out)
+{
+    int cost = 0;
+    for (int i = 0; i < length; i++)
+    {
+        int a = (i >= bpp) ? row[i - bpp] : 0;
+        int b = prior[i];
+        int c = (i >= bpp) ? prior[i - bpp] : 0;
+        int predict = 0;
+        switch (filter)
+        {
+            case 1: predict = a; break;
+            case 2: predict = b; break;
+            case 3: predict = (a + b) >> 1; break;
+            case 4:
+            {
+                int p = a + b - c;
+                int pa = abs(p - a);
+                int pb = abs(p - b);
+                int pc = abs(p - c);
+                predict = (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+                break;
+            }
+        }
+        out[i] = (uint8_t)(row[i] - predict);
+        cost += (out[i] < 128) ? out[i] : 256 - out[i];
+    }
+    return cost;
+}
+
+std::vector<uint8_t> ZlibCompress(const std::vector<uint8_t>& data)
+{
+    std::vector<LzToken> tokens;
+    FindMatches(data, &tokens);
+
+    std::vector<uint8_t> out;
+    out.reserve(data.size() / 2);
+    out.push_back(0x78); // deflate, 32K window
+    out.push_back(0x9c);
+
+    // one dynamic Huffman block per 64K tokens
+    DeflateWriter dw;
+    dw.out = &out;
+    dw.buffer = 0;
+    dw.bits = 0;
+    const size_t block_tokens = 65536;
+    size_t start = 0;
+    do
+    {
+        size_t count = std::min(block_tokens, tokens.size() - start);
+        WriteDeflateBlock(&dw, tokens.data() + start, count, start + count == tokens.size());
+        start += count;
+    } while (start < tokens.size());
+    if (dw.bits > 0)
+    {
+        PutBitsLsb(&dw, 0, 8 - (dw.bits & 7));
+    }
+
+    uint32_t s1 = 1, s2 = 0;
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        s1 = (s1 + data[i]) % 65521;
+        s2 = (s2 + s1) % 65521;
+    }
+    PutBigEndian32(out, (s2 << 16) | s1);
+
+    return out;
+}
+
+void FindMatches(const std::vector<uint8_t>& data, std::vector<LzToken> *tokens)
+{
+    // greedy LZ77 over 3-byte hash chains, 32K window
+    const int window = 32768;
+    const int max_chain = 32;
+    const int hash_bits = 15;
+    std::vector<int> head(1 << hash_bits, -1);
+    std::vector<int> prev(window, -1);
+    int size = (int)data.size();
+
+    int pos = 0;
+    while (pos < size)
+    {
+        int best_length = 0;
+        int best_distance = 0;
+        if (pos + 3 <= size)
+        {
+            uint32_t hash = ((data[pos] << 10) ^ (data[pos + 1] << 5) ^ data[pos + 2]) & ((1 << hash_bits) - 1);
+            int max_length = std::min(258, size - pos);
+            int candidate = head[hash];
+            for (int chain = 0; chain < max_chain && candidate >= 0 && pos - candidate <= window; chain++)
+            {
+                int length = 0;
+                while (length < max_length && data[candidate + length] == data[pos + length])
+                {
+                    length++;
+                }
+                if (length > best_length)
+                {
+                    best_length = length;
+                    best_distance = pos - candidate;
+                    if (length == max_length) break;
+                }
+                candidate = prev[candidate % window];
+            }
+            prev[pos % window] = head[hash];
+            head[hash] = pos;
+        }
+
+        LzToken token;
+        if (best_length >= 3)
+        {
+            token.length = (uint16_t)best_length;
+            token.value = (uint16_t)best_distance;
+            // keep the hash chains complete across the match
+            for (int i = pos + 1; i < pos + best_length && i + 3 <= size; i++)
+            {
+                uint32_t hash = ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1 << hash_bits) - 1);
+                prev[i % window] = head[hash];
+                head[hash] = i;
+            }
+            pos += best_length;
+        }
+        else
+        {
+            token.length = 0;
+            token.value = data[pos];
+            pos++;
+        }
+        tokens->push_back(token);
+    }
+}
+
+void WriteDeflateBlock(DeflateWriter *dw, const LzToken *tokens, size_t count, bool final)
+{
+    static const uint8_t code_length_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    int extra_bits, extra;
+
+    uint32_t lit_freq[286] = {0};
+    uint32_t dist_freq[30] = {0};
+    for (size_t i = 0; i < count; i++)
+    {
+        if (tokens[i].length == 0)
+        {
+            lit_freq[tokens[i].value]++;
+        }
+        else
+        {
+            lit_freq[LengthSymbol(tokens[i].length, &extra_bits, &extra)]++;
+            dist_freq[DistanceSymbol(tokens[i].value, &extra_bits, &extra)]++;
+        }
+    }
+    lit_freq[256] = 1;
+    // a block with no matches still needs a (one code) distance tree
+    if (std::count(dist_freq, dist_freq + 30, 0u) == 30)
+    {
+        dist_freq[0] = 1;
+    }
+
+    uint8_t lengths[286 + 30];
+    uint16_t lit_codes[286], dist_codes[30];
+    BuildHuffLengths(lit_freq, 286, 15, lengths);
+    BuildHuffLengths(dist_freq, 30, 15, lengths + 286);
+    BuildDeflateCodes(lengths, 286, lit_codes);
+    BuildDeflateCodes(lengths + 286, 30, dist_codes);
+
+    int hlit = 286;
+    while (hlit > 257 && lengths[hlit - 1] == 0) hlit--;
+    int hdist = 30;
+    while (hdist > 1 && lengths[286 + hdist - 1] == 0) hdist--;
+
+    // code lengths are sent literally (symbols 0-15, no run-length codes)
+    uint8_t all_lengths[286 + 30];
+    memcpy(all_lengths, lengths, hlit);
+    memcpy(all_lengths + hlit, lengths + 286, hdist);
+    uint32_t cl_freq[19] = {0};
+    for (int i = 0; i < hlit + hdist; i++)
+    {
+        cl_freq[all_lengths[i]]++;
+    }
+    uint8_t cl_lengths[19];
+    uint16_t cl_codes[19];
+    BuildHuffLengths(cl_freq, 19, 7, cl_lengths);
+    BuildDeflateCodes(cl_lengths, 19, cl_codes);
+    int hclen = 19;
+    while (hclen > 4 && cl_lengths[code_length_order[hclen - 1]] == 0) hclen--;
+
+    PutBitsLsb(dw, final ? 1 : 0, 1);
+    PutBitsLsb(dw, 2, 2);
+    PutBitsLsb(dw, hlit - 257, 5);
+    PutBitsLsb(dw, hdist - 1, 5);
+    PutBitsLsb(dw, hclen - 4, 4);
+    for (int i = 0; i < hclen; i++)
+    {
+        PutBitsLsb(dw, cl_lengths[code_length_order[i]], 3);
+    }
+    for (int i = 0; i < hlit + hdist; i++)
+    {
+        PutBitsLsb(dw, cl_codes[all_lengths[i]], cl_lengths[all_lengths[i]]);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (tokens[i].length == 0)
+        {
+            PutBitsLsb(dw, lit_codes[tokens[i].value], lengths[tokens[i].value]);
+        }
+        else
+        {
+            int symbol = LengthSymbol(tokens[i].length, &extra_bits, &extra);
+            PutBitsLsb(dw, lit_codes[symbol], lengths[symbol]);
+            PutBitsLsb(dw, extra, extra_bits);
+            symbol = DistanceSymbol(tokens[i].value, &extra_bits, &extra);
+            PutBitsLsb(dw, dist_codes[symbol], lengths[286 + symbol]);
+            PutBitsLsb(dw, extra, extra_bits);
+        }
+    }
+    PutBitsLsb(dw, lit_codes[256], lengths[256]);
+}
+
+void BuildHuffLengths(const uint32_t *freq, int num, int max_length, uint8_t *lengths)
+{
+    // plain Huffman construction; if the tree comes out too deep, flatten
+    // the frequencies and try again
+    std::vector<uint32_t> weights(freq, freq + num);
+    for (;;)
+    {
+        memset(lengths, 0, num);
+        std::vector<int> parent(2 * num, -1);
+        std::priority_queue<std::pair<uint64_t, int>, std::vector<std::pair<uint64_t, int> >, std::greater<std::pair<uint64_t, int> > > heap;
+        int used = 0;
+        for (int i = 0; i < num; i++)
+        {
+            if (weights[i] > 0)
+            {
+                heap.push(std::make_pair((uint64_t)weights[i], i));
+                used++;
+            }
+        }
+        if (used == 0) return;
+        if (used == 1)
+        {
+            lengths[heap.top().second] = 1;
+            return;
+        }
+
+        int next = num;
+        while (heap.size() > 1)
+        {
+            std::pair<uint64_t, int> a = heap.top();
+            heap.pop();
+            std::pair<uint64_t, int> b = heap.top();
+            heap.pop();
+            parent[a.second] = next;
+            parent[b.second] = next;
+            heap.push(std::make_pair(a.first + b.first, next));
+            next++;
+        }
+
+        int deepest = 0;
+        for (int i = 0; i < num; i++)
+        {
+            if (weights[i] == 0) continue;
+            int depth = 0;
+            for (int node = i; parent[node] >= 0; node = parent[node])
+            {
+                depth++;
+            }
+            lengths[i] = (uint8_t)depth;
+            deepest = std::max(deepest, depth);
+        }
+        if (deepest <= max_length) return;
+
+        for (int i = 0; i < num; i++)
+        {
+            if (weights[i] > 0) weights[i] = (weights[i] >> 1) | 1;
+        }
+    }
+}
+
+void BuildDeflateCodes(const uint8_t *lengths, int num, uint16_t *codes)
+{
+    // canonical codes (RFC 1951 3.2.2), bit-reversed for LSB-first output
+    int count[16] = {0};
+    int next_code[16];
+    for (int i = 0; i < num; i++)
+    {
+        count[lengths[i]]++;
+    }
+    count[0] = 0;
+    int code = 0;
+    for (int bits = 1; bits < 16; bits++)
+    {
+        code = (code + count[bits - 1]) << 1;
+        next_code[bits] = code;
+    }
+    for (int i = 0; i < num; i++)
+    {
+        int length = lengths[i];
+        codes[i] = 0;
+        if (length == 0) continue;
+        int value = next_code[length]++;
+        int reversed = 0;
+        for (int b = 0; b < length; b++)
+        {
+            reversed = (reversed << 1) | ((value >> b) & 1);
+        }
+        codes[i] = (uint16_t)reversed;
+    }
+}
+
+int LengthSymbol(int length, int *extra_bits, int *extra)
+{
+    static const int base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const int bits[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    int i = 28;
+    while (base[i] > length) i--;
+    *extra_bits = bits[i];
+    *extra = length - base[i];
+    return 257 + i;
+}
+
+int DistanceSymbol(int distance, int *extra_bits, int *extra)
+{
+    static const int base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const int bits[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    int i = 29;
+    while (base[i] > distance) i--;
+    *extra_bits = bits[i];
+    *extra = distance - base[i];
+    return i;
+}
+
+void PutBitsLsb(DeflateWriter *dw, uint32_t value, int length)
+{
+    dw->buffer |= (uint64_t)value << dw->bits;
+    dw->bits += length;
+    while (dw->bits >= 8)
+    {
+        dw->out->push_back((uint8_t)dw->buffer);
+        dw->buffer >>= 8;
+        dw->bits -= 8;
+    }
+}
+
+uint32_t Crc32(const uint8_t *data, size_t length, uint32_t crc)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int k = 0; k < 8; k++)
+        {
+            crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+void PutChunk(std::vector<uint8_t>& out, const char *type, const uint8_t *data, size_t length)
+{
+    PutBigEndian32(out, (uint32_t)length);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    if (length > 0)
+    {
+        out.insert(out.end(), data, data + length);
+    }
+    PutBigEndian32(out, Crc32(out.data() + start, length + 4, 0));
+}
+
+void PutBigEndian32(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back((uint8_t)(value >> 24));
+    out.push_back((uint8_t)(value >> 16));
+    out.push_back((uint8_t)(value >> 8));
+    out.push_back((uint8_t)value);
+}
+
+void PutRgbeRun(std::vector<uint8_t>& out, const uint8_t *values, int count)
+{
+    // runs of 4 or more equal bytes (up to 127) are worth a 2 byte run code;
+    // everything between them goes out as literal blocks of up to 128
+    int x = 0;
+    while (x < count)
+    {
+        int run_start = x;
+        int run_length = 0;
+        while (run_start < count)
+        {
+            run_length = 1;
+            while (run_start + run_length < count && run_length < 127 && values[run_start + run_length] == values[run_start])
+            {
+                run_length++;
+            }
+            if (run_length >= 4)
+            {
+                break;
+            }
+            run_start += run_length;
+        }
+        while (x < run_start)
+        {
+            int literal = std::min(128, run_start - x);
+            out.push_back((uint8_t)literal);
+            out.insert(out.end(), values + x, values + x + literal);
+            x += literal;
+        }
+        if (run_start < count)
+        {
+            out.push_back((uint8_t)(128 + run_length));
+            out.push_back(values[run_start]);
+            x = run_start + run_length;
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <cstdint>
+#include <vector>
+
+// Synthetic image corpus for the decode benchmarks. Images are generated
+// deterministically from a seed so runs on different nodes are comparable.
+
+// fills a width x height image with texture-like content (gradients, edges
+// and noise), `channels` interleaved 8-bit components per pixel
+std::vector<uint8_t> GenerateTestImage(int width, int height, int channels, uint32_t seed);
+
+// the same content as linear RGB floats spanning several stops (a dim
+// corner to a bright one), for the HDR encoder
+std::vector<float> GenerateTestImageHdr(int width, int height, uint32_t seed);
+
+// JFIF encoder: 8-bit RGB input, YCbCr 4:2:0 output, standard Huffman
+// tables, quality 1-100. progressive files send the DC coefficients first,
+// then two AC bands per component (spectral selection only)
+std::vector<uint8_t> EncodeJpeg(const uint8_t *rgb, int width, int height, int quality, bool progressive);
+
+// non-interlaced PNG encoder: 1-4 channels (gray, gray+alpha, RGB, RGBA) of
+// 8 or 16 bits, rows in PNG byte order (16-bit samples big-endian). rows
+// get adaptive filters and the zlib stream is greedy LZ77 with dynamic
+// Huffman blocks, similar to a default zlib/libpng setup
+std::vector<uint8_t> EncodePng(const uint8_t *pixels, int width, int height, int channels, int bit_depth);
+
+// Radiance RGBE encoder: 3 floats per pixel, run-length encoded scanlines
+// (the "new" RLE that stb_image and most writers use)
+std::vector<uint8_t> EncodeHdr(const float *rgb, int width, int height);
+
+// single-frame GIF89a encoder: 8-bit RGB input mapped onto a 6x7x6 color
+// cube, 8-bit LZW with a clear code whenever the code table fills up
+std::vector<uint8_t> EncodeGif(const uint8_t *rgb, int width, int height);
+
+#endif // CORPUS_H
@@ -0,0 +1,294 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "image_arena.h"
+#define STBI_MALLOC(sz) ImageArenaMalloc(sz)
+#define STBI_REALLOC(p, newsz) ImageArenaRealloc(p, newsz)
+#define STBI_FREE(p) ImageArenaFree(p)
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "corpus.h"
+
+// Decode throughput benchmark for the bundled stb_image.
+//
+// usage: imgbench [-n iterations] [-a] [-s jpeg scale denom] [-f | -c] [image files ...]
+//
+// With no files, a synthetic set of large JPEG and RGBA PNG textures is
+// generated in memory. -a routes stb_image's allocations through an
+// ImageArena that is reset after every decode, and reports its allocation
+// counts. -s 2/4/8 decodes JPEGs at reduced size (throughput is still per
+// output byte). -f decodes by filename with stbi_load() instead of from
+// memory (synthetic inputs are written to $TMPDIR first), so file I/O is
+// part of the timing; -c does the same but evicts each file from the page
+// cache before every decode. Reported throughput is decoded (RGBA) bytes per
+// second. The checksum lets builds with different SIMD kernels (e.g.
+// imgbench vs. imgbench_sse2) or file input paths (imgbench_stdio) be
+// checked for identical output.
+
+enum DecodeSource : uint8_t { FromMemory, FromFileWarm, FromFileCold };
+
+typedef struct BenchInput {
+    std::string name;
+    std::string path;         // file holding data, empty if only in memory
+    bool temporary;
+    std::vector<uint8_t> data;
+} BenchInput;
+
+static bool ReadInput(const char *filename, BenchInput *input);
+static bool WriteTempInput(BenchInput *input);
+static bool EvictFromPageCache(const char *filename);
+static void RunDecode(const BenchInput& input, int iterations, ImageArena *arena, DecodeSource source);
+static uint32_t Checksum(const uint8_t *data, size_t length);
+static double Now();
+
+int main(int argc, char **argv)
+{
+    int iterations = 5;
+    bool use_arena = false;
+    DecodeSource source = FromMemory;
+    std::vector<BenchInput> inputs;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-a") == 0)
+        {
+            use_arena = true;
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            stbi_set_jpeg_scale_denom_on_load(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-f") == 0)
+        {
+            source = FromFileWarm;
+        }
+        else if (strcmp(argv[i], "-c") == 0)
+        {
+            source = FromFileCold;
+        }
+        else
+        {
+            BenchInput input;
+            if (ReadInput(argv[i], &input))
+            {
+                inputs.push_back(input);
+            }
+        }
+    }
+
+    if (inputs.empty())
+    {
+        const int sizes[3] = {1024, 4096, 8192};
+        for (int i = 0; i < 3; i++)
+        {
+            std::vector<uint8_t> rgb = GenerateTestImage(sizes[i], sizes[i], 3, (uint32_t)i);
+            BenchInput input;
+            input.name = "synthetic " + std::to_string(sizes[i]) + "x" + std::to_string(sizes[i]) + " jpeg q90";
+            input.temporary = false;
+            input.data = EncodeJpeg(rgb.data(), sizes[i], sizes[i], 90, false);
+            inputs.push_back(input);
+        }
+        for (int i = 1; i < 3; i++)
+        {
+            std::vector<uint8_t> rgba = GenerateTestImage(sizes[i], sizes[i], 4, (uint32_t)i);
+            BenchInput input;
+            input.name = "synthetic " + std::to_string(sizes[i]) + "x" + std::to_string(sizes[i]) + " png rgba";
+            input.temporary = false;
+            input.data = EncodePng(rgba.data(), sizes[i], sizes[i], 4, 8);
+            inputs.push_back(input);
+        }
+    }
+
+#ifdef STBI_AVX2
+    printf("kernels: %s\n", stbi__avx2_available() ? "avx2" : "sse2");
+#elif defined(STBI_SSE2)
+    printf("kernels: sse2\n");
+#else
+    printf("kernels: generic\n");
+#endif
+#ifdef STBI_NO_MMAP
+    const char *file_input = "stdio";
+#else
+    const char *file_input = "mmap";
+#endif
+    if (source == FromMemory)
+    {
+        printf("input: memory\n");
+    }
+    else
+    {
+        printf("input: %s, %s page cache\n", file_input, source == FromFileCold ? "cold" : "warm");
+    }
+
+    ImageArena arena;
+    ImageArenaInit(&arena, 4 * 1024 * 1024);
+
+    stbi_set_flip_vertically_on_load(true);
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        if (source != FromMemory && inputs[i].path.empty() && !WriteTempInput(&inputs[i]))
+        {
+            continue;
+        }
+        RunDecode(inputs[i], iterations, use_arena ? &arena : NULL, source);
+        if (inputs[i].temporary)
+        {
+            unlink(inputs[i].path.c_str());
+        }
+    }
+
+    ImageArenaRelease(&arena);
+
+    return 0;
+}
+
+bool ReadInput(const char *filename, BenchInput *input)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Error: cannot open %s\n", filename);
+        return false;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long fsize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    input->name = filename;
+    input->path = filename;
+    input->temporary = false;
+    input->data.resize(fsize);
+    size_t read = fread(input->data.data(), fsize, 1, fp);
+    fclose(fp);
+    if (read != 1)
+    {
+        fprintf(stderr, "Error: cannot read %s\n", filename);
+        return false;
+    }
+
+    return true;
+}
+
+bool WriteTempInput(BenchInput *input)
+{
+    const char *tmpdir = getenv("TMPDIR");
+    std::string path = std::string(tmpdir != NULL ? tmpdir : "/tmp") + "/imgbench-XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    int fd = mkstemp(name.data());
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: cannot create temporary file %s\n", path.c_str());
+        return false;
+    }
+
+    // flushed to disk so the page cache copy is clean and can be evicted
+    bool written = write(fd, input->data.data(), input->data.size()) == (ssize_t)input->data.size() && fsync(fd) == 0;
+    close(fd);
+    if (!written)
+    {
+        fprintf(stderr, "Error: cannot write temporary file %s\n", name.data());
+        unlink(name.data());
+        return false;
+    }
+
+    input->path = name.data();
+    input->temporary = true;
+    return true;
+}
+
+bool EvictFromPageCache(const char *filename)
+{
+#ifdef POSIX_FADV_DONTNEED
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool evicted = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return evicted;
+#else
+    (void)filename;
+    return false;
+#endif
+}
+
+void RunDecode(const BenchInput& input, int iterations, ImageArena *arena, DecodeSource source)
+{
+    int img_w = 0, img_h = 0, img_c = 0;
+    double best = 1.0e30;
+    uint32_t checksum = 0;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        if (source == FromFileCold && !EvictFromPageCache(input.path.c_str()))
+        {
+            fprintf(stderr, "Error: cannot evict %s from the page cache\n", input.path.c_str());
+            return;
+        }
+        ImageArenaBind(arena);
+        double start = Now();
+        uint8_t *pixels;
+        if (source == FromMemory)
+        {
+            pixels = stbi_load_from_memory(input.data.data(), (int)input.data.size(), &img_w, &img_h, &img_c, STBI_rgb_alpha);
+        }
+        else
+        {
+            pixels = stbi_load(input.path.c_str(), &img_w, &img_h, &img_c, STBI_rgb_alpha);
+        }
+        double elapsed = Now() - start;
+        if (pixels == NULL)
+        {
+            fprintf(stderr, "Error: %s: %s\n", input.name.c_str(), stbi_failure_reason());
+            ImageArenaBind(NULL);
+            return;
+        }
+        if (i == 0)
+        {
+            checksum = Checksum(pixels, (size_t)img_w * img_h * 4);
+        }
+        stbi_image_free(pixels);
+        ImageArenaBind(NULL);
+        if (arena != NULL) ImageArenaReset(arena);
+        if (elapsed < best) best = elapsed;
+    }
+
+    double mbytes = (double)img_w * img_h * 4 / (1024.0 * 1024.0);
+    printf("%-36s %5dx%-5d %8.2f ms %9.1f MB/s  checksum %08x\n", input.name.c_str(), img_w, img_h,
+           best * 1000.0, mbytes / best, checksum);
+    if (arena != NULL)
+    {
+        printf("%-36s %llu allocs, %llu reallocs (%llu in place), peak %.1f MB, reserved %.1f MB\n", "  arena",
+               (unsigned long long)arena->stats.num_allocs, (unsigned long long)arena->stats.num_reallocs,
+               (unsigned long long)arena->stats.num_grow_in_place, arena->stats.peak_bytes / (1024.0 * 1024.0),
+               arena->stats.reserved_bytes / (1024.0 * 1024.0));
+    }
+}
+
+uint32_t Checksum(const uint8_t *data, size_t length)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+double Now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
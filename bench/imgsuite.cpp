@@ -0,0 +1,282 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#define STBI_PROFILE
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "corpus.h"
+
+// Decode benchmark suite for the bundled stb_image.
+//
+// usage: imgsuite [-n iterations] [image sizes ...]
+//
+// Generates a corpus in memory at each size (default 256, 1024 and 4096
+// pixels square): baseline and progressive JPEG (q90, 4:2:0), 8-bit RGBA
+// and 16-bit RGB PNG, Radiance HDR and GIF. Every image goes through
+// stbi_load (RGBA8), stbi_load_16 (RGBA16), stbi_loadf (RGBA float) and
+// stbi_info. For each decode the best of the iterations is reported, as
+// compressed input and decoded output MB/s, with that run's time per stage
+// from stb_image's STBI_PROFILE counters: entropy decoding (JPEG Huffman,
+// PNG inflate, GIF LZW), IDCT, chroma upsampling and color conversion for
+// JPEG, unfiltering for PNG. Time outside those stages (headers, format
+// conversion, HDR decoding, allocation) is the remainder of the total.
+//
+// Before timing anything, a few malformed inputs that once crashed the
+// decoders are checked to be rejected cleanly.
+
+enum DecodeApi : uint8_t { Load8, Load16, LoadFloat, Info };
+
+typedef struct SuiteInput {
+    std::string name;
+    int width;
+    int height;
+    std::vector<uint8_t> data;
+} SuiteInput;
+
+typedef struct MalformedInput {
+    const char *name;
+    const uint8_t *data;
+    int length;
+} MalformedInput;
+
+static bool RejectsMalformedInputs();
+static void AddInputs(int size, std::vector<SuiteInput> *inputs);
+static void RunDecode(const SuiteInput& input, DecodeApi api, int iterations, double ticks_per_ms);
+static double CalibrateTicks();
+static uint32_t Checksum(const uint8_t *data, size_t length);
+static double Now();
+
+int main(int argc, char **argv)
+{
+    int iterations = 5;
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+        else if (atoi(argv[i]) > 0)
+        {
+            sizes.push_back(atoi(argv[i]));
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-n iterations] [image sizes ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (sizes.empty())
+    {
+        sizes.push_back(256);
+        sizes.push_back(1024);
+        sizes.push_back(4096);
+    }
+
+#ifdef STBI_AVX2
+    printf("kernels: %s\n", stbi__avx2_available() ? "avx2" : "sse2");
+#elif defined(STBI_SSE2)
+    printf("kernels: sse2\n");
+#else
+    printf("kernels: generic\n");
+#endif
+    if (!RejectsMalformedInputs())
+    {
+        return 1;
+    }
+    double ticks_per_ms = CalibrateTicks() / 1000.0;
+    printf("%-14s %10s %10s %10s %9s %9s %9s %9s %9s  %s\n", "", "total ms", "in MB/s", "out MB/s", "entropy",
+           "idct", "upsample", "color", "filter", "checksum");
+
+    stbi_set_flip_vertically_on_load(true);
+    for (size_t s = 0; s < sizes.size(); s++)
+    {
+        std::vector<SuiteInput> inputs;
+        AddInputs(sizes[s], &inputs);
+        for (size_t i = 0; i < inputs.size(); i++)
+        {
+            printf("%s %dx%d, %.1f KB\n", inputs[i].name.c_str(), inputs[i].width, inputs[i].height,
+                   inputs[i].data.size() / 1024.0);
+            RunDecode(inputs[i], Load8, iterations, ticks_per_ms);
+            RunDecode(inputs[i], Load16, iterations, ticks_per_ms);
+            RunDecode(inputs[i], LoadFloat, iterations, ticks_per_ms);
+            RunDecode(inputs[i], Info, iterations, ticks_per_ms);
+        }
+    }
+
+    return 0;
+}
+
+
+// Auxillary functions
+bool RejectsMalformedInputs()
+{
+    // fixed-Huffman zlib streams: 16 literals, then a code DEFLATE reserves.
+    // the zero padding keeps the inflater on its fast path for the bad code
+    static const uint8_t length_286[36] = {
+        0x78, 0x01, 0x73, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74,
+        0x1c, 0x83, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    static const uint8_t distance_30[36] = {
+        0x78, 0x01, 0x73, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74,
+        0x04, 0x3e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    static const MalformedInput inputs[] = {
+        {"zlib length code 286", length_286, (int)sizeof(length_286)},
+        {"zlib length code 286, near the end", length_286, 20},
+        {"zlib distance code 30", distance_30, (int)sizeof(distance_30)},
+    };
+
+    int num_inputs = (int)(sizeof(inputs) / sizeof(inputs[0]));
+    int num_rejected = 0;
+    for (int i = 0; i < num_inputs; i++)
+    {
+        int length = 0;
+        char *output = stbi_zlib_decode_malloc_guesssize((const char*)inputs[i].data, inputs[i].length, 16384, &length);
+        if (output != NULL)
+        {
+            fprintf(stderr, "Error: malformed input accepted: %s\n", inputs[i].name);
+            STBI_FREE(output);
+            continue;
+        }
+        num_rejected++;
+    }
+    printf("malformed inputs: %d of %d rejected\n", num_rejected, num_inputs);
+
+    return num_rejected == num_inputs;
+}
+
+void AddInputs(int size, std::vector<SuiteInput> *inputs)
+{
+    uint32_t seed = (uint32_t)size;
+    std::vector<uint8_t> rgb = GenerateTestImage(size, size, 3, seed);
+    std::vector<uint8_t> rgba = GenerateTestImage(size, size, 4, seed);
+
+    // 16-bit samples: the 8-bit content in the high byte, a smooth ramp in
+    // the low byte so the extra precision isn't just zeros
+    std::vector<uint8_t> rgb16((size_t)size * size * 6);
+    for (size_t i = 0; i < (size_t)size * size * 3; i++)
+    {
+        rgb16[i * 2] = rgb[i];
+        rgb16[i * 2 + 1] = (uint8_t)(i / 3 % size);
+    }
+    std::vector<float> hdr = GenerateTestImageHdr(size, size, seed);
+
+    SuiteInput input;
+    input.width = size;
+    input.height = size;
+    input.name = "jpeg baseline";
+    input.data = EncodeJpeg(rgb.data(), size, size, 90, false);
+    inputs->push_back(input);
+    input.name = "jpeg progressive";
+    input.data = EncodeJpeg(rgb.data(), size, size, 90, true);
+    inputs->push_back(input);
+    input.name = "png rgba 8-bit";
+    input.data = EncodePng(rgba.data(), size, size, 4, 8);
+    inputs->push_back(input);
+    input.name = "png rgb 16-bit";
+    input.data = EncodePng(rgb16.data(), size, size, 3, 16);
+    inputs->push_back(input);
+    input.name = "hdr";
+    input.data = EncodeHdr(hdr.data(), size, size);
+    inputs->push_back(input);
+    input.name = "gif";
+    input.data = EncodeGif(rgb.data(), size, size);
+    inputs->push_back(input);
+}
+
+void RunDecode(const SuiteInput& input, DecodeApi api, int iterations, double ticks_per_ms)
+{
+    static const char *api_names[4] = {"stbi_load", "stbi_load_16", "stbi_loadf", "stbi_info"};
+    static const int texel_bytes[4] = {4, 8, 16, 0};
+    const stbi_uc *data = input.data.data();
+    int length = (int)input.data.size();
+
+    double best = 1.0e30;
+    stbi_profile best_profile;
+    memset(&best_profile, 0, sizeof(best_profile));
+    uint32_t checksum = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        int img_w = 0, img_h = 0, img_c = 0;
+        void *pixels = NULL;
+        bool ok;
+        stbi_profile_reset();
+        double start = Now();
+        switch (api)
+        {
+            case Load8:
+                ok = (pixels = stbi_load_from_memory(data, length, &img_w, &img_h, &img_c, STBI_rgb_alpha)) != NULL;
+                break;
+            case Load16:
+                ok = (pixels = stbi_load_16_from_memory(data, length, &img_w, &img_h, &img_c, STBI_rgb_alpha)) != NULL;
+                break;
+            case LoadFloat:
+                ok = (pixels = stbi_loadf_from_memory(data, length, &img_w, &img_h, &img_c, STBI_rgb_alpha)) != NULL;
+                break;
+            default:
+                ok = stbi_info_from_memory(data, length, &img_w, &img_h, &img_c) != 0;
+                break;
+        }
+        double elapsed = Now() - start;
+        if (!ok)
+        {
+            fprintf(stderr, "Error: %s: %s: %s\n", input.name.c_str(), api_names[api], stbi_failure_reason());
+            return;
+        }
+        if (i == 0 && pixels != NULL)
+        {
+            checksum = Checksum((const uint8_t*)pixels, (size_t)img_w * img_h * texel_bytes[api]);
+        }
+        stbi_image_free(pixels);
+        if (elapsed < best)
+        {
+            best = elapsed;
+            stbi_profile_get(&best_profile);
+        }
+    }
+
+    // stbi_info only reads the header, so throughput means nothing for it
+    if (api == Info)
+    {
+        printf("  %-12s %10.4f\n", api_names[api], best * 1000.0);
+        return;
+    }
+    double in_mbytes = input.data.size() / (1024.0 * 1024.0);
+    double out_mbytes = (double)input.width * input.height * texel_bytes[api] / (1024.0 * 1024.0);
+    printf("  %-12s %10.3f %10.1f %10.1f %9.3f %9.3f %9.3f %9.3f %9.3f  %08x\n", api_names[api], best * 1000.0,
+           in_mbytes / best, out_mbytes / best, best_profile.entropy / ticks_per_ms, best_profile.idct / ticks_per_ms,
+           best_profile.upsample / ticks_per_ms, best_profile.color / ticks_per_ms,
+           best_profile.filter / ticks_per_ms, checksum);
+}
+
+double CalibrateTicks()
+{
+    // stage counters are in timer ticks (TSC cycles on x86); spin for a
+    // moment against the steady clock to convert them
+    double start = Now();
+    unsigned long long start_ticks = stbi_profile_ticks();
+    double elapsed;
+    do
+    {
+        elapsed = Now() - start;
+    } while (elapsed < 0.1);
+    return (stbi_profile_ticks() - start_ticks) / elapsed;
+}
+
+uint32_t Checksum(const uint8_t *data, size_t length)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+double Now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -36,8 +36,9 @@
           http://gist.github.com/urraka/685d9a6340b26b830d49
 
       - decode from memory or through FILE (define STBI_NO_STDIO to remove code)
+      - filenames are memory-mapped on POSIX systems (define STBI_NO_MMAP to use FILE)
       - decode from arbitrary I/O callbacks
-      - SIMD acceleration on x86/x64 (SSE2) and ARM (NEON)
+      - SIMD acceleration on x86/x64 (SSE2, AVX2) and ARM (NEON)
 
    Full documentation under "DOCUMENTATION" below.
 
@@ -206,10 +207,12 @@ RECENT REVISION HISTORY:
 // code.)
 //
 // On x86, SSE2 will automatically be used when available based on a run-time
-// test; if not, the generic C versions are used as a fall-back. On ARM targets,
-// the typical path is to have separate builds for NEON and non-NEON devices
-// (at least this is true for iOS and Android). Therefore, the NEON support is
-// toggled by a build flag: define STBI_NEON to get NEON loops.
+// test; if not, the generic C versions are used as a fall-back. The JPEG
+// upsampling and color conversion kernels also have AVX2 versions, likewise
+// selected by a run-time test; define STBI_NO_AVX2 to disable them. On ARM
+// targets, the typical path is to have separate builds for NEON and non-NEON
+// devices (at least this is true for iOS and Android). Therefore, the NEON
+// support is toggled by a build flag: define STBI_NEON to get NEON loops.
 //
 // If for some reason you do not want to use any of SIMD code, or if
 // you have issues compiling it, you can disable it entirely by
@@ -357,6 +360,22 @@ STBIDEF stbi_uc *stbi_load_from_memory   (stbi_uc           const *buffer, int l
 STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk  , void *user, int *x, int *y, int *channels_in_file, int desired_channels);
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
+
+// incremental animated GIF decoding: one frame per call into a caller buffer
+// of x * y * 4 bytes (RGBA), so memory use doesn't grow with the number of
+// frames. a memory stream reads from 'buffer' until it is closed, so keep the
+// buffer alive. stbi_gif_stream_next returns 1 with the next frame and its
+// delay in milliseconds, 0 once every frame has been returned, and -1 on a
+// decode error; rewind starts over at the first frame. the vertical flip
+// setting of the calling thread is applied to each frame as it is returned.
+typedef struct stbi__gif_stream stbi_gif_stream;
+STBIDEF stbi_gif_stream *stbi_gif_stream_open_memory(stbi_uc const *buffer, int len, int *x, int *y);
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_gif_stream *stbi_gif_stream_open       (char const *filename, int *x, int *y);
+#endif
+STBIDEF int              stbi_gif_stream_next       (stbi_gif_stream *gs, stbi_uc *out, int *delay_ms);
+STBIDEF int              stbi_gif_stream_rewind     (stbi_gif_stream *gs);
+STBIDEF void             stbi_gif_stream_close      (stbi_gif_stream *gs);
 #endif
 
 
@@ -366,6 +385,19 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in
 // for stbi_load_from_file, file pointer is left pointing immediately after image
 #endif
 
+// decode into a caller-provided buffer (e.g. a mapped pixel unpack buffer)
+// instead of a new allocation. 'buffer_len' must be at least
+// x * y * channels bytes -- query the size with stbi_info first. returns 1 on
+// success, 0 on failure (including a too-small buffer). the buffer is never
+// freed by stb_image. baseline/progressive JPEG decodes straight into it;
+// other formats are decoded as usual and copied in (fused with the vertical
+// flip, if enabled).
+STBIDEF int      stbi_load_from_memory_into   (stbi_uc           const *data, int len   , stbi_uc *buffer, size_t buffer_len, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF int      stbi_load_from_callbacks_into(stbi_io_callbacks const *clbk, void *user, stbi_uc *buffer, size_t buffer_len, int *x, int *y, int *channels_in_file, int desired_channels);
+#ifndef STBI_NO_STDIO
+STBIDEF int      stbi_load_into               (char const *filename, stbi_uc *buffer, size_t buffer_len, int *x, int *y, int *channels_in_file, int desired_channels);
+#endif
+
 ////////////////////////////////////
 //
 // 16-bits-per-channel interface
@@ -443,9 +475,49 @@ STBIDEF void stbi_set_unpremultiply_on_load(int flag_true_if_should_unpremultipl
 // or just pass them through "as-is"
 STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 
-// flip the image vertically, so the first pixel in the output array is the bottom left
+// flip the image vertically, so the first pixel in the output array is the bottom left.
+// the JPEG and PNG decoders write their rows in flipped order directly, other
+// formats are flipped in a separate pass after decoding
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+// decode JPEGs at 1/scale_denom of their size in each axis (rounded up), using
+// reduced-size IDCTs, so time and memory shrink with the output. 1 (default),
+// 2, 4 and 8 are supported; other values round down to one of those. 8
+// reconstructs each 8x8 block from its DC coefficient alone, and for
+// progressive files skips the AC scans entirely, which makes a cheap preview.
+// other formats ignore this setting. stbi_info() reports the scaled size, so
+// it can still be used to size buffers for stbi_load_into().
+STBIDEF void stbi_set_jpeg_scale_denom_on_load(int scale_denom);
+
+// the settings above are process-wide. these variants set them for the
+// calling thread only, overriding the process-wide value from then on, so
+// threads decoding concurrently don't race on each other's settings. they
+// need thread-local storage (see STBI_THREAD_LOCAL); without it they set
+// the process-wide value. stbi_failure_reason() is per-thread as well.
+STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpremultiply);
+STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
+STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
+STBIDEF void stbi_set_jpeg_scale_denom_on_load_thread(int scale_denom);
+
+#ifdef STBI_PROFILE
+// time spent in each decode stage, in stbi_profile_ticks() units (TSC cycles
+// on x86, nanoseconds elsewhere), summed over the calling thread's decodes
+// since the last reset. only compiled in with STBI_PROFILE defined: it reads
+// the timer around every JPEG block and every output row.
+typedef struct
+{
+   unsigned long long entropy;    // JPEG Huffman decoding, PNG inflate, GIF LZW
+   unsigned long long idct;       // JPEG dequantization and inverse DCT
+   unsigned long long upsample;   // JPEG chroma upsampling
+   unsigned long long color;      // JPEG color conversion
+   unsigned long long filter;     // PNG row unfiltering and de-interlacing
+} stbi_profile;
+
+STBIDEF void               stbi_profile_reset(void);
+STBIDEF void               stbi_profile_get(stbi_profile *profile);
+STBIDEF unsigned long long stbi_profile_ticks(void);
+#endif
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -520,11 +592,36 @@ STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const ch
 #include <stdio.h>
 #endif
 
+// the filename loaders memory-map the file where the OS allows it and decode
+// it like an in-memory image; define STBI_NO_MMAP to always read through stdio
+#if !defined(STBI_NO_STDIO) && !defined(STBI_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define STBI__MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #ifndef STBI_ASSERT
 #include <assert.h>
 #define STBI_ASSERT(x) assert(x)
 #endif
 
+// thread-local storage for the per-thread settings and failure reason.
+// define STBI_NO_THREAD_LOCALS to keep everything process-wide
+#ifndef STBI_NO_THREAD_LOCALS
+   #if defined(__cplusplus) && __cplusplus >= 201103L
+      #define STBI_THREAD_LOCAL       thread_local
+   #elif defined(__GNUC__) && __GNUC__ < 5
+      #define STBI_THREAD_LOCAL       __thread
+   #elif defined(_MSC_VER)
+      #define STBI_THREAD_LOCAL       __declspec(thread)
+   #elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+      #define STBI_THREAD_LOCAL       _Thread_local
+   #elif defined(__GNUC__)
+      #define STBI_THREAD_LOCAL       __thread
+   #endif
+#endif
 
 #ifndef _MSC_VER
    #ifdef __cplusplus
@@ -542,12 +639,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -667,6 +766,48 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// x86 AVX2
+//
+// Unlike SSE2, AVX2 can't be assumed on any x64 target, so the AVX2 kernels
+// are compiled with a per-function target attribute (GCC/Clang) and only
+// selected after a run-time CPUID check. Define STBI_NO_AVX2 to keep the
+// SSE2 kernels.
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2)
+#if defined(_MSC_VER) && _MSC_VER >= 1700
+#define STBI_AVX2
+#elif defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define STBI_AVX2
+#endif
+#endif
+
+#ifdef STBI_AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define STBI__AVX2_TARGET
+
+static int stbi__avx2_available(void)
+{
+   int info[4];
+   __cpuid(info,1);
+   // OSXSAVE and AVX, and the OS must be saving YMM state
+   if ((info[2] & 0x18000000) != 0x18000000) return 0;
+   if ((_xgetbv(0) & 6) != 6) return 0;
+   __cpuidex(info,7,0);
+   return ((info[1] >> 5) & 1) != 0;
+}
+#else
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+
+static int stbi__avx2_available(void)
+{
+   // checks both the CPUID bit and OS support for YMM state
+   __builtin_cpu_init();
+   return __builtin_cpu_supports("avx2");
+}
+#endif
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -702,6 +843,9 @@ typedef struct
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   stbi_uc *out_buffer;    // caller-provided 8-bit destination, or NULL
+   size_t out_buffer_len;
 } stbi__context;
 
 
@@ -712,6 +856,8 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
 {
    s->io.read = NULL;
    s->read_from_callbacks = 0;
+   s->out_buffer = NULL;
+   s->out_buffer_len = 0;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
    s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *) buffer+len;
 }
@@ -723,6 +869,8 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
    s->io_user_data = user;
    s->buflen = sizeof(s->buffer_start);
    s->read_from_callbacks = 1;
+   s->out_buffer = NULL;
+   s->out_buffer_len = 0;
    s->img_buffer_original = s->buffer_start;
    stbi__refill_buffer(s);
    s->img_buffer_original_end = s->img_buffer_end;
@@ -781,6 +929,7 @@ typedef struct
    int bits_per_channel;
    int num_channels;
    int channel_order;
+   int flipped; // rows were already written bottom-to-top by the decoder
 } stbi__result_info;
 
 #ifndef STBI_NO_JPEG
@@ -840,14 +989,71 @@ static void    *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp, int
 static int      stbi__pnm_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
-// this is not threadsafe
+#ifndef STBI_THREAD_LOCAL
 static const char *stbi__g_failure_reason;
+#else
+static STBI_THREAD_LOCAL const char *stbi__g_failure_reason;
+#endif
 
 STBIDEF const char *stbi_failure_reason(void)
 {
    return stbi__g_failure_reason;
 }
 
+#ifdef STBI_PROFILE
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define stbi__profile_now()  ((unsigned long long) __builtin_ia32_rdtsc())
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define stbi__profile_now()  ((unsigned long long) __rdtsc())
+#else
+#include <time.h>
+static unsigned long long stbi__profile_now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (unsigned long long) ts.tv_sec * 1000000000u + (unsigned long long) ts.tv_nsec;
+}
+#endif
+
+#ifndef STBI_THREAD_LOCAL
+static stbi_profile stbi__profile;
+static unsigned long long stbi__profile_last;
+#else
+static STBI_THREAD_LOCAL stbi_profile stbi__profile;
+static STBI_THREAD_LOCAL unsigned long long stbi__profile_last;
+#endif
+
+// charge the time since the last begin/mark to one stage
+static void stbi__profile_mark(unsigned long long *stage)
+{
+   unsigned long long now = stbi__profile_now();
+   *stage += now - stbi__profile_last;
+   stbi__profile_last = now;
+}
+
+STBIDEF void stbi_profile_reset(void)
+{
+   memset(&stbi__profile, 0, sizeof(stbi__profile));
+}
+
+STBIDEF void stbi_profile_get(stbi_profile *profile)
+{
+   *profile = stbi__profile;
+}
+
+STBIDEF unsigned long long stbi_profile_ticks(void)
+{
+   return stbi__profile_now();
+}
+
+#define STBI__PROFILE_BEGIN()       (stbi__profile_last = stbi__profile_now())
+#define STBI__PROFILE_MARK(stage)   stbi__profile_mark(&stbi__profile.stage)
+#else
+#define STBI__PROFILE_BEGIN()       ((void) 0)
+#define STBI__PROFILE_MARK(stage)   ((void) 0)
+#endif
+
 static int stbi__err(const char *str)
 {
    stbi__g_failure_reason = str;
@@ -962,13 +1168,62 @@ static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp);
 static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp);
 #endif
 
-static int stbi__vertically_flip_on_load = 0;
+static int stbi__vertically_flip_on_load_global = 0;
+static int stbi__jpeg_scale_shift_on_load_global = 0;
+
+static int stbi__jpeg_scale_shift(int scale_denom)
+{
+   return scale_denom >= 8 ? 3 : scale_denom >= 4 ? 2 : scale_denom >= 2 ? 1 : 0;
+}
 
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
 {
-    stbi__vertically_flip_on_load = flag_true_if_should_flip;
+    stbi__vertically_flip_on_load_global = flag_true_if_should_flip;
+}
+
+STBIDEF void stbi_set_jpeg_scale_denom_on_load(int scale_denom)
+{
+    stbi__jpeg_scale_shift_on_load_global = stbi__jpeg_scale_shift(scale_denom);
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__vertically_flip_on_load   stbi__vertically_flip_on_load_global
+#define stbi__jpeg_scale_shift_on_load  stbi__jpeg_scale_shift_on_load_global
+
+STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip)
+{
+   stbi_set_flip_vertically_on_load(flag_true_if_should_flip);
+}
+
+STBIDEF void stbi_set_jpeg_scale_denom_on_load_thread(int scale_denom)
+{
+   stbi_set_jpeg_scale_denom_on_load(scale_denom);
+}
+#else
+// a thread uses its own value once it has set one, the global one until then
+static STBI_THREAD_LOCAL int stbi__vertically_flip_on_load_local, stbi__vertically_flip_on_load_set;
+static STBI_THREAD_LOCAL int stbi__jpeg_scale_shift_on_load_local, stbi__jpeg_scale_shift_on_load_set;
+
+STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip)
+{
+   stbi__vertically_flip_on_load_local = flag_true_if_should_flip;
+   stbi__vertically_flip_on_load_set = 1;
 }
 
+STBIDEF void stbi_set_jpeg_scale_denom_on_load_thread(int scale_denom)
+{
+   stbi__jpeg_scale_shift_on_load_local = stbi__jpeg_scale_shift(scale_denom);
+   stbi__jpeg_scale_shift_on_load_set = 1;
+}
+
+#define stbi__vertically_flip_on_load  (stbi__vertically_flip_on_load_set        \
+                                        ? stbi__vertically_flip_on_load_local    \
+                                        : stbi__vertically_flip_on_load_global)
+#define stbi__jpeg_scale_shift_on_load (stbi__jpeg_scale_shift_on_load_set       \
+                                        ? stbi__jpeg_scale_shift_on_load_local   \
+                                        : stbi__jpeg_scale_shift_on_load_global)
+#endif // STBI_THREAD_LOCAL
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1098,7 +1353,24 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
 
    // @TODO: move stbi__convert_format to here
 
-   if (stbi__vertically_flip_on_load) {
+   if (s->out_buffer && result != s->out_buffer) {
+      // decoder couldn't write to the caller's buffer directly; copy it over,
+      // flipping on the way if the decoder didn't already
+      int channels = req_comp ? req_comp : *comp;
+      int flip = stbi__vertically_flip_on_load && !ri.flipped;
+      size_t bytes_per_row = (size_t) *x * channels;
+      int row;
+      if (bytes_per_row * *y > s->out_buffer_len) {
+         STBI_FREE(result);
+         return stbi__errpuc("buffer too small", "Output buffer too small for image");
+      }
+      for (row = 0; row < *y; ++row)
+         memcpy(s->out_buffer + (flip ? *y - 1 - row : row) * bytes_per_row, (stbi_uc *) result + row * bytes_per_row, bytes_per_row);
+      STBI_FREE(result);
+      return s->out_buffer;
+   }
+
+   if (stbi__vertically_flip_on_load && !ri.flipped) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
    }
@@ -1123,7 +1395,7 @@ static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x,
    // @TODO: move stbi__convert_format16 to here
    // @TODO: special case RGB-to-Y (and RGBA-to-YA) for 8-bit-to-16-bit case to keep more precision
 
-   if (stbi__vertically_flip_on_load) {
+   if (stbi__vertically_flip_on_load && !ri.flipped) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi__uint16));
    }
@@ -1155,14 +1427,91 @@ static FILE *stbi__fopen(char const *filename, char const *mode)
    return f;
 }
 
+typedef struct
+{
+   FILE *f;
+#ifdef STBI__MMAP
+   void *map;
+   size_t map_len;
+#endif
+} stbi__file;
+
+// start a context on a named file. regular files are mapped and decoded
+// through the in-memory path: no 128-byte refills through stdio, and for
+// full loads the kernel is told up front to read the whole file ahead.
+// anything that can't be mapped (pipes, empty or >2GB files) uses stdio.
+static int stbi__open_file(stbi__file *file, stbi__context *s, char const *filename, int whole_file)
+{
+   file->f = NULL;
+#ifdef STBI__MMAP
+   file->map = NULL;
+   {
+      struct stat st;
+      int flags = MAP_PRIVATE;
+      int fd = open(filename, O_RDONLY);
+      #ifdef MAP_POPULATE
+      if (whole_file) flags |= MAP_POPULATE; // map every page up front instead of faulting them in one by one
+      #endif
+      if (fd >= 0) {
+         if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size <= INT_MAX) {
+            void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, flags, fd, 0);
+            if (map != MAP_FAILED) {
+               #ifdef MADV_WILLNEED // hidden by strict ISO modes without _DEFAULT_SOURCE
+               if (whole_file) {
+                  madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+                  madvise(map, (size_t) st.st_size, MADV_WILLNEED);
+               }
+               #endif
+               file->map = map;
+               file->map_len = (size_t) st.st_size;
+            }
+         }
+         close(fd); // the mapping keeps its own reference
+         if (file->map) {
+            stbi__start_mem(s, (stbi_uc *) file->map, (int) file->map_len);
+            return 1;
+         }
+      }
+   }
+#else
+   STBI_NOTUSED(whole_file);
+#endif
+   file->f = stbi__fopen(filename, "rb");
+   if (!file->f) return 0;
+   stbi__start_file(s, file->f);
+   return 1;
+}
+
+static void stbi__close_file(stbi__file *file)
+{
+#ifdef STBI__MMAP
+   if (file->map) munmap(file->map, file->map_len);
+#endif
+   if (file->f) fclose(file->f);
+}
+
 
 STBIDEF stbi_uc *stbi_load(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
-   FILE *f = stbi__fopen(filename, "rb");
+   stbi__file file;
+   stbi__context s;
    unsigned char *result;
-   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
-   result = stbi_load_from_file(f,x,y,comp,req_comp);
-   fclose(f);
+   if (!stbi__open_file(&file, &s, filename, 1)) return stbi__errpuc("can't fopen", "Unable to open file");
+   result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+   stbi__close_file(&file);
+   return result;
+}
+
+STBIDEF int stbi_load_into(char const *filename, stbi_uc *buffer, size_t buffer_len, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__file file;
+   stbi__context s;
+   int result;
+   if (!stbi__open_file(&file, &s, filename, 1)) return stbi__err("can't fopen", "Unable to open file");
+   s.out_buffer = buffer;
+   s.out_buffer_len = buffer_len;
+   result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp) != NULL;
+   stbi__close_file(&file);
    return result;
 }
 
@@ -1194,11 +1543,12 @@ STBIDEF stbi__uint16 *stbi_load_from_file_16(FILE *f, int *x, int *y, int *comp,
 
 STBIDEF stbi_us *stbi_load_16(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
-   FILE *f = stbi__fopen(filename, "rb");
+   stbi__file file;
+   stbi__context s;
    stbi__uint16 *result;
-   if (!f) return (stbi_us *) stbi__errpuc("can't fopen", "Unable to open file");
-   result = stbi_load_from_file_16(f,x,y,comp,req_comp);
-   fclose(f);
+   if (!stbi__open_file(&file, &s, filename, 1)) return (stbi_us *) stbi__errpuc("can't fopen", "Unable to open file");
+   result = stbi__load_and_postprocess_16bit(&s,x,y,comp,req_comp);
+   stbi__close_file(&file);
    return result;
 }
 
@@ -1233,6 +1583,24 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF int stbi_load_from_memory_into(stbi_uc const *data, int len, stbi_uc *buffer, size_t buffer_len, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,data,len);
+   s.out_buffer = buffer;
+   s.out_buffer_len = buffer_len;
+   return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp) != NULL;
+}
+
+STBIDEF int stbi_load_from_callbacks_into(stbi_io_callbacks const *clbk, void *user, stbi_uc *buffer, size_t buffer_len, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   s.out_buffer = buffer;
+   s.out_buffer_len = buffer_len;
+   return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp) != NULL;
+}
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp)
 {
@@ -1285,11 +1653,12 @@ STBIDEF float *stbi_loadf_from_callbacks(stbi_io_callbacks const *clbk, void *us
 #ifndef STBI_NO_STDIO
 STBIDEF float *stbi_loadf(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
+   stbi__file file;
+   stbi__context s;
    float *result;
-   FILE *f = stbi__fopen(filename, "rb");
-   if (!f) return stbi__errpf("can't fopen", "Unable to open file");
-   result = stbi_loadf_from_file(f,x,y,comp,req_comp);
-   fclose(f);
+   if (!stbi__open_file(&file, &s, filename, 1)) return stbi__errpf("can't fopen", "Unable to open file");
+   result = stbi__loadf_main(&s,x,y,comp,req_comp);
+   stbi__close_file(&file);
    return result;
 }
 
@@ -1614,14 +1983,18 @@ static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
 {
    int i,k,n;
    float *output;
+   float table[256];
    if (!data) return NULL;
    output = (float *) stbi__malloc_mad4(x, y, comp, sizeof(float), 0);
    if (output == NULL) { STBI_FREE(data); return stbi__errpf("outofmem", "Out of memory"); }
    // compute number of non-alpha components
    if (comp & 1) n = comp; else n = comp-1;
+   // only 256 possible inputs, so pow() runs once per value instead of per texel
+   for (i=0; i < 256; ++i)
+      table[i] = (float) (pow(i/255.0f, stbi__l2h_gamma) * stbi__l2h_scale);
    for (i=0; i < x*y; ++i) {
       for (k=0; k < n; ++k) {
-         output[i*comp + k] = (float) (pow(data[i*comp+k]/255.0f, stbi__l2h_gamma) * stbi__l2h_scale);
+         output[i*comp + k] = table[data[i*comp+k]];
       }
       if (k < comp) output[i*comp + k] = data[i*comp+k]/255.0f;
    }
@@ -1632,21 +2005,92 @@ static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
 
 #ifndef STBI_NO_HDR
 #define stbi__float2int(x)   ((int) (x))
+static stbi_uc stbi__h2l_color(float v)
+{
+   float z = (float) pow(v*stbi__h2l_scale_i, stbi__h2l_gamma_i) * 255 + 0.5f;
+   if (z < 0) z = 0;
+   if (z > 255) z = 255;
+   return (stbi_uc) stbi__float2int(z);
+}
+
+static stbi__uint32 stbi__float_bits(float v)
+{
+   stbi__uint32 bits;
+   memcpy(&bits, &v, 4);
+   return bits;
+}
+
+// Below this many color values, building the lookup tables costs more than
+// calling pow() on each one.
+#define STBI__H2L_TABLE_MIN  16384
+#define STBI__H2L_BUCKETS    ((0x7f800000u >> 16) + 1)  // non-negative floats up to +inf
+
+// stbi__h2l_color() is monotonic in its input, so instead of evaluating it per
+// value we find the 255 thresholds where its result steps up (by bisecting
+// over float bit patterns, using stbi__h2l_color() itself, so the results are
+// identical), then index a table of step counts by the top 16 bits of each
+// value's float representation. Non-negative floats order like their bit
+// patterns, so usually one more threshold compare finishes the job.
+static int stbi__h2l_build_tables(stbi__uint32 *thresholds, stbi_uc *base)
+{
+   stbi__uint32 lo, hi, bucket;
+   float inf;
+   int k;
+   lo = 0x7f800000u;
+   memcpy(&inf, &lo, 4);
+   if (!(stbi__h2l_scale_i > 0 && stbi__h2l_gamma_i > 0)) return 0;
+   if (stbi__h2l_color(0.0f) != 0 || stbi__h2l_color(inf) != 255) return 0;
+   lo = 0;
+   for (k=1; k < 256; ++k) {
+      hi = 0x7f800000u;
+      while (hi - lo > 1) {
+         stbi__uint32 mid = lo + (hi - lo) / 2;
+         float v;
+         memcpy(&v, &mid, 4);
+         if (stbi__h2l_color(v) >= k) hi = mid; else lo = mid;
+      }
+      thresholds[k] = hi;
+      lo = hi - 1;
+   }
+   thresholds[0] = 0;
+   k = 0;
+   for (bucket=0; bucket < STBI__H2L_BUCKETS; ++bucket) {
+      while (k < 255 && thresholds[k+1] <= (bucket << 16)) ++k;
+      base[bucket] = (stbi_uc) k;
+   }
+   return 1;
+}
+
 static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 {
    int i,k,n;
    stbi_uc *output;
+   stbi_uc *base = NULL;
+   stbi__uint32 thresholds[256];
    if (!data) return NULL;
    output = (stbi_uc *) stbi__malloc_mad3(x, y, comp, 0);
    if (output == NULL) { STBI_FREE(data); return stbi__errpuc("outofmem", "Out of memory"); }
    // compute number of non-alpha components
    if (comp & 1) n = comp; else n = comp-1;
+   if (x*y*n >= STBI__H2L_TABLE_MIN) {
+      base = (stbi_uc *) stbi__malloc(STBI__H2L_BUCKETS);
+      if (base && !stbi__h2l_build_tables(thresholds, base)) {
+         STBI_FREE(base);
+         base = NULL;
+      }
+   }
    for (i=0; i < x*y; ++i) {
       for (k=0; k < n; ++k) {
-         float z = (float) pow(data[i*comp+k]*stbi__h2l_scale_i, stbi__h2l_gamma_i) * 255 + 0.5f;
-         if (z < 0) z = 0;
-         if (z > 255) z = 255;
-         output[i*comp + k] = (stbi_uc) stbi__float2int(z);
+         float v = data[i*comp+k];
+         stbi__uint32 bits = stbi__float_bits(v);
+         if (base && bits <= 0x7f800000u) {
+            int c = base[bits >> 16];
+            while (c < 255 && bits >= thresholds[c+1]) ++c;
+            output[i*comp + k] = (stbi_uc) c;
+         } else {
+            // negative, NaN, or no tables
+            output[i*comp + k] = stbi__h2l_color(v);
+         }
       }
       if (k < comp) {
          float z = data[i*comp+k] * 255 + 0.5f;
@@ -1655,6 +2099,7 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
          output[i*comp + k] = (stbi_uc) stbi__float2int(z);
       }
    }
+   if (base) STBI_FREE(base);
    STBI_FREE(data);
    return output;
 }
@@ -1744,6 +2189,7 @@ typedef struct
 
    int scan_n, order[4];
    int restart_interval, todo;
+   int scale_shift;   // output is 1/(1<<scale_shift) size; blocks are (8>>scale_shift)^2 pixels
 
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
@@ -2260,6 +2706,87 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
    }
 }
 
+// reduced-size IDCTs for scaled decoding. each output pixel is the average of
+// the pixels stbi__idct_block would produce under it: the 8-point basis
+// functions box-filtered down to 4 or 2 points (which zeroes some of them).
+// fixed-point scaling is the same as stbi__idct_block.
+#define STBI__IDCT_1D_4(s0,s1,s2,s3,s5,s6,s7)                                  \
+   int d0,e0,o0,o1;                                                            \
+   d0 = stbi__fsh(s0);                                                         \
+   e0 = (s2)*stbi__f2f( 0.923879533f) + (s6)*stbi__f2f(-0.382683432f);         \
+   o0 = (s1)*stbi__f2f( 1.281457724f) + (s3)*stbi__f2f( 0.449988112f)          \
+      + (s5)*stbi__f2f(-0.300672443f) + (s7)*stbi__f2f(-0.254897790f);         \
+   o1 = (s1)*stbi__f2f( 0.530797169f) + (s3)*stbi__f2f(-1.086367402f)          \
+      + (s5)*stbi__f2f( 0.725887491f) + (s7)*stbi__f2f(-0.105582121f);
+
+#define STBI__IDCT_1D_2(s0,s1,s3,s5,s7)                                        \
+   int d0,o0;                                                                  \
+   d0 = stbi__fsh(s0);                                                         \
+   o0 = (s1)*stbi__f2f( 0.906127446f) + (s3)*stbi__f2f(-0.318189645f)          \
+      + (s5)*stbi__f2f( 0.212607524f) + (s7)*stbi__f2f(-0.180239956f);
+
+static void stbi__idct_4x4(stbi_uc *out, int out_stride, short data[64])
+{
+   int i,val[32],*v=val;
+   stbi_uc *o;
+   short *d = data;
+
+   // columns: 8 coefficients in, 4 rows out
+   for (i=0; i < 8; ++i,++d,++v) {
+      if (d[ 8]==0 && d[16]==0 && d[24]==0 && d[32]==0
+           && d[40]==0 && d[48]==0 && d[56]==0) {
+         int dcterm = d[0]*4;
+         v[0] = v[8] = v[16] = v[24] = dcterm;
+      } else {
+         STBI__IDCT_1D_4(d[ 0],d[ 8],d[16],d[24],d[40],d[48],d[56])
+         d0 += 512;
+         v[ 0] = (d0+e0+o0) >> 10;
+         v[ 8] = (d0-e0+o1) >> 10;
+         v[16] = (d0-e0-o1) >> 10;
+         v[24] = (d0+e0-o0) >> 10;
+      }
+   }
+
+   for (i=0, v=val, o=out; i < 4; ++i,v+=8,o+=out_stride) {
+      STBI__IDCT_1D_4(v[0],v[1],v[2],v[3],v[5],v[6],v[7])
+      d0 += 65536 + (128<<17);
+      o[0] = stbi__clamp((d0+e0+o0) >> 17);
+      o[1] = stbi__clamp((d0-e0+o1) >> 17);
+      o[2] = stbi__clamp((d0-e0-o1) >> 17);
+      o[3] = stbi__clamp((d0+e0-o0) >> 17);
+   }
+}
+
+static void stbi__idct_2x2(stbi_uc *out, int out_stride, short data[64])
+{
+   int i,val[16],*v=val;
+   stbi_uc *o;
+   short *d = data;
+
+   // columns: 8 coefficients in, 2 rows out
+   for (i=0; i < 8; ++i,++d,++v) {
+      STBI__IDCT_1D_2(d[ 0],d[ 8],d[24],d[40],d[56])
+      d0 += 512;
+      v[0] = (d0+o0) >> 10;
+      v[8] = (d0-o0) >> 10;
+   }
+
+   for (i=0, v=val, o=out; i < 2; ++i,v+=8,o+=out_stride) {
+      STBI__IDCT_1D_2(v[0],v[1],v[3],v[5],v[7])
+      d0 += 65536 + (128<<17);
+      o[0] = stbi__clamp((d0+o0) >> 17);
+      o[1] = stbi__clamp((d0-o0) >> 17);
+   }
+}
+
+// 1/8-scale "IDCT": the DC term alone gives the block average. this matches
+// what stbi__idct_block produces for a block with no AC energy
+static void stbi__idct_dc(stbi_uc *out, int out_stride, short data[64])
+{
+   STBI_NOTUSED(out_stride);
+   out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2691,6 +3218,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          int i,j;
          STBI_SIMD_ALIGN(short, data[64]);
          int n = z->order[0];
+         int bs = 8 >> z->scale_shift;
          // non-interleaved data, we just need to process one block at a time,
          // in trivial scanline order
          // number of blocks to do just depends on how many actual "pixels" this
@@ -2701,7 +3229,9 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
             for (i=0; i < w; ++i) {
                int ha = z->img_comp[n].ha;
                if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               STBI__PROFILE_MARK(entropy);
+               z->idct_block_kernel(z->img_comp[n].data+(z->img_comp[n].w2*j+i)*bs, z->img_comp[n].w2, data);
+               STBI__PROFILE_MARK(idct);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -2715,6 +3245,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          return 1;
       } else { // interleaved
          int i,j,k,x,y;
+         int bs = 8 >> z->scale_shift;
          STBI_SIMD_ALIGN(short, data[64]);
          for (j=0; j < z->img_mcu_y; ++j) {
             for (i=0; i < z->img_mcu_x; ++i) {
@@ -2725,11 +3256,13 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   // by the basic H and V specified for the component
                   for (y=0; y < z->img_comp[n].v; ++y) {
                      for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
+                        int x2 = (i*z->img_comp[n].h + x)*bs;
+                        int y2 = (j*z->img_comp[n].v + y)*bs;
                         int ha = z->img_comp[n].ha;
                         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                        STBI__PROFILE_MARK(entropy);
                         z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                        STBI__PROFILE_MARK(idct);
                      }
                   }
                }
@@ -2807,6 +3340,22 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
    }
 }
 
+// advance to the marker that ends the current scan without decoding it
+static void stbi__skip_entropy_coded_data(stbi__jpeg *z)
+{
+   stbi__jpeg_reset(z);
+   while (!stbi__at_eof(z->s)) {
+      int x = stbi__get8(z->s);
+      if (x != 0xff) continue;
+      do x = stbi__get8(z->s); while (x == 0xff && !stbi__at_eof(z->s));
+      // stuffed zero bytes and restart markers are part of the scan
+      if (x != 0x00 && !STBI__RESTART(x)) {
+         z->marker = (unsigned char) x;
+         return;
+      }
+   }
+}
+
 static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
 {
    int i;
@@ -2819,6 +3368,8 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
    if (z->progressive) {
       // dequantize and idct the data
       int i,j,n;
+      int bs = 8 >> z->scale_shift;
+      STBI__PROFILE_BEGIN();
       for (n=0; n < z->s->img_n; ++n) {
          int w = (z->img_comp[n].x+7) >> 3;
          int h = (z->img_comp[n].y+7) >> 3;
@@ -2826,10 +3377,11 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
             for (i=0; i < w; ++i) {
                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
                stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               z->idct_block_kernel(z->img_comp[n].data+(z->img_comp[n].w2*j+i)*bs, z->img_comp[n].w2, data);
             }
          }
       }
+      STBI__PROFILE_MARK(idct);
    }
 }
 
@@ -3056,8 +3608,8 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       //
       // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
       // so these muls can't overflow with 32-bit ints (which we require)
-      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * (8 >> z->scale_shift);
+      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * (8 >> z->scale_shift);
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
@@ -3067,10 +3619,9 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       // align blocks for idct using mmx/sse
       z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
       if (z->progressive) {
-         // w2, h2 are multiples of 8 (see above)
-         z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-         z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+         z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+         z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * z->img_comp[i].coeff_h, 64, sizeof(short), 15);
          if (z->img_comp[i].raw_coeff == NULL)
             return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
          z->img_comp[i].coeff = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3127,7 +3678,15 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
    while (!stbi__EOI(m)) {
       if (stbi__SOS(m)) {
          if (!stbi__process_scan_header(j)) return 0;
-         if (!stbi__parse_entropy_coded_data(j)) return 0;
+         if (j->progressive && j->scale_shift == 3 && j->spec_start != 0) {
+            // DC-only decode never looks at AC coefficients, so don't even
+            // huffman-decode them
+            stbi__skip_entropy_coded_data(j);
+         } else {
+            STBI__PROFILE_BEGIN();
+            if (!stbi__parse_entropy_coded_data(j)) return 0;
+            STBI__PROFILE_MARK(entropy);
+         }
          if (j->marker == STBI__MARKER_none ) {
             // handle 0s at the end of image data from IP Kamera 9060
             while (!stbi__at_eof(j->s)) {
@@ -3351,6 +3910,78 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+// same filter as stbi__resample_row_hv_2_simd, 16 input pixels at a time.
+// bit-identical to the SSE2 and generic versions.
+STBI__AVX2_TARGET
+static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   // as in the SSE2 loop, the last pixel of the row is left to the scalar tail
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass: 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i diff  = _mm256_sub_epi16(farw, nearw);
+      __m256i nears = _mm256_slli_epi16(nearw, 2);
+      __m256i curr  = _mm256_add_epi16(nears, diff); // current row
+
+      // shift curr by one 16-bit element across the 128-bit lane boundary,
+      // then patch in the neighbours from the previous/next group
+      __m256i prv0 = _mm256_alignr_epi8(curr, _mm256_permute2x128_si256(curr, curr, 0x08), 14);
+      __m256i nxt0 = _mm256_alignr_epi8(_mm256_permute2x128_si256(curr, curr, 0x81), curr, 2);
+      __m256i prev = _mm256_insert_epi16(prv0, t1, 0);
+      __m256i next = _mm256_insert_epi16(nxt0, 3*in_near[i+16] + in_far[i+16], 15);
+
+      // horizontal pass, polyphase:
+      // even pixels = 3*cur + prev = cur*4 + (prev - cur)
+      // odd  pixels = 3*cur + next = cur*4 + (next - cur)
+      __m256i bias = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i prvd = _mm256_sub_epi16(prev, curr);
+      __m256i nxtd = _mm256_sub_epi16(next, curr);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(prvd, curb);
+      __m256i odd  = _mm256_add_epi16(nxtd, curb);
+
+      // interleave and undo scaling. unpack and pack both work per 128-bit
+      // lane, so the two reorderings cancel and the output is in order.
+      __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+      __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+      __m256i de0  = _mm256_srli_epi16(int0, 4);
+      __m256i de1  = _mm256_srli_epi16(int1, 4);
+      __m256i outv = _mm256_packus_epi16(de0, de1);
+      _mm256_storeu_si256((__m256i *) (out + i*2), outv);
+
+      // "previous" value for next iter
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -3525,9 +4156,74 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// 16 pixels per iteration; same fixed-point math as the SSE2 kernel, which
+// also finishes off the remainder of the row.
+STBI__AVX2_TARGET
+static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 4) {
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i c_bias = _mm256_set1_epi16(128);
+      __m256i y_bias = _mm256_set1_epi16(8);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+      for (; i+15 < count; i += 16) {
+         // load and widen to short
+         __m256i yw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (y+i)));
+         __m256i crw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (pcr+i)));
+         __m256i cbw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (pcb+i)));
+
+         // (y << 4) + 8 and (c - 128) << 8, matching the SSE2 byte unpacks
+         __m256i yws = _mm256_add_epi16(_mm256_slli_epi16(yw, 4), y_bias);
+         __m256i crs = _mm256_slli_epi16(_mm256_sub_epi16(crw, c_bias), 8);
+         __m256i cbs = _mm256_slli_epi16(_mm256_sub_epi16(cbw, c_bias), 8);
+
+         // color transform
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crs);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbs);
+         __m256i cb1 = _mm256_mulhi_epi16(cbs, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crs, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte and interleave; each 128-bit lane now holds
+         // pixels 0-3 / 8-11 (o0) and 4-7 / 12-15 (o1)
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+         // fix up lane order and store
+         _mm256_storeu_si256((__m256i *) (out + 0),  _mm256_permute2x128_si256(o0, o1, 0x20));
+         _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+         out += 64;
+      }
+   }
+
+   if (i < count)
+      stbi__YCbCr_to_RGB_simd(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
+   j->scale_shift = 0;
    j->idct_block_kernel = stbi__idct_block;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
@@ -3540,6 +4236,15 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    }
 #endif
 
+#ifdef STBI_AVX2
+   // the 8x8 IDCT is one block of eight 16-bit rows, which is exactly the
+   // SSE2 register width, so it keeps the SSE2 kernel
+   if (stbi__avx2_available()) {
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+   }
+#endif
+
 #ifdef STBI_NEON
    j->idct_block_kernel = stbi__idct_simd;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
@@ -3570,7 +4275,9 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
-static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+// if 'flip' is set, scanlines are written bottom-to-top so the caller doesn't
+// need a separate vertical flip pass
+static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp, int flip)
 {
    int n, decode_n, is_rgb;
    z->s->img_n = 0; // make stbi__cleanup_jpeg safe
@@ -3581,6 +4288,17 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // load a jpeg image from whichever source, but leave in YCbCr format
    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
+   // with scaled decoding, everything downstream works on the reduced image
+   if (z->scale_shift) {
+      int round = (1 << z->scale_shift) - 1;
+      z->s->img_x = (z->s->img_x + round) >> z->scale_shift;
+      z->s->img_y = (z->s->img_y + round) >> z->scale_shift;
+      for (n=0; n < z->s->img_n; ++n) {
+         z->img_comp[n].x = (z->img_comp[n].x + round) >> z->scale_shift;
+         z->img_comp[n].y = (z->img_comp[n].y + round) >> z->scale_shift;
+      }
+   }
+
    // determine actual number of components to generate
    n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
 
@@ -3595,7 +4313,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    {
       int k;
       unsigned int i,j;
-      stbi_uc *output;
+      stbi_uc *output, *last_row, *tail_row = NULL;
       stbi_uc *coutput[4];
 
       stbi__resample res_comp[4];
@@ -3623,12 +4341,34 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
       }
 
       // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+      if (z->s->out_buffer) {
+         // decode straight into the caller's buffer. it has no slack after the
+         // last row for the n==3 paths' 4th byte, so that row goes via tail_row.
+         if (!stbi__mad3sizes_valid(n, z->s->img_x, z->s->img_y, 0) || (size_t) n * z->s->img_x * z->s->img_y > z->s->out_buffer_len) {
+            stbi__cleanup_jpeg(z);
+            return stbi__errpuc("buffer too small", "Output buffer too small for image");
+         }
+         output = z->s->out_buffer;
+         if (n == 3) {
+            tail_row = (stbi_uc *) stbi__malloc_mad2(n, z->s->img_x, 1);
+            if (!tail_row) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+         }
+      } else {
+         output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+         if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+      }
+      last_row = output + n * z->s->img_x * (z->s->img_y - 1);
 
       // now go ahead and resample
+      STBI__PROFILE_BEGIN();
       for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
+         stbi_uc *dest = output + n * z->s->img_x * (flip ? z->s->img_y - 1 - j : j);
+         stbi_uc *row_out = (tail_row && dest == last_row) ? tail_row : dest;
+         stbi_uc *out = row_out;
+         // the n==3 paths write a (discarded) 4th byte past the end of the row,
+         // which is only overwritten later when rows are produced top-down
+         stbi_uc *spill = (flip && n == 3) ? out + n * z->s->img_x : NULL;
+         stbi_uc spill_byte = spill ? *spill : 0;
          for (k=0; k < decode_n; ++k) {
             stbi__resample *r = &res_comp[k];
             int y_bot = r->ystep >= (r->vs >> 1);
@@ -3643,6 +4383,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
                   r->line1 += z->img_comp[k].w2;
             }
          }
+         STBI__PROFILE_MARK(upsample);
          if (n >= 3) {
             stbi_uc *y = coutput[0];
             if (z->s->img_n == 3) {
@@ -3703,13 +4444,13 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
                   stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
                   stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
                   out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
+                  if (n == 2) out[1] = 255;
                   out += n;
                }
             } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
                for (i=0; i < z->s->img_x; ++i) {
                   out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
+                  if (n == 2) out[1] = 255;
                   out += n;
                }
             } else {
@@ -3720,7 +4461,11 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
                   for (i=0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
             }
          }
+         if (spill) *spill = spill_byte;
+         if (row_out != dest) memcpy(dest, tail_row, n * z->s->img_x);
+         STBI__PROFILE_MARK(color);
       }
+      if (tail_row) STBI_FREE(tail_row);
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
       *out_y = z->s->img_y;
@@ -3733,10 +4478,14 @@ static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int re
 {
    unsigned char* result;
    stbi__jpeg* j = (stbi__jpeg*) stbi__malloc(sizeof(stbi__jpeg));
-   STBI_NOTUSED(ri);
    j->s = s;
    stbi__setup_jpeg(j);
-   result = load_jpeg_image(j, x,y,comp,req_comp);
+   j->scale_shift = stbi__jpeg_scale_shift_on_load;
+   if (j->scale_shift == 1) j->idct_block_kernel = stbi__idct_4x4;
+   if (j->scale_shift == 2) j->idct_block_kernel = stbi__idct_2x2;
+   if (j->scale_shift == 3) j->idct_block_kernel = stbi__idct_dc;
+   ri->flipped = stbi__vertically_flip_on_load;
+   result = load_jpeg_image(j, x,y,comp,req_comp, ri->flipped);
    STBI_FREE(j);
    return result;
 }
@@ -3759,8 +4508,9 @@ static int stbi__jpeg_info_raw(stbi__jpeg *j, int *x, int *y, int *comp)
       stbi__rewind( j->s );
       return 0;
    }
-   if (x) *x = j->s->img_x;
-   if (y) *y = j->s->img_y;
+   // report the size a load with the current scale setting will produce
+   if (x) *x = (j->s->img_x + (1 << stbi__jpeg_scale_shift_on_load) - 1) >> stbi__jpeg_scale_shift_on_load;
+   if (y) *y = (j->s->img_y + (1 << stbi__jpeg_scale_shift_on_load) - 1) >> stbi__jpeg_scale_shift_on_load;
    if (comp) *comp = j->s->img_n >= 3 ? 3 : 1;
    return 1;
 }
@@ -3875,7 +4625,7 @@ typedef struct
 {
    stbi_uc *zbuffer, *zbuffer_end;
    int num_bits;
-   stbi__uint32 code_buffer;
+   stbi__uint64 code_buffer;
 
    char *zout;
    char *zout_start;
@@ -3891,20 +4641,38 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
    return *z->zbuffer++;
 }
 
+stbi_inline static stbi__uint64 stbi__zload64le(const stbi_uc *p)
+{
+   // compilers turn this into a single load on little-endian targets
+   return  (stbi__uint64) p[0]        | ((stbi__uint64) p[1] <<  8) |
+          ((stbi__uint64) p[2] << 16) | ((stbi__uint64) p[3] << 24) |
+          ((stbi__uint64) p[4] << 32) | ((stbi__uint64) p[5] << 40) |
+          ((stbi__uint64) p[6] << 48) | ((stbi__uint64) p[7] << 56);
+}
+
+// code_buffer may hold look-ahead bits above num_bits; they are always the
+// stream bits that follow, so OR-ing the same bytes in again is harmless
 static void stbi__fill_bits(stbi__zbuf *z)
 {
+   if (z->zbuffer_end - z->zbuffer >= 8) {
+      // top up to 56..63 bits with one 8-byte load; the bytes that don't fit
+      // aren't consumed and get loaded again next time
+      z->code_buffer |= stbi__zload64le(z->zbuffer) << z->num_bits;
+      z->zbuffer += (63 - z->num_bits) >> 3;
+      z->num_bits |= 56;
+      return;
+   }
    do {
-      STBI_ASSERT(z->code_buffer < (1U << z->num_bits));
-      z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
+      z->code_buffer |= (stbi__uint64) stbi__zget8(z) << z->num_bits;
       z->num_bits += 8;
-   } while (z->num_bits <= 24);
+   } while (z->num_bits <= 48);
 }
 
 stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
 {
    unsigned int k;
    if (z->num_bits < n) stbi__fill_bits(z);
-   k = z->code_buffer & ((1 << n) - 1);
+   k = (unsigned int) (z->code_buffer & ((1 << n) - 1));
    z->code_buffer >>= n;
    z->num_bits -= n;
    return k;
@@ -3915,7 +4683,7 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse((int) (a->code_buffer & 0xffff), 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -3928,10 +4696,10 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    return z->value[b];
 }
 
-stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
+// caller guarantees at least 16 bits in the buffer
+stbi_inline static int stbi__zhuffman_decode_nofill(stbi__zbuf *a, stbi__zhuffman *z)
 {
    int b,s;
-   if (a->num_bits < 16) stbi__fill_bits(a);
    b = z->fast[a->code_buffer & STBI__ZFAST_MASK];
    if (b) {
       s = b >> 9;
@@ -3942,6 +4710,12 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
    return stbi__zhuffman_decode_slowpath(a, z);
 }
 
+stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
+{
+   if (a->num_bits < 16) stbi__fill_bits(a);
+   return stbi__zhuffman_decode_nofill(a, z);
+}
+
 static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room for n bytes
 {
    char *q;
@@ -3975,11 +4749,77 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+// output slack the fast loop needs: the longest match plus 8-byte overcopy
+#define STBI__ZFAST_OUT_SLACK  (258 + 8)
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z;
+      if (a->zbuffer_end - a->zbuffer >= 8 && a->zout_end - zout >= STBI__ZFAST_OUT_SLACK) {
+         // fast path, away from the ends of both buffers. one refill leaves
+         // >= 56 bits, enough for a length code, a distance code and their
+         // extra bits (15+5+15+13), or for up to three literals in a row
+         stbi_uc *p;
+         int len,dist,b;
+         stbi__fill_bits(a);
+         z = stbi__zhuffman_decode_nofill(a, &a->z_length);
+         if (z < 256) {
+            if (z < 0) return stbi__err("bad huffman code","Corrupt PNG");
+            *zout++ = (char) z;
+            // follow-on literals that hit the fast table need no refill
+            b = a->z_length.fast[a->code_buffer & STBI__ZFAST_MASK];
+            if (b && (b & 511) < 256) {
+               a->code_buffer >>= b >> 9;
+               a->num_bits -= b >> 9;
+               *zout++ = (char) (b & 511);
+               b = a->z_length.fast[a->code_buffer & STBI__ZFAST_MASK];
+               if (b && (b & 511) < 256) {
+                  a->code_buffer >>= b >> 9;
+                  a->num_bits -= b >> 9;
+                  *zout++ = (char) (b & 511);
+               }
+            }
+            continue;
+         }
+         if (z == 256) {
+            a->zout = zout;
+            return 1;
+         }
+         z -= 257;
+         // length codes 286 and 287 (and distance codes 30 and 31) can be
+         // coded in fixed-Huffman blocks but must not appear in the data
+         if (z >= 29) return stbi__err("bad huffman code","Corrupt PNG");
+         len = stbi__zlength_base[z];
+         if (stbi__zlength_extra[z]) len += stbi__zreceive(a, stbi__zlength_extra[z]);
+         z = stbi__zhuffman_decode_nofill(a, &a->z_distance);
+         if (z < 0 || z >= 30) return stbi__err("bad huffman code","Corrupt PNG");
+         dist = stbi__zdist_base[z];
+         if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
+         if (zout - a->zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
+         p = (stbi_uc *) (zout - dist);
+         if (dist >= 8) {
+            // 8 bytes at a time; may write up to 7 bytes past the match,
+            // which the slack covers and later output overwrites
+            char *end = zout + len;
+            do {
+               memcpy(zout, p, 8);
+               zout += 8;
+               p += 8;
+            } while (zout < end);
+            zout = end;
+         } else if (dist == 1) {
+            memset(zout, *p, len);
+            zout += len;
+         } else {
+            do *zout++ = *p++; while (--len);
+         }
+         continue;
+      }
+
+      // careful path near the end of the input or output
+      z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -3995,10 +4835,13 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
             return 1;
          }
          z -= 257;
+         // length codes 286 and 287 (and distance codes 30 and 31) can be
+         // coded in fixed-Huffman blocks but must not appear in the data
+         if (z >= 29) return stbi__err("bad huffman code","Corrupt PNG");
          len = stbi__zlength_base[z];
          if (stbi__zlength_extra[z]) len += stbi__zreceive(a, stbi__zlength_extra[z]);
          z = stbi__zhuffman_decode(a, &a->z_distance);
-         if (z < 0) return stbi__err("bad huffman code","Corrupt PNG");
+         if (z < 0 || z >= 30) return stbi__err("bad huffman code","Corrupt PNG");
          dist = stbi__zdist_base[z];
          if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
          if (zout - a->zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
@@ -4074,21 +4917,29 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
       stbi__zreceive(a, a->num_bits & 7); // discard
    // drain the bit-packed data into header
    k = 0;
-   while (a->num_bits > 0) {
+   while (a->num_bits > 0 && k < 4) {
       header[k++] = (stbi_uc) (a->code_buffer & 255); // suppress MSVC run-time check
       a->code_buffer >>= 8;
       a->num_bits -= 8;
    }
-   STBI_ASSERT(a->num_bits == 0);
+   if (a->num_bits == 0) a->code_buffer = 0; // drop look-ahead, we read zbuffer directly now
    // now fill header the normal way
    while (k < 4)
       header[k++] = stbi__zget8(a);
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
-   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
    if (a->zout + len > a->zout_end)
       if (!stbi__zexpand(a, a->zout, len)) return 0;
+   // the 64-bit bit buffer can still hold the first few bytes of the block
+   while (a->num_bits > 0 && len > 0) {
+      *a->zout++ = (char) (a->code_buffer & 255);
+      a->code_buffer >>= 8;
+      a->num_bits -= 8;
+      --len;
+   }
+   if (a->num_bits == 0) a->code_buffer = 0;
+   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
    memcpy(a->zout, a->zbuffer, len);
    a->zbuffer += len;
    a->zout += len;
@@ -4290,6 +5141,7 @@ typedef struct
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   int flip;   // store scanlines bottom-to-top
 } stbi__png;
 
 
@@ -4324,10 +5176,133 @@ static int stbi__paeth(int a, int b, int c)
    return c;
 }
 
+#ifdef STBI_SSE2
+// SIMD unfiltering for 8-bit rows. Up is a straight 16-byte add; the others
+// depend on the pixel to the left, so they run one 3- or 4-byte pixel per
+// iteration with every channel in parallel.
+
+static void stbi__png_unfilter_up_sse2(stbi_uc *cur, stbi_uc *raw, stbi_uc *prior, int nk)
+{
+   int k = 0;
+   for (; k+16 <= nk; k += 16) {
+      __m128i r = _mm_loadu_si128((__m128i *) (raw + k));
+      __m128i b = _mm_loadu_si128((__m128i *) (prior + k));
+      _mm_storeu_si128((__m128i *) (cur + k), _mm_add_epi8(r, b));
+   }
+   for (; k < nk; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+
+// n is a constant at every call site, so these compile to plain moves
+stbi_inline static __m128i stbi__png_load_px(const stbi_uc *p, int n)
+{
+   int v;
+   if (n == 4)
+      memcpy(&v, p, 4);
+   else
+      v = p[0] | (p[1] << 8) | (p[2] << 16);
+   return _mm_cvtsi32_si128(v);
+}
+
+stbi_inline static void stbi__png_store_px(stbi_uc *p, __m128i x, int n, int alpha)
+{
+   int v = _mm_cvtsi128_si32(x) | alpha;
+   if (n == 4) {
+      memcpy(p, &v, 4);
+   } else {
+      p[0] = (stbi_uc) v;
+      p[1] = (stbi_uc) (v >> 8);
+      p[2] = (stbi_uc) (v >> 16);
+   }
+}
+
+stbi_inline static void stbi__png_unfilter_px_n(int filter, stbi_uc *cur, stbi_uc *raw, stbi_uc *prior, stbi__uint32 count, int img_n, int out_n)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i a = stbi__png_load_px(cur - out_n, out_n);
+   int alpha = out_n > img_n ? (int) 0xff000000 : 0;
+   stbi__uint32 i;
+
+   switch (filter) {
+      case STBI__F_none:
+         for (i=0; i < count; ++i, raw += img_n, cur += out_n)
+            stbi__png_store_px(cur, stbi__png_load_px(raw, img_n), out_n, alpha);
+         break;
+      case STBI__F_sub:
+         for (i=0; i < count; ++i, raw += img_n, cur += out_n) {
+            a = _mm_add_epi8(stbi__png_load_px(raw, img_n), a);
+            stbi__png_store_px(cur, a, out_n, alpha);
+         }
+         break;
+      case STBI__F_up:
+         for (i=0; i < count; ++i, raw += img_n, cur += out_n, prior += out_n) {
+            __m128i b = stbi__png_load_px(prior, out_n);
+            stbi__png_store_px(cur, _mm_add_epi8(stbi__png_load_px(raw, img_n), b), out_n, alpha);
+         }
+         break;
+      case STBI__F_avg:
+      case STBI__F_avg_first: {
+         // floor((a+b)/2) == pavgb(a,b) - ((a^b)&1)
+         __m128i one = _mm_set1_epi8(1);
+         for (i=0; i < count; ++i, raw += img_n, cur += out_n, prior += out_n) {
+            __m128i b = filter == STBI__F_avg ? stbi__png_load_px(prior, out_n) : zero;
+            __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+            a = _mm_add_epi8(stbi__png_load_px(raw, img_n), avg);
+            stbi__png_store_px(cur, a, out_n, alpha);
+         }
+         break;
+      }
+      case STBI__F_paeth: {
+         // 16-bit lanes: pa = |b-c|, pb = |a-c|, pc = |a+b-2c|, ties go a, b, c
+         __m128i lo = _mm_set1_epi16(0xff);
+         __m128i c = _mm_unpacklo_epi8(stbi__png_load_px(prior - out_n, out_n), zero);
+         a = _mm_unpacklo_epi8(a, zero);
+         for (i=0; i < count; ++i, raw += img_n, cur += out_n, prior += out_n) {
+            __m128i b = _mm_unpacklo_epi8(stbi__png_load_px(prior, out_n), zero);
+            __m128i r = _mm_unpacklo_epi8(stbi__png_load_px(raw, img_n), zero);
+            __m128i bc = _mm_sub_epi16(b, c);
+            __m128i ac = _mm_sub_epi16(a, c);
+            __m128i abc = _mm_add_epi16(ac, bc);
+            __m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+            __m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+            __m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc));
+            __m128i m = _mm_min_epi16(_mm_min_epi16(pa, pb), pc);
+            __m128i use_a = _mm_cmpeq_epi16(pa, m);
+            __m128i use_b = _mm_cmpeq_epi16(pb, m);
+            __m128i pred = _mm_or_si128(_mm_and_si128(use_b, b), _mm_andnot_si128(use_b, c));
+            pred = _mm_or_si128(_mm_and_si128(use_a, a), _mm_andnot_si128(use_a, pred));
+            a = _mm_and_si128(_mm_add_epi16(r, pred), lo);
+            c = b;
+            stbi__png_store_px(cur, _mm_packus_epi16(a, zero), out_n, alpha);
+         }
+         break;
+      }
+   }
+}
+
+// unfilters 'count' pixels of img_n (3 or 4) channels into pixels of out_n
+// channels; when out_n == img_n+1 the added alpha is set to 255. the pixel
+// before cur (and prior) must already be decoded. returns 0 if not handled.
+static int stbi__png_unfilter_px_sse2(int filter, stbi_uc *cur, stbi_uc *raw, stbi_uc *prior, stbi__uint32 count, int img_n, int out_n)
+{
+   if (filter == STBI__F_paeth_first) filter = STBI__F_sub; // paeth(a,0,0) == a
+   if (img_n == 4)
+      stbi__png_unfilter_px_n(filter, cur, raw, prior, count, 4, 4);
+   else if (img_n == 3 && out_n == 3)
+      stbi__png_unfilter_px_n(filter, cur, raw, prior, count, 3, 3);
+   else if (img_n == 3)
+      stbi__png_unfilter_px_n(filter, cur, raw, prior, count, 3, 4);
+   else
+      return 0;
+   return 1;
+}
+#endif
+
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
-// create the png data from post-deflated data
-static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+// create the png data from post-deflated data. if 'flip' is set, scanlines
+// are stored bottom-to-top (filters still see the previous *decoded* row).
+static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color, int flip)
 {
    int bytes = (depth == 16? 2 : 1);
    stbi__context *s = a->s;
@@ -4354,7 +5329,8 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    if (raw_len < img_len) return stbi__err("not enough pixels","Corrupt PNG");
 
    for (j=0; j < y; ++j) {
-      stbi_uc *cur = a->out + stride*j;
+      stbi__uint32 row = flip ? y-1-j : j;
+      stbi_uc *cur = a->out + stride*row;
       stbi_uc *prior;
       int filter = *raw++;
 
@@ -4367,7 +5343,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          filter_bytes = 1;
          width = img_width_bytes;
       }
-      prior = cur - stride; // bugfix: need to compute this after 'cur +=' computation above
+      prior = flip ? cur + stride : cur - stride; // bugfix: need to compute this after 'cur +=' computation above
 
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
@@ -4408,6 +5384,21 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       // this is a little gross, so that we don't switch per-pixel or per-component
       if (depth < 8 || img_n == out_n) {
          int nk = (width - 1)*filter_bytes;
+         #ifdef STBI_SSE2
+         if (stbi__sse2_available()) {
+            int handled = 1;
+            if (filter == STBI__F_up)
+               stbi__png_unfilter_up_sse2(cur, raw, prior, nk);
+            else if (depth == 8 && filter != STBI__F_none)
+               handled = stbi__png_unfilter_px_sse2(filter, cur, raw, prior, width - 1, img_n, out_n);
+            else
+               handled = 0;
+            if (handled) {
+               raw += nk;
+               continue;
+            }
+         }
+         #endif
          #define STBI__CASE(f) \
              case f:     \
                 for (k=0; k < nk; ++k)
@@ -4425,6 +5416,13 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          raw += nk;
       } else {
          STBI_ASSERT(img_n+1 == out_n);
+         #ifdef STBI_SSE2
+         if (depth == 8 && stbi__sse2_available() &&
+             stbi__png_unfilter_px_sse2(filter, cur, raw, prior, x - 1, img_n, out_n)) {
+            raw += (x - 1)*img_n;
+            continue;
+         }
+         #endif
          #define STBI__CASE(f) \
              case f:     \
                 for (i=x-1; i >= 1; --i, cur[filter_bytes]=255,raw+=filter_bytes,cur+=output_bytes,prior+=output_bytes) \
@@ -4443,7 +5441,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          // the loop above sets the high byte of the pixels' alpha, but for
          // 16 bit png files we also need the low byte set. we'll do that here.
          if (depth == 16) {
-            cur = a->out + stride*j; // start at the beginning of the row again
+            cur = a->out + stride*row; // start at the beginning of the row again
             for (i=0; i < x; ++i,cur+=output_bytes) {
                cur[filter_bytes+1] = 255;
             }
@@ -4539,14 +5537,14 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    return 1;
 }
 
-static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint32 image_data_len, int out_n, int depth, int color, int interlaced)
+static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint32 image_data_len, int out_n, int depth, int color, int interlaced, int flip)
 {
    int bytes = (depth == 16 ? 2 : 1);
    int out_bytes = out_n * bytes;
    stbi_uc *final;
    int p;
    if (!interlaced)
-      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
+      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color, flip);
 
    // de-interlacing
    final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
@@ -4561,13 +5559,14 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
       y = (a->s->img_y - yorig[p] + yspc[p]-1) / yspc[p];
       if (x && y) {
          stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
-         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
+         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color, 0)) {
             STBI_FREE(final);
             return 0;
          }
          for (j=0; j < y; ++j) {
             for (i=0; i < x; ++i) {
                int out_y = j*yspc[p]+yorig[p];
+               if (flip) out_y = a->s->img_y - 1 - out_y;
                int out_x = i*xspc[p]+xorig[p];
                memcpy(final + out_y*a->s->img_x*out_bytes + out_x*out_bytes,
                       a->out + (j*x+i)*out_bytes, out_bytes);
@@ -4670,19 +5669,56 @@ static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int
    return 1;
 }
 
-static int stbi__unpremultiply_on_load = 0;
-static int stbi__de_iphone_flag = 0;
+static int stbi__unpremultiply_on_load_global = 0;
+static int stbi__de_iphone_flag_global = 0;
 
 STBIDEF void stbi_set_unpremultiply_on_load(int flag_true_if_should_unpremultiply)
 {
-   stbi__unpremultiply_on_load = flag_true_if_should_unpremultiply;
+   stbi__unpremultiply_on_load_global = flag_true_if_should_unpremultiply;
 }
 
 STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert)
 {
-   stbi__de_iphone_flag = flag_true_if_should_convert;
+   stbi__de_iphone_flag_global = flag_true_if_should_convert;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__unpremultiply_on_load  stbi__unpremultiply_on_load_global
+#define stbi__de_iphone_flag  stbi__de_iphone_flag_global
+
+STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpremultiply)
+{
+   stbi_set_unpremultiply_on_load(flag_true_if_should_unpremultiply);
 }
 
+STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert)
+{
+   stbi_convert_iphone_png_to_rgb(flag_true_if_should_convert);
+}
+#else
+static STBI_THREAD_LOCAL int stbi__unpremultiply_on_load_local, stbi__unpremultiply_on_load_set;
+static STBI_THREAD_LOCAL int stbi__de_iphone_flag_local, stbi__de_iphone_flag_set;
+
+STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpremultiply)
+{
+   stbi__unpremultiply_on_load_local = flag_true_if_should_unpremultiply;
+   stbi__unpremultiply_on_load_set = 1;
+}
+
+STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert)
+{
+   stbi__de_iphone_flag_local = flag_true_if_should_convert;
+   stbi__de_iphone_flag_set = 1;
+}
+
+#define stbi__unpremultiply_on_load  (stbi__unpremultiply_on_load_set           \
+                                      ? stbi__unpremultiply_on_load_local       \
+                                      : stbi__unpremultiply_on_load_global)
+#define stbi__de_iphone_flag  (stbi__de_iphone_flag_set                         \
+                               ? stbi__de_iphone_flag_local                     \
+                               : stbi__de_iphone_flag_global)
+#endif
+
 static void stbi__de_iphone(stbi__png *z)
 {
    stbi__context *s = z->s;
@@ -4846,14 +5882,17 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             // initial guess for decoded data size to avoid unnecessary reallocs
             bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
             raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
+            STBI__PROFILE_BEGIN();
             z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
             if (z->expanded == NULL) return 0; // zlib should set error
+            STBI__PROFILE_MARK(entropy);
             STBI_FREE(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
-            if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
+            if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace, z->flip)) return 0;
+            STBI__PROFILE_MARK(filter);
             if (has_trans) {
                if (z->depth == 16) {
                   if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
@@ -4934,6 +5973,9 @@ static void *stbi__png_load(stbi__context *s, int *x, int *y, int *comp, int req
 {
    stbi__png p;
    p.s = s;
+   // everything after unfiltering (transparency, palette expansion,
+   // stbi__convert_format) works per pixel, so the row order carries through
+   p.flip = ri->flipped = stbi__vertically_flip_on_load;
    return stbi__do_png(&p, x,y,comp,req_comp, ri);
 }
 
@@ -6436,8 +7478,10 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
             } else
                return stbi__errpuc("missing color table", "Corrupt GIF");            
             
+            STBI__PROFILE_BEGIN();
             o = stbi__process_gif_raster(s, g);
             if (o == NULL) return NULL;
+            STBI__PROFILE_MARK(entropy);
 
             // if this was the first frame, 
             pcount = g->w * g->h; 
@@ -6535,7 +7579,7 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
             }
             memcpy( out + ((layers - 1) * stride), u, stride ); 
             if (layers >= 2) {
-               two_back = out - 2 * stride; 
+               two_back = out + (layers - 2) * stride; // frame before the one just decoded
             }
 
             if (delays) {
@@ -6589,6 +7633,152 @@ static int stbi__gif_info(stbi__context *s, int *x, int *y, int *comp)
 {
    return stbi__gif_info_raw(s,x,y,comp);
 }
+
+struct stbi__gif_stream
+{
+   stbi__context s;
+   stbi__gif g;
+   stbi_uc const *buffer;  // start of the data, or NULL when reading through stdio
+   int len;
+#ifndef STBI_NO_STDIO
+   stbi__file file;
+   int has_file;
+#endif
+   int frames;             // frames returned since the last (re)start
+   stbi_uc *two_back;      // frame n-2 while decoding frame n, for "restore to previous" disposal
+   stbi_uc *prev;          // scratch for frame n-1; swapped with two_back after each frame
+};
+
+static int stbi__gif_stream_start(stbi_gif_stream *gs)
+{
+#ifndef STBI_NO_STDIO
+   if (!gs->buffer) {
+      if (fseek(gs->file.f, 0, SEEK_SET) != 0) return stbi__err("can't seek", "Unable to rewind file");
+      stbi__start_file(&gs->s, gs->file.f);
+      return 1;
+   }
+#endif
+   stbi__start_mem(&gs->s, gs->buffer, gs->len);
+   return 1;
+}
+
+static void stbi__gif_stream_reset(stbi_gif_stream *gs)
+{
+   STBI_FREE(gs->g.out);
+   STBI_FREE(gs->g.history);
+   STBI_FREE(gs->g.background);
+   memset(&gs->g, 0, sizeof(gs->g));
+   gs->frames = 0;
+}
+
+static stbi_gif_stream *stbi__gif_stream_init(stbi_gif_stream *gs, int *x, int *y)
+{
+   int w, h;
+   if (!stbi__gif_test(&gs->s)) {
+      stbi__err("not GIF", "Image was not as a gif type.");
+      goto fail;
+   }
+   // the header is read again by the first stbi__gif_load_next, so start over
+   // (stbi__rewind only covers the first buffer of a stdio stream)
+   if (!stbi__gif_info_raw(&gs->s, &w, &h, NULL) || !stbi__gif_stream_start(gs)) goto fail;
+   if (!stbi__mad3sizes_valid(w, h, 4, 0)) {
+      stbi__err("too large", "Corrupt GIF");
+      goto fail;
+   }
+   gs->two_back = (stbi_uc *) stbi__malloc_mad3(w, h, 4, 0);
+   gs->prev = (stbi_uc *) stbi__malloc_mad3(w, h, 4, 0);
+   if (!gs->two_back || !gs->prev) {
+      stbi__err("outofmem", "Out of memory");
+      goto fail;
+   }
+   if (x) *x = w;
+   if (y) *y = h;
+   return gs;
+
+fail:
+   stbi_gif_stream_close(gs);
+   return NULL;
+}
+
+STBIDEF stbi_gif_stream *stbi_gif_stream_open_memory(stbi_uc const *buffer, int len, int *x, int *y)
+{
+   stbi_gif_stream *gs = (stbi_gif_stream *) stbi__malloc(sizeof(*gs));
+   if (!gs) return (stbi_gif_stream *) stbi__errpuc("outofmem", "Out of memory");
+   memset(gs, 0, sizeof(*gs));
+   gs->buffer = buffer;
+   gs->len = len;
+   stbi__gif_stream_start(gs);
+   return stbi__gif_stream_init(gs, x, y);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_gif_stream *stbi_gif_stream_open(char const *filename, int *x, int *y)
+{
+   stbi_gif_stream *gs = (stbi_gif_stream *) stbi__malloc(sizeof(*gs));
+   if (!gs) return (stbi_gif_stream *) stbi__errpuc("outofmem", "Out of memory");
+   memset(gs, 0, sizeof(*gs));
+   if (!stbi__open_file(&gs->file, &gs->s, filename, 0)) {
+      STBI_FREE(gs);
+      return (stbi_gif_stream *) stbi__errpuc("can't fopen", "Unable to open file");
+   }
+   gs->has_file = 1;
+#ifdef STBI__MMAP
+   if (gs->file.map) {
+      gs->buffer = (stbi_uc const *) gs->file.map;
+      gs->len = (int) gs->file.map_len;
+   }
+#endif
+   return stbi__gif_stream_init(gs, x, y);
+}
+#endif
+
+STBIDEF int stbi_gif_stream_next(stbi_gif_stream *gs, stbi_uc *out, int *delay_ms)
+{
+   int comp, stride, row, h;
+   stbi_uc *u, *t;
+
+   // keep frame n-1 around: it becomes "two back" for the frame after this one
+   if (gs->frames > 0)
+      memcpy(gs->prev, gs->g.out, (size_t) gs->g.w * gs->g.h * 4);
+
+   u = stbi__gif_load_next(&gs->s, &gs->g, &comp, 4, gs->frames >= 2 ? gs->two_back : 0);
+   if (u == (stbi_uc *) &gs->s) return 0;  // end of animated gif marker
+   if (!u) return -1;
+
+   t = gs->two_back;
+   gs->two_back = gs->prev;
+   gs->prev = t;
+   ++gs->frames;
+
+   stride = gs->g.w * 4;
+   h = gs->g.h;
+   if (stbi__vertically_flip_on_load) {
+      for (row = 0; row < h; ++row)
+         memcpy(out + (size_t) row * stride, u + (size_t) (h - 1 - row) * stride, stride);
+   } else {
+      memcpy(out, u, (size_t) stride * h);
+   }
+   if (delay_ms) *delay_ms = gs->g.delay;
+   return 1;
+}
+
+STBIDEF int stbi_gif_stream_rewind(stbi_gif_stream *gs)
+{
+   stbi__gif_stream_reset(gs);
+   return stbi__gif_stream_start(gs);
+}
+
+STBIDEF void stbi_gif_stream_close(stbi_gif_stream *gs)
+{
+   if (!gs) return;
+   stbi__gif_stream_reset(gs);
+   STBI_FREE(gs->two_back);
+   STBI_FREE(gs->prev);
+#ifndef STBI_NO_STDIO
+   if (gs->has_file) stbi__close_file(&gs->file);
+#endif
+   STBI_FREE(gs);
+}
 #endif
 
 // *************************************************************************************************
@@ -7165,11 +8355,12 @@ static int stbi__is_16_main(stbi__context *s)
 #ifndef STBI_NO_STDIO
 STBIDEF int stbi_info(char const *filename, int *x, int *y, int *comp)
 {
-    FILE *f = stbi__fopen(filename, "rb");
+    stbi__file file;
+    stbi__context s;
     int result;
-    if (!f) return stbi__err("can't fopen", "Unable to open file");
-    result = stbi_info_from_file(f, x, y, comp);
-    fclose(f);
+    if (!stbi__open_file(&file, &s, filename, 0)) return stbi__err("can't fopen", "Unable to open file");
+    result = stbi__info_main(&s, x, y, comp);
+    stbi__close_file(&file);
     return result;
 }
 
@@ -7186,11 +8377,12 @@ STBIDEF int stbi_info_from_file(FILE *f, int *x, int *y, int *comp)
 
 STBIDEF int stbi_is_16_bit(char const *filename)
 {
-    FILE *f = stbi__fopen(filename, "rb");
+    stbi__file file;
+    stbi__context s;
     int result;
-    if (!f) return stbi__err("can't fopen", "Unable to open file");
-    result = stbi_is_16_bit_from_file(f);
-    fclose(f);
+    if (!stbi__open_file(&file, &s, filename, 0)) return stbi__err("can't fopen", "Unable to open file");
+    result = stbi__is_16_main(&s);
+    stbi__close_file(&file);
     return result;
 }
 
@@ -2,13 +2,45 @@
 
 uniform sampler2D uImage;
 
+// virtual texture: uImage is replaced by pages of uAtlas, found through uPageTable
+uniform bool uVirtual;
+uniform sampler2D uAtlas;
+uniform usampler2D uPageTable;
+uniform vec2 uVtSize;
+uniform int uVtPageSize;
+uniform int uVtBorder;
+uniform int uVtNumLevels;
+uniform ivec2 uVtLevelPages[16];
+uniform int uVtLevelRow[16];
+
 in vec2 vTexCoord;
 in vec3 vLightWeighting;
 
 out vec4 FragColor;
 
+vec4 VirtualTexture(vec2 uv) {
+    // mip level from the screen-space footprint of a level 0 texel
+    vec2 texel = uv * uVtSize;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+    int level = clamp(int(floor(lod)), 0, uVtNumLevels - 1);
+
+    // the page table holds the atlas slot and level of the finest resident
+    // page covering this one
+    float page_size = float(uVtPageSize);
+    ivec2 page = clamp(ivec2(texel / (page_size * exp2(float(level)))), ivec2(0), uVtLevelPages[level] - 1);
+    uvec4 entry = texelFetch(uPageTable, ivec2(page.x, page.y + uVtLevelRow[level]), 0);
+    int resident = int(entry.b);
+
+    vec2 resident_origin = vec2(page >> (resident - level)) * page_size;
+    vec2 in_page = clamp(texel / exp2(float(resident)) - resident_origin, vec2(0.0), vec2(page_size));
+    vec2 atlas_texel = vec2(entry.rg) * float(uVtPageSize + 2 * uVtBorder) + float(uVtBorder) + in_page;
+    return textureLod(uAtlas, atlas_texel / vec2(textureSize(uAtlas, 0)), 0.0);
+}
+
 void main() {
-    vec4 textureColor = texture(uImage, vTexCoord);
+    vec4 textureColor = uVirtual ? VirtualTexture(vTexCoord) : texture(uImage, vTexCoord);
 
     FragColor = vec4(textureColor.rgb * vLightWeighting, textureColor.a);
 }
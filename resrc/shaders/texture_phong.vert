@@ -1,8 +1,11 @@
 #version 150
 
-uniform mat4 uModelViewMatrix;
-uniform mat4 uProjectionMatrix;
-uniform mat3 uNormalMatrix;
+// written once a frame into the stream ring (src/stream_ring.h)
+layout(std140) uniform FrameTransforms {
+    mat4 uProjectionMatrix;
+    mat4 uModelViewMatrix;
+    mat3 uNormalMatrix;
+};
 uniform vec3 uAmbientColor;
 uniform vec3 uLightingDirection;
 uniform vec3 uDirectionalColor;
@@ -10,15 +13,24 @@ uniform vec3 uDirectionalColor;
 in vec3 aVertexPosition;
 in vec3 aVertexNormal;
 in vec2 aVertexTexCoord;
+// per instance: position and scale, rotation quaternion; both are the
+// constant (0, 0, 0, 1) when a single cube is drawn
+in vec4 aInstancePosition;
+in vec4 aInstanceRotation;
 
 out vec2 vTexCoord;
 out vec3 vLightWeighting;
 
+vec3 Rotate(vec4 q, vec3 v) {
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
 void main() {
-    gl_Position = uProjectionMatrix * uModelViewMatrix * vec4(aVertexPosition, 1.0);
+    vec3 position = Rotate(aInstanceRotation, aVertexPosition) * aInstancePosition.w + aInstancePosition.xyz;
+    gl_Position = uProjectionMatrix * uModelViewMatrix * vec4(position, 1.0);
     vTexCoord = aVertexTexCoord;
 
-    vec3 transformedNormal = uNormalMatrix * aVertexNormal;
+    vec3 transformedNormal = uNormalMatrix * Rotate(aInstanceRotation, aVertexNormal);
     float directionalLightWeighting = max(dot(transformedNormal, uLightingDirection), 0.0);
     vLightWeighting = uAmbientColor + uDirectionalColor * directionalLightWeighting;
 }
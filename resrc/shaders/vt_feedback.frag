@@ -0,0 +1,26 @@
+#version 150
+
+// records the virtual texture page and level texture_phong.frag samples here
+uniform vec2 uVtSize;
+uniform int uVtPageSize;
+uniform int uVtNumLevels;
+uniform ivec2 uVtLevelPages[16];
+uniform float uVtLodBias;
+
+in vec2 vTexCoord;
+in vec3 vLightWeighting;
+
+out uvec4 FeedbackPage;
+
+void main() {
+    // same level selection as the main pass; the bias accounts for the
+    // feedback target's lower resolution
+    vec2 texel = vTexCoord * uVtSize;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + uVtLodBias;
+    int level = clamp(int(floor(lod)), 0, uVtNumLevels - 1);
+
+    ivec2 page = clamp(ivec2(texel / (float(uVtPageSize) * exp2(float(level)))), ivec2(0), uVtLevelPages[level] - 1);
+    FeedbackPage = uvec4(uvec2(page), uint(level), 1u);
+}
@@ -0,0 +1,254 @@
+#include "animated_texture.h"
+#include <cstdio>
+
+static void DecoderMain(AnimatedTexture *anim);
+static void FinishSlot(AnimatedTexture *anim, int slot);
+
+bool AnimatedTextureOpen(AnimatedTexture *anim, const char *filename)
+{
+    anim->filename = filename;
+    anim->stream = stbi_gif_stream_open(filename, &anim->width, &anim->height);
+    if (anim->stream == NULL)
+    {
+        fprintf(stderr, "Error: cannot open animation %s (%s)\n", filename, stbi_failure_reason());
+        return false;
+    }
+
+    GLsizeiptr size = (GLsizeiptr)anim->width * anim->height * 4;
+    for (int i = 0; i < ANIM_NUM_SLOTS; i++)
+    {
+        AnimatedSlot& slot = anim->slots[i];
+        slot.state = SlotFree;
+        slot.upload_fence = 0;
+        slot.pixels = NULL;
+        slot.delay_ms = 0;
+        slot.ok = false;
+        glGenBuffers(1, &slot.pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        glGenTextures(1, &slot.tex_id);
+        glBindTexture(GL_TEXTURE_2D, slot.tex_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, anim->width, anim->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    anim->next_free = 0;
+    anim->shown = -1;
+    anim->finished = false;
+    anim->next_due = 0.0;
+    anim->shutdown = false;
+    anim->decoder = std::thread(DecoderMain, anim);
+    AnimatedTextureUpdate(anim);
+
+    return true;
+}
+
+void AnimatedTextureClose(AnimatedTexture *anim)
+{
+    {
+        std::lock_guard<std::mutex> lock(anim->mutex);
+        anim->shutdown = true;
+    }
+    anim->decode_ready.notify_all();
+    anim->decoder.join();
+    stbi_gif_stream_close(anim->stream);
+    anim->stream = NULL;
+
+    for (int i = 0; i < ANIM_NUM_SLOTS; i++)
+    {
+        AnimatedSlot& slot = anim->slots[i];
+        if (slot.pixels != NULL)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            slot.pixels = NULL;
+        }
+        if (slot.upload_fence != 0)
+        {
+            glDeleteSync(slot.upload_fence);
+            slot.upload_fence = 0;
+        }
+        glDeleteBuffers(1, &slot.pbo);
+        glDeleteTextures(1, &slot.tex_id);
+    }
+    anim->decode_queue.clear();
+    anim->decode_done.clear();
+}
+
+void AnimatedTextureUpdate(AnimatedTexture *anim)
+{
+    // frames the decoder has finished, in ring order
+    std::vector<int> done;
+    {
+        std::lock_guard<std::mutex> lock(anim->mutex);
+        done.swap(anim->decode_done);
+    }
+    for (size_t i = 0; i < done.size(); i++)
+    {
+        FinishSlot(anim, done[i]);
+    }
+
+    for (int i = 0; i < ANIM_NUM_SLOTS; i++)
+    {
+        AnimatedSlot& slot = anim->slots[i];
+        if (slot.state == SlotUploading)
+        {
+            GLenum status = glClientWaitSync(slot.upload_fence, 0, 0);
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+            {
+                glDeleteSync(slot.upload_fence);
+                slot.upload_fence = 0;
+                slot.state = SlotReady;
+            }
+        }
+    }
+
+    // slots come free in ring order (the shown frame is always the oldest),
+    // so handing them over in that order keeps the frames in sequence
+    GLsizeiptr size = (GLsizeiptr)anim->width * anim->height * 4;
+    bool queued = false;
+    while (!anim->finished && anim->slots[anim->next_free].state == SlotFree)
+    {
+        AnimatedSlot& slot = anim->slots[anim->next_free];
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+        slot.pixels = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (slot.pixels == NULL)
+        {
+            break;
+        }
+        slot.state = SlotDecoding;
+        {
+            std::lock_guard<std::mutex> lock(anim->mutex);
+            anim->decode_queue.push_back(anim->next_free);
+        }
+        anim->next_free = (anim->next_free + 1) % ANIM_NUM_SLOTS;
+        queued = true;
+    }
+    if (queued)
+    {
+        anim->decode_ready.notify_one();
+    }
+}
+
+bool AnimatedTextureDue(const AnimatedTexture& anim, double now)
+{
+    return !anim.finished && now >= anim.next_due;
+}
+
+bool AnimatedTextureNextReady(const AnimatedTexture& anim)
+{
+    AnimatedSlotState state = anim.slots[(anim.shown + 1) % ANIM_NUM_SLOTS].state;
+    return state == SlotReady || state == SlotEnd;
+}
+
+void AnimatedTextureAdvance(AnimatedTexture *anim, double now)
+{
+    int next = (anim->shown + 1) % ANIM_NUM_SLOTS;
+    AnimatedSlot& slot = anim->slots[next];
+    if (slot.state == SlotEnd)
+    {
+        anim->finished = true;
+        return;
+    }
+
+    if (anim->shown >= 0)
+    {
+        anim->slots[anim->shown].state = SlotFree;
+    }
+    slot.state = SlotShown;
+    anim->shown = next;
+
+    // browsers show frames with no (or a 10 ms) delay for 100 ms, and GIFs
+    // are authored for that; a frame is only dropped from the schedule when
+    // rendering has fallen more than a whole frame behind it
+    double delay = (slot.delay_ms <= 10 ? 100 : slot.delay_ms) / 1000.0;
+    anim->next_due = now - anim->next_due > delay ? now + delay : anim->next_due + delay;
+}
+
+GLuint AnimatedTextureCurrent(const AnimatedTexture& anim)
+{
+    return anim.shown >= 0 ? anim.slots[anim.shown].tex_id : 0;
+}
+
+bool IsAnimatedTextureFile(const std::string& filename)
+{
+    return filename.size() > 4 && (filename.compare(filename.size() - 4, 4, ".gif") == 0 ||
+                                   filename.compare(filename.size() - 4, 4, ".GIF") == 0);
+}
+
+
+// Auxillary functions
+void DecoderMain(AnimatedTexture *anim)
+{
+    stbi_set_flip_vertically_on_load_thread(true);
+    int pass_frames = 0;
+    bool stopped = false;
+    for (;;)
+    {
+        int index;
+        {
+            std::unique_lock<std::mutex> lock(anim->mutex);
+            anim->decode_ready.wait(lock, [anim] { return anim->shutdown || !anim->decode_queue.empty(); });
+            if (anim->shutdown)
+            {
+                return;
+            }
+            index = anim->decode_queue.front();
+            anim->decode_queue.pop_front();
+        }
+
+        // after the last frame start over at the first; a still image (or
+        // an empty file) ends after its only pass
+        AnimatedSlot& slot = anim->slots[index];
+        int result = stopped ? 0 : stbi_gif_stream_next(anim->stream, slot.pixels, &slot.delay_ms);
+        if (result == 0 && !stopped && pass_frames > 1)
+        {
+            pass_frames = 0;
+            result = stbi_gif_stream_rewind(anim->stream) ? stbi_gif_stream_next(anim->stream, slot.pixels, &slot.delay_ms) : -1;
+        }
+        if (result < 0)
+        {
+            fprintf(stderr, "Error: cannot decode animation %s (%s)\n", anim->filename.c_str(), stbi_failure_reason());
+        }
+        pass_frames += result == 1 ? 1 : 0;
+        stopped = result != 1;
+        slot.ok = result == 1;
+
+        {
+            std::lock_guard<std::mutex> lock(anim->mutex);
+            anim->decode_done.push_back(index);
+        }
+    }
+}
+
+void FinishSlot(AnimatedTexture *anim, int index)
+{
+    AnimatedSlot& slot = anim->slots[index];
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    slot.pixels = NULL;
+    if (slot.ok)
+    {
+        // sourced from the buffer, so the transfer runs behind the frames
+        // still drawing; the fence says when the slot can be shown
+        glBindTexture(GL_TEXTURE_2D, slot.tex_id);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, anim->width, anim->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        slot.upload_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        slot.state = SlotUploading;
+    }
+    else
+    {
+        slot.state = SlotEnd;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
@@ -0,0 +1,79 @@
+#ifndef ANIMATED_TEXTURE_H
+#define ANIMATED_TEXTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <glad/glad.h>
+#include "stb_image.h"
+
+// Animated GIF texture streamed one frame at a time.
+//
+// A decoder thread pulls frames from an stbi_gif_stream into a small ring of
+// slots, each a pixel unpack buffer the GL thread maps for it, and starts
+// over at the first frame after the last one. Decoded frames are uploaded
+// from their buffer into the slot's own texture ahead of time, so showing
+// the next frame is only a change of texture id. Memory use is the ring plus
+// the decoder's few frame-sized buffers, however many frames the file has.
+//
+// The GL thread decides when to advance (see AnimatedTextureDue), which lets
+// the caller keep every rank on the same frame.
+
+#define ANIM_NUM_SLOTS 3
+
+enum AnimatedSlotState : uint8_t { SlotFree, SlotDecoding, SlotUploading, SlotReady, SlotShown, SlotEnd };
+
+typedef struct AnimatedSlot {
+    AnimatedSlotState state;
+    GLuint pbo;
+    GLuint tex_id;
+    GLsync upload_fence;
+    uint8_t *pixels;   // mapped pbo while the decoder owns the slot
+    int delay_ms;
+    bool ok;           // false: no frame (end of a still image, or a decode error)
+} AnimatedSlot;
+
+typedef struct AnimatedTexture {
+    std::string filename;
+    stbi_gif_stream *stream;   // only used by the decoder thread after open
+    int width;
+    int height;
+
+    AnimatedSlot slots[ANIM_NUM_SLOTS];
+    int next_free;             // next slot to hand to the decoder
+    int shown;                 // slot on screen, -1 before the first frame
+    bool finished;             // no frame will follow the one shown
+    double next_due;
+
+    // decoder thread; slots go through the queue in ring order
+    std::thread decoder;
+    std::deque<int> decode_queue;
+    std::vector<int> decode_done;
+    std::mutex mutex;
+    std::condition_variable decode_ready;
+    bool shutdown;
+} AnimatedTexture;
+
+bool AnimatedTextureOpen(AnimatedTexture *anim, const char *filename);
+void AnimatedTextureClose(AnimatedTexture *anim);
+
+// once per frame: hands free slots to the decoder and uploads decoded frames
+void AnimatedTextureUpdate(AnimatedTexture *anim);
+
+// 'now' is a time every rank agrees on; the first frame is due right away
+bool AnimatedTextureDue(const AnimatedTexture& anim, double now);
+// the frame after the shown one is uploaded (or there won't be one)
+bool AnimatedTextureNextReady(const AnimatedTexture& anim);
+void AnimatedTextureAdvance(AnimatedTexture *anim, double now);
+
+// texture of the frame on screen, 0 until the first one is shown
+GLuint AnimatedTextureCurrent(const AnimatedTexture& anim);
+
+bool IsAnimatedTextureFile(const std::string& filename);
+
+#endif // ANIMATED_TEXTURE_H
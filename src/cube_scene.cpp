@@ -0,0 +1,156 @@
+#include "cube_scene.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+static float RandomFloat(uint32_t *state);
+
+void CubeSceneInit(CubeScene *scene, int num_cubes, uint32_t seed)
+{
+    scene->num_cubes = num_cubes;
+    scene->instances.resize(num_cubes);
+    scene->motions.resize(num_cubes);
+    scene->draw_list.resize(num_cubes);
+    scene->update_time = 0.0;
+
+    // smallest grid with a cell for every cube; the cubes take cells spread
+    // evenly through it so a partly filled grid still fills the whole volume
+    int grid = 1;
+    while ((int64_t)grid * grid * grid < num_cubes)
+    {
+        grid++;
+    }
+    int64_t num_cells = (int64_t)grid * grid * grid;
+    float cell = 2.0f * CUBE_SCENE_EXTENT / grid;
+
+    uint32_t state = seed * 2654435761u + 1;
+    for (int i = 0; i < num_cubes; i++)
+    {
+        int64_t index = (int64_t)i * num_cells / num_cubes;
+        int cx = (int)(index % grid);
+        int cy = (int)(index / grid % grid);
+        int cz = (int)(index / grid / grid);
+        float x = -CUBE_SCENE_EXTENT + (cx + 0.5f) * cell;
+        float z = -CUBE_SCENE_EXTENT + (cz + 0.5f) * cell;
+        CubeInstance& instance = scene->instances[i];
+        instance.position[1] = -CUBE_SCENE_EXTENT + (cy + 0.5f) * cell;
+        // small enough that a cube never reaches out of its cell as it spins
+        instance.scale = cell * (0.2f + 0.08f * RandomFloat(&state));
+
+        CubeMotion& motion = scene->motions[i];
+        float axis_z = 2.0f * RandomFloat(&state) - 1.0f;
+        float theta = 2.0f * (float)M_PI * RandomFloat(&state);
+        float r = sqrtf(1.0f - axis_z * axis_z);
+        motion.axis[0] = r * cosf(theta);
+        motion.axis[1] = r * sinf(theta);
+        motion.axis[2] = axis_z;
+        motion.phase = 2.0f * (float)M_PI * RandomFloat(&state);
+        motion.rate = (0.5f + 1.5f * RandomFloat(&state)) * (RandomFloat(&state) < 0.5f ? -1.0f : 1.0f);
+        motion.orbit_radius = sqrtf(x * x + z * z);
+        motion.orbit_phase = atan2f(z, x);
+        motion.orbit_rate = 0.2f / (0.5f + motion.orbit_radius);
+
+        scene->draw_list[i] = i;
+    }
+
+    scene->num_drawn = 0;
+    scene->instance_buffer = 0;
+    scene->instance_offset = 0;
+    CubeSceneAnimate(scene, 0.0);
+}
+
+void CubeSceneRelease(CubeScene *scene)
+{
+    scene->instances.clear();
+    scene->motions.clear();
+    scene->draw_list.clear();
+    scene->num_cubes = 0;
+    scene->num_drawn = 0;
+}
+
+void CubeSceneAttach(GLuint vao, GLuint position_attrib, GLuint rotation_attrib)
+{
+    glBindVertexArray(vao);
+    glEnableVertexAttribArray(position_attrib);
+    glVertexAttribDivisor(position_attrib, 1);
+    glEnableVertexAttribArray(rotation_attrib);
+    glVertexAttribDivisor(rotation_attrib, 1);
+    glBindVertexArray(0);
+}
+
+void CubeSceneBindInstances(const CubeScene& scene, GLuint position_attrib, GLuint rotation_attrib, int first)
+{
+    size_t offset = scene.instance_offset + (size_t)first * sizeof(CubeInstance);
+    glBindBuffer(GL_ARRAY_BUFFER, scene.instance_buffer);
+    glVertexAttribPointer(position_attrib, 4, GL_FLOAT, false, sizeof(CubeInstance),
+                          (void*)(offset + offsetof(CubeInstance, position)));
+    glVertexAttribPointer(rotation_attrib, 4, GL_FLOAT, false, sizeof(CubeInstance),
+                          (void*)(offset + offsetof(CubeInstance, rotation)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CubeSceneAnimate(CubeScene *scene, double time)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < scene->num_cubes; i++)
+    {
+        const CubeMotion& motion = scene->motions[i];
+        CubeInstance& instance = scene->instances[i];
+        // wrap before converting to float so precision doesn't fall off
+        // as the clock runs
+        float orbit_angle = motion.orbit_phase + (float)fmod(motion.orbit_rate * time, 2.0 * M_PI);
+        instance.position[0] = motion.orbit_radius * cosf(orbit_angle);
+        instance.position[2] = motion.orbit_radius * sinf(orbit_angle);
+
+        float half_angle = 0.5f * (motion.phase + (float)fmod(motion.rate * time, 2.0 * M_PI));
+        float s = sinf(half_angle);
+        instance.rotation[0] = motion.axis[0] * s;
+        instance.rotation[1] = motion.axis[1] * s;
+        instance.rotation[2] = motion.axis[2] * s;
+        instance.rotation[3] = cosf(half_angle);
+    }
+
+    scene->update_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void CubeSceneSetDrawList(CubeScene *scene, const std::vector<int>& cubes)
+{
+    scene->draw_list = cubes;
+}
+
+void CubeSceneUpload(CubeScene *scene, StreamRing *ring)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // gathered straight into the ring, which the gpu reads from directly
+    int num_drawn = (int)scene->draw_list.size();
+    size_t offset = 0;
+    CubeInstance *instances = (CubeInstance*)StreamRingAlloc(ring, (size_t)num_drawn * sizeof(CubeInstance), &offset);
+    if (instances == NULL)
+    {
+        fprintf(stderr, "Error: no room in the stream ring for %d cube instances\n", num_drawn);
+        num_drawn = 0;
+    }
+    for (int i = 0; i < num_drawn; i++)
+    {
+        instances[i] = scene->instances[scene->draw_list[i]];
+    }
+    scene->instance_buffer = ring->buffer;
+    scene->instance_offset = offset;
+    scene->num_drawn = num_drawn;
+
+    scene->update_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Auxillary functions
+float RandomFloat(uint32_t *state)
+{
+    // xorshift32, top 24 bits as [0, 1)
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
@@ -0,0 +1,69 @@
+#ifndef CUBE_SCENE_H
+#define CUBE_SCENE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+#include "stream_ring.h"
+
+// Population of moving cubes drawn with instanced draw calls, one for each
+// level of detail in use.
+//
+// Cubes start in the cells of a grid filling [-CUBE_SCENE_EXTENT,
+// CUBE_SCENE_EXTENT]^3, with as many cells as the population needs. Each
+// spins about its own axis at its own rate and the population swirls about
+// the y axis, inner cubes faster than outer ones, so cubes drift past each
+// other over time. The scene is generated from a seed and animated from the
+// shared render clock, so every rank computes the same one. Per-instance
+// data is a position and scale plus a rotation quaternion (32 bytes);
+// CubeSceneAnimate computes them for a point in time and CubeSceneUpload
+// gathers the cubes on the draw list into the frame's stream ring, from
+// where texture_phong.vert applies them to the cube's vertices.
+
+#define CUBE_SCENE_EXTENT 1.5f
+
+typedef struct CubeInstance {
+    float position[3];
+    float scale;        // half the edge length (the cube mesh spans -1 to 1)
+    float rotation[4];  // unit quaternion x, y, z, w
+} CubeInstance;
+
+typedef struct CubeMotion {
+    float axis[3];      // spin
+    float phase;        // radians at time 0
+    float rate;         // radians per second
+    float orbit_radius; // swirl about the y axis
+    float orbit_phase;
+    float orbit_rate;
+} CubeMotion;
+
+typedef struct CubeScene {
+    int num_cubes;
+    std::vector<CubeInstance> instances;
+    std::vector<CubeMotion> motions;
+    std::vector<int> draw_list;          // cubes to upload, all of them by default
+    int num_drawn;                       // instances uploaded this frame
+    GLuint instance_buffer;              // where they are: the stream ring's buffer
+    size_t instance_offset;
+    double update_time;   // seconds spent in the last animate plus upload
+} CubeScene;
+
+void CubeSceneInit(CubeScene *scene, int num_cubes, uint32_t seed);
+void CubeSceneRelease(CubeScene *scene);
+
+// adds the instance attributes (divisor 1) to a vao whose per-vertex
+// attributes are already set up
+void CubeSceneAttach(GLuint vao, GLuint position_attrib, GLuint rotation_attrib);
+// points the bound vao's instance attributes at this frame's instances from
+// 'first' on; needed once a frame after CubeSceneUpload, and for instanced
+// draws of part of them without a base instance
+void CubeSceneBindInstances(const CubeScene& scene, GLuint position_attrib, GLuint rotation_attrib, int first);
+
+// moves every cube to where it is 'time' seconds in
+void CubeSceneAnimate(CubeScene *scene, double time);
+// sets the cubes CubeSceneUpload sends to the gpu
+void CubeSceneSetDrawList(CubeScene *scene, const std::vector<int>& cubes);
+void CubeSceneUpload(CubeScene *scene, StreamRing *ring);
+
+#endif // CUBE_SCENE_H
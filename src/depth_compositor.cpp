@@ -0,0 +1,263 @@
+#include "depth_compositor.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <mpi.h>
+
+static void Exchange(DepthCompositor *compositor, CompositorRect region);
+static void Composite(DepthCompositor *compositor);
+static CompositorRect Intersect(const CompositorRect& a, const CompositorRect& b);
+
+bool DepthCompositorInit(DepthCompositor *compositor, int rank, int num_ranks, int num_columns, int num_rows,
+                         int tile_width, int tile_height, int window_width, int window_height, bool flipped,
+                         const float clear_color[4])
+{
+    compositor->rank = rank;
+    compositor->num_ranks = num_ranks;
+    compositor->width = num_columns * tile_width;
+    compositor->height = num_rows * tile_height;
+    compositor->window_width = window_width;
+    compositor->window_height = window_height;
+    for (int c = 0; c < 4; c++)
+    {
+        compositor->clear_color[c] = (uint8_t)(clear_color[c] * 255.0f + 0.5f);
+    }
+
+    // GL puts row 0 at the bottom, so the top row of tiles is the last band
+    // of the image, unless the projection is flipped
+    compositor->tiles.resize(num_ranks);
+    for (int r = 0; r < num_ranks; r++)
+    {
+        int column = r % num_columns;
+        int row = r / num_columns;
+        CompositorRect& tile = compositor->tiles[r];
+        tile.x = column * tile_width;
+        tile.y = (flipped ? row : num_rows - row - 1) * tile_height;
+        tile.width = tile_width;
+        tile.height = tile_height;
+    }
+
+    glGenTextures(1, &compositor->color_tex);
+    glBindTexture(GL_TEXTURE_2D, compositor->color_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, compositor->width, compositor->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glGenTextures(1, &compositor->depth_tex);
+    glBindTexture(GL_TEXTURE_2D, compositor->depth_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, compositor->width, compositor->height, 0,
+                 GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glGenTextures(1, &compositor->tile_tex);
+    glBindTexture(GL_TEXTURE_2D, compositor->tile_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tile_width, tile_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &compositor->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, compositor->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, compositor->color_tex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, compositor->depth_tex, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glGenFramebuffers(1, &compositor->tile_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, compositor->tile_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, compositor->tile_tex, 0);
+    complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete)
+    {
+        fprintf(stderr, "Error: cannot create a %dx%d compositing target\n", compositor->width, compositor->height);
+        DepthCompositorRelease(compositor);
+        return false;
+    }
+
+    compositor->send_rects.resize(num_ranks);
+    compositor->recv_rects.resize(num_ranks);
+    compositor->send_counts.resize(num_ranks);
+    compositor->send_offsets.resize(num_ranks);
+    compositor->recv_counts.resize(num_ranks);
+    compositor->recv_offsets.resize(num_ranks);
+    compositor->tile_color.resize((size_t)tile_width * tile_height * 4);
+    compositor->tile_depth.resize((size_t)tile_width * tile_height);
+    memset(&compositor->stats, 0, sizeof(compositor->stats));
+
+    return true;
+}
+
+void DepthCompositorRelease(DepthCompositor *compositor)
+{
+    glDeleteFramebuffers(1, &compositor->fbo);
+    glDeleteFramebuffers(1, &compositor->tile_fbo);
+    glDeleteTextures(1, &compositor->color_tex);
+    glDeleteTextures(1, &compositor->depth_tex);
+    glDeleteTextures(1, &compositor->tile_tex);
+}
+
+void DepthCompositorBegin(DepthCompositor *compositor)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, compositor->fbo);
+    glViewport(0, 0, compositor->width, compositor->height);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void DepthCompositorEnd(DepthCompositor *compositor, CompositorRect region)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // only the region can hold this rank's fragments
+    CompositorRect whole = {0, 0, compositor->width, compositor->height};
+    region = Intersect(region, whole);
+    size_t region_pixels = (size_t)region.width * region.height;
+    compositor->region_color.resize(region_pixels * 4);
+    compositor->region_depth.resize(region_pixels);
+    if (region_pixels > 0)
+    {
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(region.x, region.y, region.width, region.height, GL_RGBA, GL_UNSIGNED_BYTE,
+                     compositor->region_color.data());
+        glReadPixels(region.x, region.y, region.width, region.height, GL_DEPTH_COMPONENT, GL_FLOAT,
+                     compositor->region_depth.data());
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    Exchange(compositor, region);
+    Composite(compositor);
+
+    const CompositorRect& tile = compositor->tiles[compositor->rank];
+    glBindTexture(GL_TEXTURE_2D, compositor->tile_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tile.width, tile.height, GL_RGBA, GL_UNSIGNED_BYTE,
+                    compositor->tile_color.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, compositor->tile_fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, tile.width, tile.height, 0, 0, compositor->window_width, compositor->window_height,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, compositor->window_width, compositor->window_height);
+
+    compositor->stats.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+CompositorRect DepthCompositorProject(const DepthCompositor& compositor, const glm::mat4& mvp, const float min[3],
+                                      const float max[3])
+{
+    CompositorRect whole = {0, 0, compositor.width, compositor.height};
+    float x0 = 1.0f, y0 = 1.0f, x1 = -1.0f, y1 = -1.0f;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec4 point = mvp * glm::vec4((corner & 1) ? max[0] : min[0], (corner & 2) ? max[1] : min[1],
+                                          (corner & 4) ? max[2] : min[2], 1.0f);
+        if (point.w <= 1.0e-6f)
+        {
+            return whole;
+        }
+        x0 = std::min(x0, point.x / point.w);
+        y0 = std::min(y0, point.y / point.w);
+        x1 = std::max(x1, point.x / point.w);
+        y1 = std::max(y1, point.y / point.w);
+    }
+
+    // a pixel of slack for rasterization rounding
+    CompositorRect rect;
+    rect.x = (int)floorf((x0 * 0.5f + 0.5f) * compositor.width) - 1;
+    rect.y = (int)floorf((y0 * 0.5f + 0.5f) * compositor.height) - 1;
+    rect.width = (int)ceilf((x1 * 0.5f + 0.5f) * compositor.width) + 1 - rect.x;
+    rect.height = (int)ceilf((y1 * 0.5f + 0.5f) * compositor.height) + 1 - rect.y;
+    return Intersect(rect, whole);
+}
+
+
+// Auxillary functions
+void Exchange(DepthCompositor *compositor, CompositorRect region)
+{
+    // cut the region along the tile grid; every rank tells every other what
+    // part of its tile is coming, so the messages need no headers
+    int num_ranks = compositor->num_ranks;
+    size_t send_size = 0;
+    for (int r = 0; r < num_ranks; r++)
+    {
+        compositor->send_rects[r] = Intersect(region, compositor->tiles[r]);
+        compositor->send_counts[r] = compositor->send_rects[r].width * compositor->send_rects[r].height * 8;
+        compositor->send_offsets[r] = (int)send_size;
+        send_size += compositor->send_counts[r];
+    }
+    MPI_Alltoall(compositor->send_rects.data(), 4, MPI_INT, compositor->recv_rects.data(), 4, MPI_INT, MPI_COMM_WORLD);
+    size_t recv_size = 0;
+    for (int r = 0; r < num_ranks; r++)
+    {
+        compositor->recv_counts[r] = compositor->recv_rects[r].width * compositor->recv_rects[r].height * 8;
+        compositor->recv_offsets[r] = (int)recv_size;
+        recv_size += compositor->recv_counts[r];
+    }
+
+    // each piece is its rows of color followed by its rows of depth
+    compositor->send_buffer.resize(send_size);
+    compositor->recv_buffer.resize(recv_size);
+    for (int r = 0; r < num_ranks; r++)
+    {
+        const CompositorRect& rect = compositor->send_rects[r];
+        uint8_t *color = compositor->send_buffer.data() + compositor->send_offsets[r];
+        uint8_t *depth = color + (size_t)rect.width * rect.height * 4;
+        for (int y = 0; y < rect.height; y++)
+        {
+            size_t src = (size_t)(rect.y - region.y + y) * region.width + (rect.x - region.x);
+            memcpy(color + (size_t)y * rect.width * 4, &compositor->region_color[src * 4], (size_t)rect.width * 4);
+            memcpy(depth + (size_t)y * rect.width * 4, &compositor->region_depth[src], (size_t)rect.width * 4);
+        }
+    }
+    MPI_Alltoallv(compositor->send_buffer.data(), compositor->send_counts.data(), compositor->send_offsets.data(),
+                  MPI_BYTE, compositor->recv_buffer.data(), compositor->recv_counts.data(),
+                  compositor->recv_offsets.data(), MPI_BYTE, MPI_COMM_WORLD);
+
+    compositor->stats.bytes_sent = send_size - compositor->send_counts[compositor->rank];
+    compositor->stats.bytes_received = recv_size - compositor->recv_counts[compositor->rank];
+}
+
+void Composite(DepthCompositor *compositor)
+{
+    const CompositorRect& tile = compositor->tiles[compositor->rank];
+    size_t tile_pixels = (size_t)tile.width * tile.height;
+    uint32_t clear;
+    memcpy(&clear, compositor->clear_color, 4);
+    uint32_t *tile_color = (uint32_t*)compositor->tile_color.data();
+    float *tile_depth = compositor->tile_depth.data();
+    std::fill(tile_color, tile_color + tile_pixels, clear);
+    std::fill(tile_depth, tile_depth + tile_pixels, 1.0f);
+
+    // nearest fragment wins, so the order of the pieces doesn't matter
+    for (int r = 0; r < compositor->num_ranks; r++)
+    {
+        const CompositorRect& rect = compositor->recv_rects[r];
+        const uint8_t *piece = compositor->recv_buffer.data() + compositor->recv_offsets[r];
+        const uint32_t *color = (const uint32_t*)piece;
+        const float *depth = (const float*)(piece + (size_t)rect.width * rect.height * 4);
+        for (int y = 0; y < rect.height; y++)
+        {
+            size_t dst = (size_t)(rect.y - tile.y + y) * tile.width + (rect.x - tile.x);
+            for (int x = 0; x < rect.width; x++)
+            {
+                float d = depth[(size_t)y * rect.width + x];
+                if (d < tile_depth[dst + x])
+                {
+                    tile_depth[dst + x] = d;
+                    tile_color[dst + x] = color[(size_t)y * rect.width + x];
+                }
+            }
+        }
+    }
+}
+
+CompositorRect Intersect(const CompositorRect& a, const CompositorRect& b)
+{
+    CompositorRect rect;
+    rect.x = std::max(a.x, b.x);
+    rect.y = std::max(a.y, b.y);
+    rect.width = std::min(a.x + a.width, b.x + b.width) - rect.x;
+    rect.height = std::min(a.y + a.height, b.y + b.height) - rect.y;
+    if (rect.width <= 0 || rect.height <= 0)
+    {
+        rect.x = 0;
+        rect.y = 0;
+        rect.width = 0;
+        rect.height = 0;
+    }
+    return rect;
+}
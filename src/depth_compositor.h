@@ -0,0 +1,84 @@
+#ifndef DEPTH_COMPOSITOR_H
+#define DEPTH_COMPOSITOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+
+// Sort-last compositing of the tiled display.
+//
+// Each rank renders only the objects it owns, but over the whole display,
+// into an offscreen color and depth target. At the end of the frame the
+// part of that image covered by the rank's region (its owned objects'
+// bounds, projected to the screen) is read back, cut along the tile grid
+// and sent to the ranks that display those tiles (direct send), which keep
+// the nearest fragment of each pixel and draw the result to their window.
+// Regions are compact when objects are partitioned spatially (see
+// scene_partition.h), so most ranks exchange pixels with only a few others.
+
+typedef struct CompositorRect {
+    int x;
+    int y;
+    int width;
+    int height;
+} CompositorRect;
+
+typedef struct DepthCompositorStats {
+    uint64_t bytes_sent;        // last frame
+    uint64_t bytes_received;
+    double time;                // seconds in readback, exchange and compositing
+} DepthCompositorStats;
+
+typedef struct DepthCompositor {
+    int rank;
+    int num_ranks;
+    int width;                            // whole display
+    int height;
+    std::vector<CompositorRect> tiles;    // each rank's part of the display
+    int window_width;                     // this rank's framebuffer
+    int window_height;
+    uint8_t clear_color[4];
+
+    GLuint fbo;                           // whole display, this rank's objects
+    GLuint color_tex;
+    GLuint depth_tex;
+    GLuint tile_fbo;                      // composited tile, blitted to the window
+    GLuint tile_tex;
+
+    std::vector<uint8_t> region_color;    // readback of the region
+    std::vector<float> region_depth;
+    std::vector<CompositorRect> send_rects;
+    std::vector<CompositorRect> recv_rects;
+    std::vector<int> send_counts;
+    std::vector<int> send_offsets;
+    std::vector<int> recv_counts;
+    std::vector<int> recv_offsets;
+    std::vector<uint8_t> send_buffer;
+    std::vector<uint8_t> recv_buffer;
+    std::vector<uint8_t> tile_color;
+    std::vector<float> tile_depth;
+    DepthCompositorStats stats;
+} DepthCompositor;
+
+// the display is a num_columns x num_rows grid of tile_width x tile_height
+// tiles, rank r showing tile (r % num_columns, r / num_columns), row 0 at the
+// top; 'flipped' when the projection renders upside down (image capture)
+bool DepthCompositorInit(DepthCompositor *compositor, int rank, int num_ranks, int num_columns, int num_rows,
+                         int tile_width, int tile_height, int window_width, int window_height, bool flipped,
+                         const float clear_color[4]);
+void DepthCompositorRelease(DepthCompositor *compositor);
+
+// renders after this go to the whole-display target
+void DepthCompositorBegin(DepthCompositor *compositor);
+// 'region' is where this rank drew (see DepthCompositorProject); collective
+// over all ranks, leaves this rank's tile in the window's framebuffer
+void DepthCompositorEnd(DepthCompositor *compositor, CompositorRect region);
+
+// screen rectangle covering a box drawn with 'mvp' (the whole display if
+// the box reaches behind the eye)
+CompositorRect DepthCompositorProject(const DepthCompositor& compositor, const glm::mat4& mvp, const float min[3],
+                                      const float max[3]);
+
+#endif // DEPTH_COMPOSITOR_H
@@ -0,0 +1,146 @@
+#include "half_float.h"
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64)
+#define HALF_FLOAT_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(HALF_FLOAT_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define HALF_FLOAT_F16C
+#include <immintrin.h>
+#endif
+
+static uint16_t FloatToHalf1(float value);
+#ifdef HALF_FLOAT_SSE2
+static size_t FloatToHalfSse2(const float *src, uint16_t *dst, size_t count);
+#endif
+#ifdef HALF_FLOAT_F16C
+static bool F16cAvailable();
+static size_t FloatToHalfF16c(const float *src, uint16_t *dst, size_t count);
+#endif
+
+void FloatToHalf(const float *src, uint16_t *dst, size_t count)
+{
+    // vector kernels do whole blocks; the tail goes one value at a time
+    size_t done = 0;
+#ifdef HALF_FLOAT_F16C
+    static const bool has_f16c = F16cAvailable();
+    if (has_f16c)
+    {
+        done = FloatToHalfF16c(src, dst, count);
+    }
+#endif
+#ifdef HALF_FLOAT_SSE2
+    done += FloatToHalfSse2(src + done, dst + done, count - done);
+#endif
+    for (size_t i = done; i < count; i++)
+    {
+        dst[i] = FloatToHalf1(src[i]);
+    }
+}
+
+
+// Auxillary functions
+uint16_t FloatToHalf1(float value)
+{
+    // same steps as the SSE2 kernel below, one lane at a time
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint32_t half;
+    if (bits >= (127 + 16) << 23)
+    {
+        // overflows to infinity, or is infinity / NaN
+        half = bits > 0x7f800000u ? 0x7e00 : 0x7c00;
+    }
+    else if (bits < (127 - 14) << 23)
+    {
+        // subnormal (or zero): let a float add do the rounding shift
+        const uint32_t magic_bits = ((127 - 15) + (23 - 10) + 1) << 23;
+        float magic;
+        memcpy(&magic, &magic_bits, 4);
+        float sum;
+        memcpy(&sum, &bits, 4);
+        sum += magic;
+        uint32_t sum_bits;
+        memcpy(&sum_bits, &sum, 4);
+        half = sum_bits - magic_bits;
+    }
+    else
+    {
+        // rebias the exponent and round the mantissa to nearest even
+        uint32_t mant_odd = (bits >> 13) & 1;
+        bits += ((uint32_t)(15 - 127) << 23) + 0xfff;
+        bits += mant_odd;
+        half = bits >> 13;
+    }
+
+    return (uint16_t)(half | (sign >> 16));
+}
+
+#ifdef HALF_FLOAT_SSE2
+size_t FloatToHalfSse2(const float *src, uint16_t *dst, size_t count)
+{
+    const __m128i sign_mask = _mm_set1_epi32((int)0x80000000u);
+    const __m128i f16_max = _mm_set1_epi32((127 + 16) << 23);
+    const __m128i min_normal = _mm_set1_epi32((127 - 14) << 23);
+    const __m128i subnormal_magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+    const __m128i normal_bias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+    const __m128i nan_bit = _mm_set1_epi32(0x200);
+    const __m128i infinity = _mm_set1_epi32(0x7c00);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i out[2];
+        for (int j = 0; j < 2; j++)
+        {
+            __m128 f = _mm_loadu_ps(src + i + 4 * j);
+            __m128 sign = _mm_and_ps(f, _mm_castsi128_ps(sign_mask));
+            __m128 abs_f = _mm_xor_ps(f, sign);
+            __m128i abs_bits = _mm_castps_si128(abs_f);
+
+            __m128i is_nan = _mm_castps_si128(_mm_cmpunord_ps(abs_f, abs_f));
+            __m128i is_regular = _mm_cmpgt_epi32(f16_max, abs_bits);
+            __m128i is_subnormal = _mm_cmpgt_epi32(min_normal, abs_bits);
+            __m128i special = _mm_or_si128(_mm_and_si128(is_nan, nan_bit), infinity);
+
+            __m128 subnormal_sum = _mm_add_ps(abs_f, _mm_castsi128_ps(subnormal_magic));
+            __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(subnormal_sum), subnormal_magic);
+
+            __m128i mant_odd = _mm_srai_epi32(_mm_slli_epi32(abs_bits, 31 - 13), 31);
+            __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(abs_bits, normal_bias), mant_odd), 13);
+
+            __m128i finite = _mm_or_si128(_mm_and_si128(is_subnormal, subnormal), _mm_andnot_si128(is_subnormal, normal));
+            __m128i half = _mm_or_si128(_mm_and_si128(is_regular, finite), _mm_andnot_si128(is_regular, special));
+            // arithmetic shift: negative halves stay in int16 range for the pack
+            out[j] = _mm_or_si128(half, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+        }
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(out[0], out[1]));
+    }
+
+    return i;
+}
+#endif
+
+#ifdef HALF_FLOAT_F16C
+bool F16cAvailable()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("f16c") && __builtin_cpu_supports("avx");
+}
+
+__attribute__((target("avx,f16c")))
+size_t FloatToHalfF16c(const float *src, uint16_t *dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 f = _mm256_loadu_ps(src + i);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT));
+    }
+
+    return i;
+}
+#endif
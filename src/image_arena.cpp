@@ -0,0 +1,206 @@
+#include "image_arena.h"
+#include <cstdlib>
+#include <cstring>
+
+struct ImageArenaChunk {
+    ImageArenaChunk *next;
+    size_t capacity;
+    size_t used;
+};
+
+// every allocation is preceded by a 16-byte header, which keeps the
+// returned pointers 16-byte aligned for the SIMD decode paths
+typedef struct AllocHeader {
+    size_t size;
+    ImageArena *arena; // NULL: plain heap allocation (no arena was bound)
+} AllocHeader;
+
+static const size_t kAlign = 16;
+static const size_t kHeaderSize = 16;
+static const size_t kChunkHeaderSize = (sizeof(ImageArenaChunk) + kAlign - 1) & ~(kAlign - 1);
+
+static thread_local ImageArena *g_bound_arena = NULL;
+
+static size_t AlignSize(size_t size);
+static uint8_t *ChunkData(ImageArenaChunk *chunk);
+static ImageArenaChunk *AddChunk(ImageArena *arena, size_t capacity);
+static void *ArenaAlloc(ImageArena *arena, size_t size);
+static bool IsTopAllocation(ImageArenaChunk *chunk, AllocHeader *header);
+
+void ImageArenaInit(ImageArena *arena, size_t chunk_size)
+{
+    memset(arena, 0, sizeof(ImageArena));
+    arena->chunk_size = AlignSize(chunk_size);
+}
+
+void ImageArenaBind(ImageArena *arena)
+{
+    g_bound_arena = arena;
+}
+
+void ImageArenaReset(ImageArena *arena)
+{
+    // a load that spilled into several chunks gets one chunk big enough for
+    // all of it next time, so steady-state loads are a single bump region
+    if (arena->chunks != NULL && arena->chunks->next != NULL)
+    {
+        size_t capacity = arena->stats.peak_bytes > arena->chunk_size ? arena->stats.peak_bytes : arena->chunk_size;
+        ImageArenaRelease(arena);
+        AddChunk(arena, AlignSize(capacity));
+    }
+    else if (arena->chunks != NULL)
+    {
+        arena->chunks->used = 0;
+    }
+    arena->stats.used_bytes = 0;
+}
+
+void ImageArenaRelease(ImageArena *arena)
+{
+    ImageArenaChunk *chunk = arena->chunks;
+    while (chunk != NULL)
+    {
+        ImageArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+    arena->stats.used_bytes = 0;
+    arena->stats.reserved_bytes = 0;
+    arena->stats.num_chunks = 0;
+}
+
+void *ImageArenaMalloc(size_t size)
+{
+    if (g_bound_arena == NULL)
+    {
+        AllocHeader *header = (AllocHeader*)malloc(kHeaderSize + size);
+        if (header == NULL) return NULL;
+        header->size = size;
+        header->arena = NULL;
+        return (uint8_t*)header + kHeaderSize;
+    }
+
+    g_bound_arena->stats.num_allocs++;
+    return ArenaAlloc(g_bound_arena, size);
+}
+
+void *ImageArenaRealloc(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+    {
+        return ImageArenaMalloc(size);
+    }
+
+    AllocHeader *header = (AllocHeader*)((uint8_t*)ptr - kHeaderSize);
+    ImageArena *arena = header->arena;
+    if (arena == NULL)
+    {
+        header = (AllocHeader*)realloc(header, kHeaderSize + size);
+        if (header == NULL) return NULL;
+        header->size = size;
+        return (uint8_t*)header + kHeaderSize;
+    }
+
+    arena->stats.num_reallocs++;
+
+    // the common case (zlib output / PNG IDAT growth) reallocates the most
+    // recent allocation, which can simply be extended
+    ImageArenaChunk *chunk = arena->chunks;
+    size_t old_extent = AlignSize(kHeaderSize + header->size);
+    size_t new_extent = AlignSize(kHeaderSize + size);
+    if (IsTopAllocation(chunk, header) && chunk->used - old_extent + new_extent <= chunk->capacity)
+    {
+        chunk->used = chunk->used - old_extent + new_extent;
+        arena->stats.used_bytes = arena->stats.used_bytes - old_extent + new_extent;
+        if (arena->stats.used_bytes > arena->stats.peak_bytes) arena->stats.peak_bytes = arena->stats.used_bytes;
+        arena->stats.num_grow_in_place++;
+        header->size = size;
+        return ptr;
+    }
+
+    void *moved = ArenaAlloc(arena, size);
+    if (moved == NULL) return NULL;
+    memcpy(moved, ptr, header->size < size ? header->size : size);
+    return moved;
+}
+
+void ImageArenaFree(void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    AllocHeader *header = (AllocHeader*)((uint8_t*)ptr - kHeaderSize);
+    ImageArena *arena = header->arena;
+    if (arena == NULL)
+    {
+        free(header);
+        return;
+    }
+
+    // only the most recent allocation can be given back; everything else
+    // waits for ImageArenaReset()
+    arena->stats.num_frees++;
+    ImageArenaChunk *chunk = arena->chunks;
+    if (IsTopAllocation(chunk, header))
+    {
+        size_t extent = AlignSize(kHeaderSize + header->size);
+        chunk->used -= extent;
+        arena->stats.used_bytes -= extent;
+    }
+}
+
+
+// Auxillary functions
+size_t AlignSize(size_t size)
+{
+    return (size + kAlign - 1) & ~(kAlign - 1);
+}
+
+uint8_t *ChunkData(ImageArenaChunk *chunk)
+{
+    return (uint8_t*)chunk + kChunkHeaderSize;
+}
+
+ImageArenaChunk *AddChunk(ImageArena *arena, size_t capacity)
+{
+    ImageArenaChunk *chunk = (ImageArenaChunk*)malloc(kChunkHeaderSize + capacity);
+    if (chunk == NULL) return NULL;
+    chunk->next = arena->chunks;
+    chunk->capacity = capacity;
+    chunk->used = 0;
+    arena->chunks = chunk;
+    arena->stats.reserved_bytes += capacity;
+    arena->stats.num_chunks++;
+    return chunk;
+}
+
+void *ArenaAlloc(ImageArena *arena, size_t size)
+{
+    size_t extent = AlignSize(kHeaderSize + size);
+    ImageArenaChunk *chunk = arena->chunks;
+    if (chunk == NULL || chunk->used + extent > chunk->capacity)
+    {
+        chunk = AddChunk(arena, extent > arena->chunk_size ? extent : arena->chunk_size);
+        if (chunk == NULL) return NULL;
+    }
+
+    AllocHeader *header = (AllocHeader*)(ChunkData(chunk) + chunk->used);
+    header->size = size;
+    header->arena = arena;
+    chunk->used += extent;
+
+    arena->stats.used_bytes += extent;
+    if (arena->stats.used_bytes > arena->stats.peak_bytes) arena->stats.peak_bytes = arena->stats.used_bytes;
+
+    return (uint8_t*)header + kHeaderSize;
+}
+
+bool IsTopAllocation(ImageArenaChunk *chunk, AllocHeader *header)
+{
+    if (chunk == NULL) return false;
+    uint8_t *start = (uint8_t*)header;
+    return start >= ChunkData(chunk) && start + AlignSize(kHeaderSize + header->size) == ChunkData(chunk) + chunk->used;
+}
@@ -0,0 +1,47 @@
+#ifndef IMAGE_ARENA_H
+#define IMAGE_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Bump allocator backing stb_image's STBI_MALLOC / STBI_REALLOC / STBI_FREE.
+//
+// An arena is bound to the calling thread with ImageArenaBind(); while bound,
+// every stb_image allocation on that thread is carved out of the arena and
+// frees are (almost) no-ops. ImageArenaReset() then drops everything at once
+// and keeps the memory for the next load. With no arena bound the hooks fall
+// back to malloc/free, so unbound threads behave exactly like stock stb_image.
+//
+// Anything returned by stbi_load() while an arena is bound lives in the arena:
+// copy it out (or decode with stbi_load_into) before resetting.
+
+typedef struct ImageArenaChunk ImageArenaChunk;
+
+typedef struct ImageArenaStats {
+    uint64_t num_allocs;     // malloc calls served
+    uint64_t num_reallocs;   // realloc calls served (in place or by copy)
+    uint64_t num_grow_in_place;
+    uint64_t num_frees;
+    size_t used_bytes;       // current bump position across all chunks
+    size_t peak_bytes;       // high-water mark of used_bytes
+    size_t reserved_bytes;   // memory obtained from the system
+    uint32_t num_chunks;
+} ImageArenaStats;
+
+typedef struct ImageArena {
+    ImageArenaChunk *chunks;  // most recent first
+    size_t chunk_size;
+    ImageArenaStats stats;
+} ImageArena;
+
+void ImageArenaInit(ImageArena *arena, size_t chunk_size);
+void ImageArenaBind(ImageArena *arena);
+void ImageArenaReset(ImageArena *arena);
+void ImageArenaRelease(ImageArena *arena);
+
+// stb_image hooks
+void *ImageArenaMalloc(size_t size);
+void *ImageArenaRealloc(void *ptr, size_t size);
+void ImageArenaFree(void *ptr);
+
+#endif // IMAGE_ARENA_H
@@ -0,0 +1,61 @@
+#include "indirect_draw.h"
+
+void IndirectDrawInit(IndirectDraw *draw)
+{
+    glGenBuffers(1, &draw->command_buffer);
+    draw->buffer_capacity = 0;
+    draw->num_uploaded = 0;
+    draw->commands.clear();
+}
+
+void IndirectDrawRelease(IndirectDraw *draw)
+{
+    glDeleteBuffers(1, &draw->command_buffer);
+    draw->commands.clear();
+    draw->buffer_capacity = 0;
+    draw->num_uploaded = 0;
+}
+
+void IndirectDrawBegin(IndirectDraw *draw)
+{
+    draw->commands.clear();
+}
+
+void IndirectDrawAdd(IndirectDraw *draw, uint32_t count, uint32_t first_index, int32_t base_vertex,
+                     uint32_t base_instance)
+{
+    DrawElementsIndirectCommand command = {count, 1, first_index, base_vertex, base_instance};
+    draw->commands.push_back(command);
+}
+
+void IndirectDrawUpload(IndirectDraw *draw)
+{
+    // storage grows to the largest list seen and is orphaned every frame, so
+    // the draws still reading last frame's commands don't stall the update
+    size_t num_commands = draw->commands.size();
+    if (num_commands > draw->buffer_capacity)
+    {
+        draw->buffer_capacity = num_commands + num_commands / 2;
+    }
+    GLsizeiptr capacity = (GLsizeiptr)(draw->buffer_capacity * sizeof(DrawElementsIndirectCommand));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw->command_buffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+    if (num_commands > 0)
+    {
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, (GLsizeiptr)(num_commands * sizeof(DrawElementsIndirectCommand)),
+                        draw->commands.data());
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    draw->num_uploaded = (int)num_commands;
+}
+
+void IndirectDrawSubmit(const IndirectDraw& draw, GLenum mode, GLenum index_type)
+{
+    if (draw.num_uploaded == 0)
+    {
+        return;
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw.command_buffer);
+    glMultiDrawElementsIndirect(mode, index_type, NULL, draw.num_uploaded, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
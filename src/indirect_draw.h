@@ -0,0 +1,46 @@
+#ifndef INDIRECT_DRAW_H
+#define INDIRECT_DRAW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+
+// Batches of indexed draws submitted with glMultiDrawElementsIndirect.
+//
+// Each visible object becomes one DrawElementsIndirectCommand (an index
+// range of a shared vertex/index buffer plus its slot in the instance
+// buffer, as base_instance), collected on the CPU and streamed into a
+// GL_DRAW_INDIRECT_BUFFER once per frame. A whole rank's scene is then
+// drawn with a single call, however many objects there are, and the
+// driver sees one draw's worth of validation instead of one per object.
+// Needs GL 4.3 (base_instance with instanced attributes is 4.2).
+
+typedef struct DrawElementsIndirectCommand {
+    uint32_t count;             // indices
+    uint32_t instance_count;
+    uint32_t first_index;
+    int32_t base_vertex;
+    uint32_t base_instance;     // offsets the instanced attributes
+} DrawElementsIndirectCommand;
+
+typedef struct IndirectDraw {
+    std::vector<DrawElementsIndirectCommand> commands;
+    GLuint command_buffer;
+    size_t buffer_capacity;     // commands the buffer's storage holds
+    int num_uploaded;
+} IndirectDraw;
+
+void IndirectDrawInit(IndirectDraw *draw);
+void IndirectDrawRelease(IndirectDraw *draw);
+
+// starts a new list of commands
+void IndirectDrawBegin(IndirectDraw *draw);
+void IndirectDrawAdd(IndirectDraw *draw, uint32_t count, uint32_t first_index, int32_t base_vertex,
+                     uint32_t base_instance);
+// streams the list to the command buffer
+void IndirectDrawUpload(IndirectDraw *draw);
+// draws the uploaded list with the bound vertex array
+void IndirectDrawSubmit(const IndirectDraw& draw, GLenum mode, GLenum index_type);
+
+#endif // INDIRECT_DRAW_H
@@ -1,6 +1,11 @@
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstring>
+#include <functional>
 #include <string>
+#include <vector>
 #include <glad/glad.h>
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
@@ -8,10 +13,41 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <mpi.h>
+#include "image_arena.h"
+#include "texture_loader.h"
+#include "virtual_texture.h"
+#include "animated_texture.h"
+#include "mesh.h"
+#include "mesh_buffers.h"
+#include "mesh_loader.h"
+#include "mesh_file.h"
+#include "mesh_lod.h"
+#include "cube_scene.h"
+#include "scene_partition.h"
+#include "scene_bvh.h"
+#include "scene_occlusion.h"
+#include "indirect_draw.h"
+#include "stream_ring.h"
+#include "program_cache.h"
+#include "depth_compositor.h"
+#define STBI_MALLOC(sz) ImageArenaMalloc(sz)
+#define STBI_REALLOC(p, newsz) ImageArenaRealloc(p, newsz)
+#define STBI_FREE(p) ImageArenaFree(p)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 enum RenderMode : uint8_t { LocalDisplay, ImageCapture };
+enum TextureSwapState : uint8_t { SwapIdle, SwapDecoding, SwapUploading, SwapReady };
+enum DrawMode : uint8_t { DrawInstanced, DrawPerObject, DrawIndirect };
+
+#define FRAME_TRANSFORMS_BINDING 0
+
+// texture_phong.vert's FrameTransforms uniform block, in std140 layout
+typedef struct FrameTransforms {
+    float projection[16];
+    float modelview[16];
+    float normal[12];       // mat3 columns, each padded to a vec4
+} FrameTransforms;
 
 typedef struct LocalViewport {
     int column;
@@ -24,24 +60,74 @@ typedef struct LocalViewport {
 
 typedef struct GShaderProgram {
     GLuint program;
-    GLint proj_uniform;
-    GLint mv_uniform;
-    GLint norm_uniform;
     GLint ambientcol_uniform;
     GLint lightdir_uniform;
     GLint lightcol_uniform;
     GLint img_uniform;
+    GLint virtual_uniform;
+    GLint atlas_uniform;
+    GLint page_table_uniform;
+    GLint vt_size_uniform;
+    GLint vt_page_size_uniform;
+    GLint vt_border_uniform;
+    GLint vt_num_levels_uniform;
+    GLint vt_level_row_uniform;
+    GLint vt_level_pages_uniform;
+    GLint vt_lod_bias_uniform;
 } GShaderProgram;
 
+typedef struct TextureSwap {
+    TextureSwapState state;
+    GLuint pbo;
+    GLuint back_tex_id;   // 0 if this rank couldn't load the image
+    GLsync upload_fence;
+    TextureJob job;
+} TextureSwap;
+
 typedef struct AppData {
     int rank;
     int num_ranks;
     RenderMode render_mode;
+    bool stream_texture;
+    std::vector<std::string> texture_files;
+    int texture_index;
+    bool texture_change_requested;
+    int texture_max_extent;
     GLuint vao;
+    std::string mesh_file;   // empty: the built-in cube
+    MeshBuffers mesh;
+    std::vector<MeshLod> mesh_lods;    // index ranges of mesh, finest first
+    float lod_max_pixels;              // 0: always the full mesh
+    float lod_pixel_scale;             // pixels one unit covers at distance 1 on this rank's render target
+    std::vector<int> lod_first;        // draw list position of each level's cubes, and one past the last
+    std::vector<int> lod_levels;       // scratch for grouping the draw list
+    std::vector<int> lod_sorted;
+    int64_t num_triangles;             // drawn per pass this frame
     GLuint tex_id;
     GLuint vertex_position_attrib;
     GLuint vertex_normal_attrib;
     GLuint vertex_texcoord_attrib;
+    GLuint instance_position_attrib;
+    GLuint instance_rotation_attrib;
+    std::string program_cache_dir;   // empty: always compile shaders from source
+    int num_cubes;        // 0: the single textured cube
+    CubeScene cube_scene;
+    StreamRing stream_ring;   // this frame's transforms and cube instances
+    DrawMode draw_mode;   // how the cubes are submitted
+    IndirectDraw indirect;
+    double submit_time;   // CPU time issuing this frame's cube draws
+    double scene_time;
+    bool sort_last;       // each rank draws the cubes it owns over the whole display
+    ScenePartition partition;
+    std::vector<SceneBounds> cube_bounds;
+    SceneBvh bvh;
+    std::vector<int> visible_cubes;
+    double cull_time;
+    bool occlusion_culling;            // also drop cubes hidden behind the largest ones
+    SceneOcclusion occlusion;
+    std::vector<std::pair<float, int> > occluders;   // (size on screen, cube)
+    double occlusion_time;
+    DepthCompositor compositor;
     glm::mat4 mat_projection;
     glm::mat4 mat_modelview;
     double render_time;
@@ -49,14 +135,39 @@ typedef struct AppData {
     double rotate_y;
     int frame_count;
     uint8_t *framebuffer;
+    ImageArena image_arena;
+    TextureLoader tex_loader;
+    TextureSwap tex_swap;
+    bool animating;
+    AnimatedTexture animation;
+    bool use_virtual_texture;
+    VirtualTexture virtual_texture;
+    GShaderProgram feedback_shader;
 } AppData;
 
 static void Init(GLFWwindow *window, GShaderProgram *shader, AppData *app, LocalViewport& viewport);
 static void Idle(GLFWwindow *window, GShaderProgram& shader, AppData& app, LocalViewport& viewport);
 static void Render(GLFWwindow *window, GShaderProgram& shader, AppData& app, LocalViewport& viewport);
-static void SetMatrixUniforms(GShaderProgram& shader, AppData& app);
-static GLuint CreateCubeVao(AppData& app);
-static GShaderProgram CreateTextureShader(AppData& app);
+static void WriteFrameTransforms(AppData& app);
+static void DrawCubes(AppData& app);
+static void UpdateCubeVisibility(AppData& app);
+static void UpdateCubeOcclusion(AppData& app, const glm::mat4& mat_view_projection);
+static void UpdateCubeLods(AppData& app);
+static const void *LodIndexOffset(const AppData& app, const MeshLod& lod);
+static GLuint CreateMeshVao(AppData& app);
+static void CreateCubeMesh(MeshData *mesh);
+static GLuint CreateTextureObject();
+static void CreateTextures(AppData& app, const char **filenames, int count, GLuint *tex_ids);
+static void TexImageFromJob(const TextureJob& job, const void *pixels);
+static bool QueryTextureSize(AppData& app, const char *filename, int *width, int *height, int *scale_denom);
+static GLuint StreamTexture(AppData& app, const char *filename);
+static void BeginTextureSwap(AppData& app, const char *filename);
+static void UpdateTextureSwap(AppData& app);
+static void SyncTextureSwap(AppData& app);
+static void KeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods);
+static int LoaderThreadCount();
+static void SetVirtualTextureUniforms(GShaderProgram& shader, AppData& app);
+static GShaderProgram CreateTextureShader(AppData& app, const char *fragment_file);
 static GLint CompileShader(char *source, uint32_t length, GLint type);
 static void CreateShaderProgram(GLint vertex_shader, GLint fragment_shader, GLuint *program);
 static void LinkShaderProgram(GLuint program);
@@ -81,11 +192,69 @@ int main(int argc, char **argv)
     app.rank = rank;
     app.num_ranks = num_ranks;
     app.render_mode = RenderMode::LocalDisplay;
+    app.stream_texture = true;
+    app.num_cubes = 0;
+    app.draw_mode = DrawMode::DrawInstanced;
+    app.sort_last = false;
+    app.lod_max_pixels = 1.0f;
+    app.occlusion_culling = false;
+    const char *tmpdir = getenv("TMPDIR");
+    app.program_cache_dir = std::string(tmpdir != NULL && tmpdir[0] != '\0' ? tmpdir : "/tmp") + "/texturecube-programs";
     int width = 1280;
     int height = 720;
-    if (argc >= 2 && std::string(argv[1]) == "imagecapture") app.render_mode = RenderMode::ImageCapture;
-    if (argc >= 3) width = atoi(argv[2]);
-    if (argc >= 4) height = atoi(argv[3]);
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "-cubes" && i + 1 < argc)
+        {
+            app.num_cubes = atoi(argv[++i]);
+        }
+        else if (std::string(argv[i]) == "-draw" && i + 1 < argc)
+        {
+            std::string mode = argv[++i];
+            app.draw_mode = mode == "perobject" ? DrawMode::DrawPerObject :
+                            (mode == "indirect" ? DrawMode::DrawIndirect : DrawMode::DrawInstanced);
+        }
+        else if (std::string(argv[i]) == "-mesh" && i + 1 < argc)
+        {
+            app.mesh_file = argv[++i];
+        }
+        else if (std::string(argv[i]) == "-lod" && i + 1 < argc)
+        {
+            app.lod_max_pixels = (float)atof(argv[++i]);
+        }
+        else if (std::string(argv[i]) == "-occlusion")
+        {
+            app.occlusion_culling = true;
+        }
+        else if (std::string(argv[i]) == "-programcache" && i + 1 < argc)
+        {
+            std::string dir = argv[++i];
+            app.program_cache_dir = dir == "none" ? "" : dir;
+        }
+        else if (std::string(argv[i]) == "-sortlast")
+        {
+            app.sort_last = true;
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+    }
+    if (args.size() >= 1 && args[0] == "imagecapture") app.render_mode = RenderMode::ImageCapture;
+    if (args.size() >= 2) width = atoi(args[1].c_str());
+    if (args.size() >= 3) height = atoi(args[2].c_str());
+    if (args.size() >= 4 && args[3] == "sync") app.stream_texture = false;
+    for (size_t i = 4; i < args.size(); i++)
+    {
+        app.texture_files.push_back(args[i]);
+    }
+    if (app.texture_files.empty())
+    {
+        app.texture_files.push_back("resrc/images/crate.jpg");
+    }
+    const std::string& first_file = app.texture_files[0];
+    app.use_virtual_texture = first_file.size() > 5 && first_file.compare(first_file.size() - 5, 5, ".vtex") == 0;
 
     // initialize GLFW
     if (!glfwInit())
@@ -107,11 +276,37 @@ int main(int argc, char **argv)
     // create a window and its OpenGL context
     char title[32];
     snprintf(title, 32, "Texture Cube: %d", rank);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+    // base instances and indirect draws need GL 4.3; everything else 3.3
+    bool needs_gl43 = app.num_cubes > 0 && app.draw_mode != DrawMode::DrawInstanced;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, needs_gl43 ? 4 : 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     GLFWwindow *window = glfwCreateWindow(m_viewport.width, m_viewport.height, title, NULL, NULL);
+    bool has_gl43 = needs_gl43;
+    if (window == NULL && needs_gl43)
+    {
+        fprintf(stderr, "Error: rank %d has no OpenGL 4.3 context for -draw, drawing instanced\n", rank);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        window = glfwCreateWindow(m_viewport.width, m_viewport.height, title, NULL, NULL);
+        has_gl43 = false;
+    }
+    if (needs_gl43)
+    {
+        // one draw mode on every rank, so rank 0's draw submit times stand
+        // for all of them
+        int local_gl43 = has_gl43 ? 1 : 0;
+        int all_gl43 = 0;
+        MPI_Allreduce(&local_gl43, &all_gl43, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+        if (!all_gl43)
+        {
+            if (rank == 0)
+            {
+                fprintf(stderr, "Error: not every rank has OpenGL 4.3 for -draw, all ranks drawing instanced\n");
+            }
+            app.draw_mode = DrawMode::DrawInstanced;
+        }
+    }
 
     // make window's context current
     glfwMakeContextCurrent(window);
@@ -136,6 +331,30 @@ int main(int argc, char **argv)
     }
 
     // clean up
+    if (app.num_cubes > 0)
+    {
+        CubeSceneRelease(&app.cube_scene);
+    }
+    StreamRingRelease(&app.stream_ring);
+    if (app.num_cubes > 0 && app.draw_mode == DrawMode::DrawIndirect)
+    {
+        IndirectDrawRelease(&app.indirect);
+    }
+    if (app.sort_last)
+    {
+        DepthCompositorRelease(&app.compositor);
+    }
+    if (app.use_virtual_texture)
+    {
+        VirtualTextureRelease(&app.virtual_texture);
+    }
+    if (app.animating)
+    {
+        AnimatedTextureClose(&app.animation);
+    }
+    ReleaseMeshBuffers(&app.mesh);
+    TextureLoaderShutdown(&app.tex_loader);
+    ImageArenaRelease(&app.image_arena);
     glfwDestroyWindow(window);
     glfwTerminate();
 
@@ -154,22 +373,117 @@ void Init(GLFWwindow *window, GShaderProgram *shader, AppData *app, LocalViewpor
     app->vertex_position_attrib = 0;
     app->vertex_normal_attrib = 1;
     app->vertex_texcoord_attrib = 2;
+    app->instance_position_attrib = 3;
+    app->instance_rotation_attrib = 4;
     app->frame_count = 0;
 
-    *shader = CreateTextureShader(*app);
-    app->vao = CreateCubeVao(*app);
+    *shader = CreateTextureShader(*app, "resrc/shaders/texture_phong.frag");
+    app->vao = CreateMeshVao(*app);
+    app->scene_time = 0.0;
+    // room for a frame's uniform block and every cube, with slack for alignment
+    size_t num_instances = app->num_cubes > 0 ? (size_t)app->num_cubes : 0;
+    StreamRingInit(&app->stream_ring, sizeof(FrameTransforms) + num_instances * sizeof(CubeInstance) + 4096);
+    if (app->num_cubes > 0)
+    {
+        // same seed on every rank, so they all build the same scene
+        CubeSceneInit(&app->cube_scene, app->num_cubes, 1);
+        CubeSceneAttach(app->vao, app->instance_position_attrib, app->instance_rotation_attrib);
+        SceneBvhInit(&app->bvh, 1.5);
+        app->cull_time = 0.0;
+        if (app->draw_mode == DrawMode::DrawIndirect)
+        {
+            IndirectDrawInit(&app->indirect);
+        }
+    }
+    else
+    {
+        // no instance arrays: one cube, unscaled and unrotated
+        glVertexAttrib4f(app->instance_position_attrib, 0.0, 0.0, 0.0, 1.0);
+        glVertexAttrib4f(app->instance_rotation_attrib, 0.0, 0.0, 0.0, 1.0);
+    }
 
-    glGenTextures(1, &(app->tex_id));
-    glBindTexture(GL_TEXTURE_2D, app->tex_id);
-    int img_w, img_h, img_c;
-    stbi_set_flip_vertically_on_load(true);
-    uint8_t *pixels = stbi_load("resrc/images/crate.jpg", &img_w, &img_h, &img_c, STBI_rgb_alpha);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, img_w, img_h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // 'T' on any rank's window cycles to the next texture on all of them
+    glfwSetWindowUserPointer(window, app);
+    glfwSetKeyCallback(window, KeyCallback);
+
+    // stb_image scratch memory comes from an arena that is reused across loads
+    ImageArenaInit(&app->image_arena, 4 * 1024 * 1024);
+    TextureLoaderInit(&app->tex_loader, LoaderThreadCount());
+    app->tex_swap.state = SwapIdle;
+    app->texture_index = 0;
+    app->texture_change_requested = false;
+    // a cube face is never larger on screen than the whole tiled display, so
+    // textures don't need more resolution than that
+    app->texture_max_extent = viewport.num_columns * viewport.width;
+    if (viewport.num_rows * viewport.height > app->texture_max_extent)
+    {
+        app->texture_max_extent = viewport.num_rows * viewport.height;
+    }
+    const char *texture_file = app->texture_files[0].c_str();
+    if (app->sort_last && (app->num_cubes <= 0 || app->use_virtual_texture))
+    {
+        // virtual texture feedback is per tile, which sort-last rendering doesn't have
+        if (app->rank == 0)
+        {
+            fprintf(stderr, "Error: -sortlast needs -cubes and doesn't work with virtual textures\n");
+        }
+        app->sort_last = false;
+    }
+    if (app->sort_last)
+    {
+        float clear_color[4] = {0.9, 0.9, 0.9, 1.0};
+        ScenePartitionInit(&app->partition, app->num_ranks, 0.1);
+        int compositor_ok = DepthCompositorInit(&app->compositor, app->rank, app->num_ranks, viewport.num_columns,
+                                                viewport.num_rows, viewport.width, viewport.height, w, h,
+                                                app->render_mode == RenderMode::ImageCapture, clear_color) ? 1 : 0;
+        // compositing is collective, so if any rank couldn't set it up they
+        // all render tiles instead
+        int all_ok = 0;
+        MPI_Allreduce(&compositor_ok, &all_ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+        if (!all_ok)
+        {
+            if (compositor_ok)
+            {
+                DepthCompositorRelease(&app->compositor);
+            }
+            if (app->rank == 0)
+            {
+                fprintf(stderr, "Error: a rank couldn't set up sort-last compositing, rendering tiles instead\n");
+            }
+            app->sort_last = false;
+        }
+    }
+    if (app->use_virtual_texture)
+    {
+        // pages stream in as this rank's feedback asks for them; until then
+        // the pinned last mip level stands in
+        app->tex_id = 0;
+        app->feedback_shader = CreateTextureShader(*app, "resrc/shaders/vt_feedback.frag");
+        if (!VirtualTextureInit(&app->virtual_texture, texture_file, 256, w, h, 8))
+        {
+            app->use_virtual_texture = false;
+        }
+    }
+    else if (app->stream_texture)
+    {
+        app->tex_id = StreamTexture(*app, texture_file);
+    }
+    else
+    {
+        CreateTextures(*app, &texture_file, 1, &app->tex_id);
+    }
+    // an animated GIF's first frame (decoded above) stands in until every
+    // rank has its first streamed frame
+    app->animating = !app->use_virtual_texture && IsAnimatedTextureFile(texture_file) &&
+                     AnimatedTextureOpen(&app->animation, texture_file);
+    if (app->rank == 0)
+    {
+        ImageArenaStats& stats = app->image_arena.stats;
+        printf("image arena: %llu allocs, %llu reallocs (%llu in place), peak %.1f KB, reserved %.1f KB in %u chunk(s)\n",
+               (unsigned long long)stats.num_allocs, (unsigned long long)stats.num_reallocs,
+               (unsigned long long)stats.num_grow_in_place, stats.peak_bytes / 1024.0,
+               stats.reserved_bytes / 1024.0, stats.num_chunks);
+    }
 
     int global_width = viewport.num_columns * viewport.width;
     int global_height = viewport.num_rows * viewport.height;
@@ -187,6 +501,14 @@ void Init(GLFWwindow *window, GShaderProgram *shader, AppData *app, LocalViewpor
     double right = (horizontal_t2 * 2.0 * frustum_w) - frustum_w;
     double bottom = (vertical_t1 * 2.0 * frustum_h) - frustum_h;
     double top = (vertical_t2 * 2.0 * frustum_h) - frustum_h;
+    if (app->sort_last)
+    {
+        // every rank draws the whole display; the compositor cuts it up
+        left = -frustum_w;
+        right = frustum_w;
+        bottom = -frustum_h;
+        top = frustum_h;
+    }
     if (app->render_mode == RenderMode::LocalDisplay) // normal render
     {
         app->mat_projection = glm::frustum(left, right, bottom, top, near, far);
@@ -195,6 +517,10 @@ void Init(GLFWwindow *window, GShaderProgram *shader, AppData *app, LocalViewpor
     {
         app->mat_projection = glm::frustum(left, right, top, bottom, near, far); 
     }
+    // what a level's error covers on screen is judged against the pixels
+    // this rank renders: its tile, or the whole display when sort-last
+    int target_height = app->sort_last ? viewport.num_rows * h : h;
+    app->lod_pixel_scale = 0.5f * fabsf(app->mat_projection[1][1]) * target_height;
 
     glUseProgram(shader->program);
     glm::vec3 ambient = glm::vec3(0.2, 0.2, 0.2);
@@ -203,7 +529,35 @@ void Init(GLFWwindow *window, GShaderProgram *shader, AppData *app, LocalViewpor
     glUniform3fv(shader->ambientcol_uniform, 1, glm::value_ptr(ambient));
     glUniform3fv(shader->lightcol_uniform, 1, glm::value_ptr(diffuse));
     glUniform3fv(shader->lightdir_uniform, 1, glm::value_ptr(light_dir));
+    glUniform1i(shader->img_uniform, 0);
+    glUniform1i(shader->atlas_uniform, 1);
+    glUniform1i(shader->page_table_uniform, 2);
+    SetVirtualTextureUniforms(*shader, *app);
     glUseProgram(0);
+    if (app->occlusion_culling && (app->num_cubes <= 0 || !app->mesh_file.empty()))
+    {
+        // occluders are rasterized as cube faces, which only the built-in cube fills
+        if (app->rank == 0)
+        {
+            fprintf(stderr, "Error: -occlusion needs -cubes with the built-in cube mesh\n");
+        }
+        app->occlusion_culling = false;
+    }
+    if (app->occlusion_culling)
+    {
+        // same aspect as the image this rank renders
+        int target_width = app->sort_last ? viewport.num_columns * w : w;
+        int target_height = app->sort_last ? viewport.num_rows * h : h;
+        SceneOcclusionInit(&app->occlusion, SCENE_OCCLUSION_WIDTH, SCENE_OCCLUSION_WIDTH * target_height / target_width);
+        app->occlusion_time = 0.0;
+    }
+    if (app->use_virtual_texture)
+    {
+        glUseProgram(app->feedback_shader.program);
+        SetVirtualTextureUniforms(app->feedback_shader, *app);
+        glUniform1f(app->feedback_shader.vt_lod_bias_uniform, VirtualTextureFeedbackLodBias(app->virtual_texture));
+        glUseProgram(0);
+    }
 
     app->rotate_x =  30.0;
     app->rotate_y = -45.0;
@@ -216,6 +570,16 @@ void Init(GLFWwindow *window, GShaderProgram *shader, AppData *app, LocalViewpor
 
 void Idle(GLFWwindow *window, GShaderProgram& shader, AppData& app, LocalViewport& viewport)
 {
+    UpdateTextureSwap(app);
+    if (app.animating)
+    {
+        AnimatedTextureUpdate(&app.animation);
+    }
+    SyncTextureSwap(app);
+    if (app.use_virtual_texture)
+    {
+        VirtualTextureUpdate(&app.virtual_texture);
+    }
     Render(window, shader, app, viewport);
 }
 
@@ -230,23 +594,77 @@ void Render(GLFWwindow *window, GShaderProgram& shader, AppData& app, LocalViewp
     }
     MPI_Bcast(&now, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 
+    StreamRingBegin(&app.stream_ring);
     double dt = now - app.render_time;
     app.rotate_x += 10.0 * dt;
     app.rotate_y -= 15.0 * dt;
+    app.scene_time += dt;
 
     app.mat_modelview = glm::translate(glm::mat4(1.0), glm::vec3(0.0, 0.0, -5.0));
     app.mat_modelview = glm::rotate(app.mat_modelview, glm::radians((float)(app.rotate_x)), glm::vec3(1.0, 0.0, 0.0));
     app.mat_modelview = glm::rotate(app.mat_modelview, glm::radians((float)(app.rotate_y)), glm::vec3(0.0, 1.0, 0.0));
 
+    WriteFrameTransforms(app);
+
+    if (app.num_cubes > 0)
+    {
+        CubeSceneAnimate(&app.cube_scene, app.scene_time);
+        UpdateCubeVisibility(app);
+        CubeSceneUpload(&app.cube_scene, &app.stream_ring);
+    }
+    StreamRingFlush(&app.stream_ring);
+    app.submit_time = 0.0;
+    if (app.num_cubes > 0 && app.draw_mode == DrawMode::DrawIndirect)
+    {
+        // one command per visible cube, reading its slot of the instance buffer
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        IndirectDrawBegin(&app.indirect);
+        for (size_t level = 0; level < app.mesh_lods.size(); level++)
+        {
+            const MeshLod& lod = app.mesh_lods[level];
+            for (int i = app.lod_first[level]; i < app.lod_first[level + 1]; i++)
+            {
+                IndirectDrawAdd(&app.indirect, lod.num_indices, lod.first_index, lod.base_vertex, i);
+            }
+        }
+        IndirectDrawUpload(&app.indirect);
+        app.submit_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    glBindVertexArray(app.vao);
+    if (app.use_virtual_texture)
+    {
+        // low resolution pass recording which pages this rank's tile needs
+        VirtualTextureBeginFeedback(&app.virtual_texture);
+        glUseProgram(app.feedback_shader.program);
+        DrawCubes(app);
+        VirtualTextureEndFeedback(&app.virtual_texture);
+        VirtualTextureBind(&app.virtual_texture, GL_TEXTURE1, GL_TEXTURE2);
+    }
+
+    GLuint frame_tex_id = app.animating ? AnimatedTextureCurrent(app.animation) : 0;
+    if (app.sort_last)
+    {
+        DepthCompositorBegin(&app.compositor);
+    }
     glUseProgram(shader.program);
-    SetMatrixUniforms(shader, app);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, app.tex_id);
-    glUniform1i(shader.img_uniform, 0);
-    glBindVertexArray(app.vao);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
+    glBindTexture(GL_TEXTURE_2D, frame_tex_id != 0 ? frame_tex_id : app.tex_id);
+    DrawCubes(app);
+    StreamRingFence(&app.stream_ring);
     glBindTexture(GL_TEXTURE_2D, 0);
     glBindVertexArray(0);
+    if (app.sort_last)
+    {
+        const SceneRegion& region = app.partition.regions[app.rank];
+        CompositorRect rect = {0, 0, 0, 0};
+        if (region.num_objects > 0)
+        {
+            rect = DepthCompositorProject(app.compositor, app.mat_projection * app.mat_modelview, region.objects.min,
+                                          region.objects.max);
+        }
+        DepthCompositorEnd(&app.compositor, rect);
+    }
 
     app.render_time = now;
 
@@ -259,35 +677,372 @@ void Render(GLFWwindow *window, GShaderProgram& shader, AppData& app, LocalViewp
     if (app.rank == 0 && app.frame_count % 60 == 0)
     {
         printf("frame time: %.3lf\n", dt);
+        if (app.num_cubes > 0)
+        {
+            SceneBvhStats& bvh = app.bvh.stats;
+            printf("cubes: %d, %d visible, instance update %.3lf ms, culling %.3lf ms (%d BVH nodes visited, "
+                   "%llu builds, %llu refits)\n", app.num_cubes, bvh.num_visible, app.cube_scene.update_time * 1000.0,
+                   app.cull_time * 1000.0, bvh.num_visited, (unsigned long long)bvh.num_builds,
+                   (unsigned long long)bvh.num_refits);
+            static const char *draw_modes[3] = {"instanced", "per object", "indirect"};
+            printf("draw submit (%s): %.3lf ms\n", draw_modes[app.draw_mode], app.submit_time * 1000.0);
+            StreamRing& ring = app.stream_ring;
+            printf("stream ring (%s): %.1f KB a frame, %.3lf ms waiting for the gpu\n",
+                   ring.mapped != NULL ? "persistent" : "orphaned", ring.used / 1024.0, ring.wait_time * 1000.0);
+            printf("levels of detail:");
+            for (size_t level = 0; level < app.mesh_lods.size(); level++)
+            {
+                printf(" %d", app.lod_first[level + 1] - app.lod_first[level]);
+            }
+            printf(" cubes, %.2f M triangles\n", app.num_triangles / 1.0e6);
+            if (app.occlusion_culling)
+            {
+                SceneOcclusionStats& occlusion = app.occlusion.stats;
+                printf("occlusion: %d occluder faces, %d of %d cubes hidden, %.3lf ms\n", occlusion.num_quads,
+                       occlusion.num_hidden, occlusion.num_tested, app.occlusion_time * 1000.0);
+            }
+        }
+        if (app.sort_last)
+        {
+            ScenePartitionStats& partition = app.partition.stats;
+            DepthCompositorStats& compositor = app.compositor.stats;
+            printf("sort-last: %d cubes on rank 0, busiest rank %d, %d migrated, %llu rebuilds; compositing %.3lf ms, "
+                   "%.1f KB sent\n", app.partition.regions[0].num_objects, partition.max_objects,
+                   partition.num_migrated, (unsigned long long)partition.num_rebuilds, compositor.time * 1000.0,
+                   compositor.bytes_sent / 1024.0);
+        }
+        if (app.use_virtual_texture)
+        {
+            VirtualTextureStats& stats = app.virtual_texture.stats;
+            printf("virtual texture: %d pages resident, %llu read, %llu evicted, %llu dropped\n", stats.num_resident,
+                   (unsigned long long)stats.num_reads, (unsigned long long)stats.num_evictions,
+                   (unsigned long long)stats.num_dropped);
+        }
     }
 
     MPI_Barrier(MPI_COMM_WORLD);
     glfwSwapBuffers(window);
 }
 
-void SetMatrixUniforms(GShaderProgram& shader, AppData& app)
+void WriteFrameTransforms(AppData& app)
 {
-    glUniformMatrix4fv(shader.proj_uniform, 1, GL_FALSE, glm::value_ptr(app.mat_projection));
-    glUniformMatrix4fv(shader.mv_uniform, 1, GL_FALSE, glm::value_ptr(app.mat_modelview));
-
+    // once a frame into the ring, for every pass and program to share
+    size_t offset;
+    FrameTransforms *transforms = (FrameTransforms*)StreamRingAlloc(&app.stream_ring, sizeof(FrameTransforms), &offset);
+    if (transforms == NULL)
+    {
+        return;
+    }
     glm::mat3 mat_normal = glm::inverse(app.mat_modelview);
     mat_normal = glm::transpose(mat_normal);
 
-    glUniformMatrix3fv(shader.norm_uniform, 1, GL_FALSE, glm::value_ptr(mat_normal));
+    memcpy(transforms->projection, glm::value_ptr(app.mat_projection), sizeof(transforms->projection));
+    memcpy(transforms->modelview, glm::value_ptr(app.mat_modelview), sizeof(transforms->modelview));
+    for (int column = 0; column < 3; column++)
+    {
+        memcpy(&transforms->normal[4 * column], glm::value_ptr(mat_normal) + 3 * column, 3 * sizeof(float));
+        transforms->normal[4 * column + 3] = 0.0f;
+    }
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_TRANSFORMS_BINDING, app.stream_ring.buffer, (GLintptr)offset,
+                      sizeof(FrameTransforms));
+}
+
+void DrawCubes(AppData& app)
+{
+    if (app.num_cubes <= 0)
+    {
+        const MeshLod& lod = app.mesh_lods[0];
+        glDrawElementsBaseVertex(GL_TRIANGLES, lod.num_indices, app.mesh.index_type, LodIndexOffset(app, lod),
+                                 lod.base_vertex);
+        return;
+    }
+
+    // the draw list is grouped by level of detail, each level a run of
+    // instances in this frame's part of the stream ring
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    CubeSceneBindInstances(app.cube_scene, app.instance_position_attrib, app.instance_rotation_attrib, 0);
+    switch (app.draw_mode)
+    {
+        case DrawMode::DrawInstanced:
+            // one draw per level; without base instances (GL 4.2) the
+            // instance arrays are pointed at the level's run instead
+            for (size_t level = 0; level < app.mesh_lods.size(); level++)
+            {
+                const MeshLod& lod = app.mesh_lods[level];
+                int first = app.lod_first[level];
+                int count = app.lod_first[level + 1] - first;
+                if (count == 0)
+                {
+                    continue;
+                }
+                CubeSceneBindInstances(app.cube_scene, app.instance_position_attrib, app.instance_rotation_attrib,
+                                       first);
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lod.num_indices, app.mesh.index_type,
+                                                  LodIndexOffset(app, lod), count, lod.base_vertex);
+            }
+            break;
+        case DrawMode::DrawPerObject:
+            // what a scene of separate objects costs: one draw call each
+            for (size_t level = 0; level < app.mesh_lods.size(); level++)
+            {
+                const MeshLod& lod = app.mesh_lods[level];
+                for (int i = app.lod_first[level]; i < app.lod_first[level + 1]; i++)
+                {
+                    glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, lod.num_indices, app.mesh.index_type,
+                                                                  LodIndexOffset(app, lod), 1, lod.base_vertex,
+                                                                  (GLuint)i);
+                }
+            }
+            break;
+        case DrawMode::DrawIndirect:
+            IndirectDrawSubmit(app.indirect, GL_TRIANGLES, app.mesh.index_type);
+            break;
+    }
+    app.submit_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void UpdateCubeVisibility(AppData& app)
+{
+    // a cube's bounds are its circumscribed sphere's, whichever way it faces
+    const CubeScene& scene = app.cube_scene;
+    app.cube_bounds.resize(scene.num_cubes);
+    for (int i = 0; i < scene.num_cubes; i++)
+    {
+        const CubeInstance& instance = scene.instances[i];
+        float radius = instance.scale * 1.7320508f;
+        for (int a = 0; a < 3; a++)
+        {
+            app.cube_bounds[i].min[a] = instance.position[a] - radius;
+            app.cube_bounds[i].max[a] = instance.position[a] + radius;
+        }
+    }
+
+    // only what this rank's frustum (its tile's, or the whole display's
+    // when sort-last) can see is uploaded and drawn
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    SceneBvhUpdate(&app.bvh, app.cube_bounds.data(), scene.num_cubes);
+    SceneFrustum frustum;
+    glm::mat4 mat_view_projection = app.mat_projection * app.mat_modelview;
+    SceneFrustumFromMatrix(glm::value_ptr(mat_view_projection), &frustum);
+    SceneBvhCull(&app.bvh, frustum, &app.visible_cubes);
+    app.cull_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (app.occlusion_culling)
+    {
+        UpdateCubeOcclusion(app, mat_view_projection);
+    }
+
+    if (app.sort_last)
+    {
+        // of those, the ones this rank owns
+        ScenePartitionUpdate(&app.partition, app.cube_bounds.data(), scene.num_cubes);
+        size_t num_owned = 0;
+        for (size_t i = 0; i < app.visible_cubes.size(); i++)
+        {
+            if (app.partition.owners[app.visible_cubes[i]] == app.rank)
+            {
+                app.visible_cubes[num_owned++] = app.visible_cubes[i];
+            }
+        }
+        app.visible_cubes.resize(num_owned);
+    }
+    UpdateCubeLods(app);
+    CubeSceneSetDrawList(&app.cube_scene, app.visible_cubes);
+}
+
+void UpdateCubeOcclusion(AppData& app, const glm::mat4& mat_view_projection)
+{
+    // the visible cubes largest on screen (size over view depth) are the
+    // occluders. Under sort-last they come from every rank's cubes, since
+    // the composited image has them all.
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const CubeScene& scene = app.cube_scene;
+    const glm::mat4& mv = app.mat_modelview;
+    std::vector<std::pair<float, int> >& occluders = app.occluders;
+    occluders.clear();
+    for (size_t i = 0; i < app.visible_cubes.size(); i++)
+    {
+        const CubeInstance& instance = scene.instances[app.visible_cubes[i]];
+        const float *p = instance.position;
+        float depth = -(mv[0][2] * p[0] + mv[1][2] * p[1] + mv[2][2] * p[2] + mv[3][2]);
+        if (depth > instance.scale * 1.7320508f)
+        {
+            occluders.push_back(std::make_pair(instance.scale / depth, app.visible_cubes[i]));
+        }
+    }
+    size_t num_occluders = std::min(occluders.size(), (size_t)SCENE_OCCLUSION_MAX_OCCLUDERS);
+    std::nth_element(occluders.begin(), occluders.begin() + num_occluders, occluders.end(),
+                     std::greater<std::pair<float, int> >());
+
+    // each occluder's faces toward the eye, rotated like texture_phong.vert does
+    glm::vec4 eye_position = glm::inverse(mv) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    glm::vec3 eye(eye_position.x, eye_position.y, eye_position.z);
+    SceneOcclusionBegin(&app.occlusion, glm::value_ptr(mat_view_projection));
+    for (size_t i = 0; i < num_occluders; i++)
+    {
+        const CubeInstance& instance = scene.instances[occluders[i].second];
+        float x = instance.rotation[0], y = instance.rotation[1], z = instance.rotation[2], w = instance.rotation[3];
+        glm::vec3 center(instance.position[0], instance.position[1], instance.position[2]);
+        glm::vec3 axes[3] = {
+            glm::vec3(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y)) * instance.scale,
+            glm::vec3(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x)) * instance.scale,
+            glm::vec3(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y)) * instance.scale
+        };
+        for (int face = 0; face < 6; face++)
+        {
+            glm::vec3 normal = axes[face / 2] * (face % 2 == 0 ? 1.0f : -1.0f);
+            glm::vec3 face_center = center + normal;
+            if (glm::dot(normal, eye - face_center) <= 0.0f)
+            {
+                continue;
+            }
+            const glm::vec3& u = axes[(face / 2 + 1) % 3];
+            const glm::vec3& v = axes[(face / 2 + 2) % 3];
+            glm::vec3 quad[4] = {face_center - u - v, face_center + u - v, face_center + u + v, face_center - u + v};
+            float corners[4][3];
+            for (int k = 0; k < 4; k++)
+            {
+                corners[k][0] = quad[k].x;
+                corners[k][1] = quad[k].y;
+                corners[k][2] = quad[k].z;
+            }
+            SceneOcclusionAddQuad(&app.occlusion, corners);
+        }
+    }
+    SceneOcclusionEnd(&app.occlusion);
+
+    size_t num_unoccluded = 0;
+    for (size_t i = 0; i < app.visible_cubes.size(); i++)
+    {
+        if (!SceneOcclusionTest(&app.occlusion, app.cube_bounds[app.visible_cubes[i]]))
+        {
+            app.visible_cubes[num_unoccluded++] = app.visible_cubes[i];
+        }
+    }
+    app.visible_cubes.resize(num_unoccluded);
+    app.occlusion_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 }
 
+void UpdateCubeLods(AppData& app)
+{
+    // each visible cube gets the coarsest level whose error stays under
+    // lod_max_pixels on this rank's render target, judged at the nearest
+    // point of its bounding sphere; a tile of a large display has more
+    // pixels per unit than a desktop window and keeps more triangles
+    const CubeScene& scene = app.cube_scene;
+    const glm::mat4& mv = app.mat_modelview;
+    int num_lods = (int)app.mesh_lods.size();
+    size_t num_visible = app.visible_cubes.size();
+    std::vector<int>& levels = app.lod_levels;
+    levels.resize(num_visible);
+    app.lod_first.assign(num_lods + 1, 0);
+    for (size_t i = 0; i < num_visible; i++)
+    {
+        const CubeInstance& instance = scene.instances[app.visible_cubes[i]];
+        const float *p = instance.position;
+        float depth = -(mv[0][2] * p[0] + mv[1][2] * p[1] + mv[2][2] * p[2] + mv[3][2]) - instance.scale * 1.7320508f;
+        int level = 0;
+        if (depth > 0.0f && app.lod_max_pixels > 0.0f)
+        {
+            level = SelectMeshLod(app.mesh_lods.data(), num_lods, app.lod_pixel_scale * instance.scale / depth,
+                                  app.lod_max_pixels);
+        }
+        levels[i] = level;
+        app.lod_first[level + 1]++;
+    }
+
+    // group the draw list by level, keeping the cull order within a level
+    app.num_triangles = 0;
+    for (int level = 0; level < num_lods; level++)
+    {
+        int count = app.lod_first[level + 1];
+        app.num_triangles += (int64_t)count * (app.mesh_lods[level].num_indices / 3);
+        app.lod_first[level + 1] = app.lod_first[level] + count;
+    }
+    std::vector<int> next(app.lod_first.begin(), app.lod_first.end() - 1);
+    app.lod_sorted.resize(num_visible);
+    for (size_t i = 0; i < num_visible; i++)
+    {
+        app.lod_sorted[next[levels[i]]++] = app.visible_cubes[i];
+    }
+    app.visible_cubes.swap(app.lod_sorted);
+}
 
 // Auxillary functions
-GLuint CreateCubeVao(AppData& app)
+GLuint CreateMeshVao(AppData& app)
 {
+    MeshData mesh;
+    MeshFile cache;
+    bool loaded = false;
+    double start = MPI_Wtime();
+    if (IsMeshCacheFile(app.mesh_file) && MeshFileOpen(app.mesh_file.c_str(), &cache))
+    {
+        // uploaded straight from the mapping: no parsing and no copy on our
+        // side, so this is as fast as the file can be read
+        GLenum index_type = cache.header.index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        CreateMeshBuffers(cache.vertices, cache.header.num_vertices, cache.indices, cache.header.num_indices,
+                          index_type, &app.mesh);
+        if (cache.lods != NULL)
+        {
+            app.mesh_lods.assign(cache.lods, cache.lods + cache.header.num_lods);
+        }
+        MeshFileClose(&cache);
+        loaded = true;
+    }
+    else if (IsMeshFile(app.mesh_file) && LoadMesh(app.mesh_file.c_str(), LoaderThreadCount(), &mesh))
+    {
+        // every rank parses its own copy; the file is read through the page
+        // cache, and the ranks on one node share it. Fitted to the size of
+        // the built-in cube, so -cubes and -sortlast bounds still hold (the
+        // cache is fitted when it is written).
+        FitMesh(&mesh, 1.0f, NULL);
+        BuildMeshLods(&mesh, MESH_MAX_LODS);
+        app.mesh_lods = mesh.lods;
+        CreateMeshBuffers(mesh, &app.mesh);
+        loaded = true;
+    }
+    else
+    {
+        if (!app.mesh_file.empty() && app.rank == 0)
+        {
+            fprintf(stderr, "Error: cannot load mesh %s, drawing the cube instead\n", app.mesh_file.c_str());
+        }
+        CreateCubeMesh(&mesh);
+        CreateMeshBuffers(mesh, &app.mesh);
+    }
+    if (app.mesh_lods.empty())
+    {
+        // the whole mesh as the only level (the cube, or a cache without levels)
+        MeshLod full = {0, (uint32_t)app.mesh.num_indices, 0, 0.0f};
+        app.mesh_lods.push_back(full);
+    }
+    if (loaded && app.rank == 0)
+    {
+        printf("mesh %s: %d vertices, %d triangles, %d levels of detail, loaded in %.1f ms\n", app.mesh_file.c_str(),
+               app.mesh.num_vertices, (int)(app.mesh_lods[0].num_indices / 3), (int)app.mesh_lods.size(),
+               (MPI_Wtime() - start) * 1000.0);
+    }
+
     GLuint vao;
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, app.mesh.vertex_buffer);
+    SetMeshVertexFormat(app.vertex_position_attrib, app.vertex_normal_attrib, app.vertex_texcoord_attrib);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, app.mesh.index_buffer);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
+    return vao;
+}
+
+const void *LodIndexOffset(const AppData& app, const MeshLod& lod)
+{
+    size_t index_size = app.mesh.index_type == GL_UNSIGNED_SHORT ? 2 : 4;
+    return (const void*)(lod.first_index * index_size);
+}
+
+void CreateCubeMesh(MeshData *mesh)
+{
     // vertices
-    GLuint vertex_position_buffer;
-    glGenBuffers(1, &vertex_position_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertex_position_buffer);
     GLfloat vertices[72] = {
         // Front face
         -1.0, -1.0,  1.0,
@@ -325,14 +1080,8 @@ GLuint CreateCubeVao(AppData& app)
         -1.0,  1.0,  1.0,
         -1.0,  1.0, -1.0
     };
-    glBufferData(GL_ARRAY_BUFFER, 72 * sizeof(GLfloat), vertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(app.vertex_position_attrib);
-    glVertexAttribPointer(app.vertex_position_attrib, 3, GL_FLOAT, false, 0, 0);
 
     // normals
-    GLuint vertex_normal_buffer;
-    glGenBuffers(1, &vertex_normal_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertex_normal_buffer);
     GLfloat normals[72] = {
         // Front
         0.0,  0.0,  1.0,
@@ -370,14 +1119,8 @@ GLuint CreateCubeVao(AppData& app)
         -1.0,  0.0,  0.0,
         -1.0,  0.0,  0.0
     };
-    glBufferData(GL_ARRAY_BUFFER, 72 * sizeof(GLfloat), normals, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(app.vertex_normal_attrib);
-    glVertexAttribPointer(app.vertex_normal_attrib, 3, GL_FLOAT, false, 0, 0);
 
     // textures
-    GLuint vertex_texcoord_buffer;
-    glGenBuffers(1, &vertex_texcoord_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertex_texcoord_buffer);
     GLfloat texcoords[48] = {
         // Front
         0.0,  0.0,
@@ -415,15 +1158,13 @@ GLuint CreateCubeVao(AppData& app)
         1.0,  1.0,
         0.0,  1.0
     };
-    glBufferData(GL_ARRAY_BUFFER, 48 * sizeof(GLfloat), texcoords, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(app.vertex_texcoord_attrib);
-    glVertexAttribPointer(app.vertex_texcoord_attrib, 2, GL_FLOAT, false, 0, 0);
+
+    // packed vertices (see mesh.h)
+    mesh->vertices.resize(24);
+    PackMeshVertices(vertices, normals, texcoords, 24, mesh->vertices.data());
 
     // faces of the triangles
-    GLuint vertex_index_buffer;
-    glGenBuffers(1, &vertex_index_buffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertex_index_buffer);
-    GLushort indices[36] = {
+    uint32_t indices[36] = {
          0,  1,  2,      0,  2,  3,   // front
          4,  5,  6,      4,  6,  7,   // back
          8,  9, 10,      8, 10, 11,   // top
@@ -431,45 +1172,414 @@ GLuint CreateCubeVao(AppData& app)
         16, 17, 18,     16, 18, 19,   // right
         20, 21, 22,     20, 22, 23    // left
     };
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, 36 * sizeof(GLushort), indices, GL_STATIC_DRAW);
+    mesh->indices.assign(indices, indices + 36);
+    ComputeMeshBounds(mesh);
+}
 
-    glBindVertexArray(0);
+GLuint CreateTextureObject()
+{
+    GLuint tex_id;
+    glGenTextures(1, &tex_id);
+    glBindTexture(GL_TEXTURE_2D, tex_id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    return vao;
+    return tex_id;
+}
+
+void CreateTextures(AppData& app, const char **filenames, int count, GLuint *tex_ids)
+{
+    // every image decodes on the loader pool at once; uploads then happen
+    // here in list order, each as soon as its own decode is done
+    TextureJob *jobs = new TextureJob[count];
+    for (int i = 0; i < count; i++)
+    {
+        TextureJobInit(&jobs[i], filenames[i]);
+        jobs[i].scale_denom = 0;
+        jobs[i].max_extent = app.texture_max_extent;
+        TextureLoaderSubmit(&app.tex_loader, &jobs[i]);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        TextureLoaderWait(&app.tex_loader, &jobs[i]);
+        tex_ids[i] = CreateTextureObject();
+        if (jobs[i].loaded)
+        {
+            TexImageFromJob(jobs[i], jobs[i].pixels);
+        }
+        else
+        {
+            fprintf(stderr, "Error: cannot decode image %s (%s)\n", filenames[i], jobs[i].failure_reason);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        TextureJobRelease(&jobs[i]);
+    }
+
+    delete[] jobs;
+}
+
+void TexImageFromJob(const TextureJob& job, const void *pixels)
+{
+    // HDR images stay half float on the GPU: half the memory of GL_RGBA32F
+    if (job.hdr)
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, job.width, job.height, 0, GL_RGBA, GL_HALF_FLOAT, pixels);
+    }
+    else
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, job.width, job.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+}
+
+bool QueryTextureSize(AppData& app, const char *filename, int *width, int *height, int *scale_denom)
+{
+    int img_c;
+    stbi_set_jpeg_scale_denom_on_load_thread(1);
+    if (!stbi_info(filename, width, height, &img_c))
+    {
+        return false;
+    }
+
+    // JPEGs decode at a reduced scale when the display can't show them in
+    // full; stbi_info then reports the size the load will produce
+    *scale_denom = TextureScaleDenom(*width, *height, app.texture_max_extent);
+    stbi_set_jpeg_scale_denom_on_load_thread(*scale_denom);
+    stbi_info(filename, width, height, &img_c);
+    stbi_set_jpeg_scale_denom_on_load_thread(1);
+
+    return true;
+}
+
+GLuint StreamTexture(AppData& app, const char *filename)
+{
+    // HDR images have no reduced-size decode to preview with
+    int img_w, img_h, img_c, scale_denom;
+    if (!QueryTextureSize(app, filename, &img_w, &img_h, &scale_denom) || stbi_is_hdr(filename))
+    {
+        GLuint tex_id;
+        CreateTextures(app, &filename, 1, &tex_id);
+        return tex_id;
+    }
+
+    // 1/8-scale preview from the JPEG DC coefficients, so rendering can start
+    // right away (other formats ignore the scale and decode in full)
+    int preview_w, preview_h;
+    ImageArenaBind(&app.image_arena);
+    stbi_set_flip_vertically_on_load_thread(true);
+    stbi_set_jpeg_scale_denom_on_load_thread(8);
+    uint8_t *preview = stbi_load(filename, &preview_w, &preview_h, &img_c, STBI_rgb_alpha);
+    stbi_set_jpeg_scale_denom_on_load_thread(1);
+    ImageArenaBind(NULL);
+
+    GLuint tex_id = CreateTextureObject();
+    if (preview == NULL)
+    {
+        fprintf(stderr, "Error: cannot decode image %s (%s)\n", filename, stbi_failure_reason());
+        ImageArenaReset(&app.image_arena);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return tex_id;
+    }
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, preview_w, preview_h, 0, GL_RGBA, GL_UNSIGNED_BYTE, preview);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    stbi_image_free(preview);
+    ImageArenaReset(&app.image_arena);
+    if (preview_w == img_w && preview_h == img_h)
+    {
+        return tex_id;
+    }
+
+    // the full resolution texture replaces the preview through a regular swap
+    BeginTextureSwap(app, filename);
+
+    return tex_id;
 }
 
-GShaderProgram CreateTextureShader(AppData& app)
+void BeginTextureSwap(AppData& app, const char *filename)
+{
+    // a swap is entered on all ranks at the same frame, and every rank goes
+    // through it even if it can't load the image, so it stays collective
+    TextureSwap& swap = app.tex_swap;
+    swap.state = SwapReady;
+    swap.back_tex_id = 0;
+
+    int img_w, img_h, scale_denom;
+    if (!QueryTextureSize(app, filename, &img_w, &img_h, &scale_denom))
+    {
+        fprintf(stderr, "Error: cannot read image %s (%s)\n", filename, stbi_failure_reason());
+        return;
+    }
+
+    // decoded on the loader pool straight into a mapped pixel unpack buffer
+    GLsizeiptr size = (GLsizeiptr)img_w * img_h * TextureBytesPerTexel(filename);
+    TextureJobInit(&swap.job, filename);
+    swap.job.scale_denom = scale_denom;
+    swap.job.dest_size = size;
+    glGenBuffers(1, &swap.pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, swap.pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    swap.job.dest = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (swap.job.dest == NULL)
+    {
+        fprintf(stderr, "Error: cannot map pixel buffer for %s\n", filename);
+        glDeleteBuffers(1, &swap.pbo);
+        return;
+    }
+
+    swap.state = SwapDecoding;
+    TextureLoaderSubmit(&app.tex_loader, &swap.job);
+}
+
+void UpdateTextureSwap(AppData& app)
+{
+    TextureSwap& swap = app.tex_swap;
+    if (swap.state == SwapDecoding && TextureLoaderPoll(&app.tex_loader, &swap.job))
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, swap.pbo);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        if (swap.job.loaded)
+        {
+            // sourced from the PBO, so the transfer runs behind the frames
+            // still drawing the front texture; the fence says when it's done
+            swap.back_tex_id = CreateTextureObject();
+            TexImageFromJob(swap.job, 0);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            swap.upload_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+            swap.state = SwapUploading;
+        }
+        else
+        {
+            fprintf(stderr, "Error: cannot decode image %s (%s)\n", swap.job.filename.c_str(), swap.job.failure_reason);
+            swap.state = SwapReady;
+        }
+        // the buffer's storage lives on until the transfer has used it
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &swap.pbo);
+    }
+
+    if (swap.state == SwapUploading)
+    {
+        GLenum status = glClientWaitSync(swap.upload_fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+        {
+            glDeleteSync(swap.upload_fence);
+            swap.state = SwapReady;
+        }
+    }
+}
+
+void SyncTextureSwap(AppData& app)
+{
+    // one small allreduce per frame: has any rank asked for the next
+    // texture, is any rank still decoding or uploading the pending one, and
+    // is any rank missing the animation frame that is due
+    TextureSwap& swap = app.tex_swap;
+    bool frame_due = app.animating && AnimatedTextureDue(app.animation, app.render_time);
+    int local[3] = {app.texture_change_requested ? 1 : 0, (swap.state == SwapDecoding || swap.state == SwapUploading) ? 1 : 0,
+                    (frame_due && !AnimatedTextureNextReady(app.animation)) ? 1 : 0};
+    int global[3];
+    MPI_Allreduce(local, global, 3, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+    // render_time is the same on every rank, so they all find the frame due
+    // together and advance together once none of them is behind
+    if (frame_due && global[2] == 0)
+    {
+        AnimatedTextureAdvance(&app.animation, app.render_time);
+    }
+
+    // the back texture is complete everywhere: swap on this frame on every
+    // rank, so the wall never shows two different textures
+    if (swap.state != SwapIdle && global[1] == 0)
+    {
+        if (swap.back_tex_id != 0)
+        {
+            glDeleteTextures(1, &app.tex_id);
+            app.tex_id = swap.back_tex_id;
+        }
+        swap.state = SwapIdle;
+
+        // the back texture holds a GIF's first frame; its animation starts
+        // streaming now, on every rank
+        const std::string& texture_file = app.texture_files[app.texture_index];
+        if (app.animating && app.animation.filename != texture_file)
+        {
+            AnimatedTextureClose(&app.animation);
+            app.animating = false;
+        }
+        if (!app.animating && IsAnimatedTextureFile(texture_file))
+        {
+            app.animating = AnimatedTextureOpen(&app.animation, texture_file.c_str());
+        }
+    }
+
+    if (swap.state == SwapIdle && global[0] != 0)
+    {
+        app.texture_change_requested = false;
+        app.texture_index = (app.texture_index + 1) % (int)app.texture_files.size();
+        BeginTextureSwap(app, app.texture_files[app.texture_index].c_str());
+    }
+}
+
+void KeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+    AppData *app = (AppData*)glfwGetWindowUserPointer(window);
+    if (key == GLFW_KEY_T && action == GLFW_PRESS && !app->use_virtual_texture)
+    {
+        app->texture_change_requested = true;
+    }
+}
+
+int LoaderThreadCount()
+{
+    // ranks sharing a node split its cores between their loader pools
+    MPI_Comm node_comm;
+    int node_ranks;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+    MPI_Comm_size(node_comm, &node_ranks);
+    MPI_Comm_free(&node_comm);
+
+    int num_threads = (int)std::thread::hardware_concurrency() / node_ranks;
+    return num_threads > 0 ? num_threads : 1;
+}
+
+void SetVirtualTextureUniforms(GShaderProgram& shader, AppData& app)
+{
+    glUniform1i(shader.virtual_uniform, app.use_virtual_texture ? 1 : 0);
+    if (!app.use_virtual_texture)
+    {
+        return;
+    }
+
+    const VirtualTextureLayout& layout = app.virtual_texture.layout;
+    glUniform2f(shader.vt_size_uniform, (float)layout.header.width, (float)layout.header.height);
+    glUniform1i(shader.vt_page_size_uniform, layout.page_size);
+    glUniform1i(shader.vt_border_uniform, layout.border);
+    glUniform1i(shader.vt_num_levels_uniform, layout.num_levels);
+    glUniform1iv(shader.vt_level_row_uniform, layout.num_levels, app.virtual_texture.level_row);
+    GLint level_pages[2 * VTEX_MAX_LEVELS];
+    for (int l = 0; l < layout.num_levels; l++)
+    {
+        level_pages[2 * l + 0] = layout.pages_x[l];
+        level_pages[2 * l + 1] = layout.pages_y[l];
+    }
+    glUniform2iv(shader.vt_level_pages_uniform, layout.num_levels, level_pages);
+}
+
+GShaderProgram CreateTextureShader(AppData& app, const char *fragment_file)
 {
     GShaderProgram shader;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
     const char *vertex_file = "resrc/shaders/texture_phong.vert";
     char *vertex_src;
     int32_t vertex_src_length = ReadFile(vertex_file, &vertex_src);
-    GLint vertex_shader = CompileShader(vertex_src, vertex_src_length, GL_VERTEX_SHADER);
-    free(vertex_src);
-
-    const char *fragment_file = "resrc/shaders/texture_phong.frag";
     char *fragment_src;
     int32_t fragment_src_length = ReadFile(fragment_file, &fragment_src);
-    GLint fragment_shader = CompileShader(fragment_src, fragment_src_length, GL_FRAGMENT_SHADER);
-    free(fragment_src);
 
-    CreateShaderProgram(vertex_shader, fragment_shader, &shader.program);
+    // attribute locations are fixed at link time, so they are part of the key
+    char bindings[64];
+    int bindings_length = snprintf(bindings, sizeof(bindings), "%u %u %u %u %u", app.vertex_position_attrib,
+                                   app.vertex_normal_attrib, app.vertex_texcoord_attrib,
+                                   app.instance_position_attrib, app.instance_rotation_attrib);
+    const char *key_sources[3] = {vertex_src, fragment_src, bindings};
+    size_t key_lengths[3] = {(size_t)std::max(vertex_src_length, 0), (size_t)std::max(fragment_src_length, 0),
+                             (size_t)bindings_length};
+    bool use_cache = !app.program_cache_dir.empty() && ProgramCacheAvailable();
+    uint64_t key = use_cache ? ProgramCacheKey(key_sources, key_lengths, 3) : 0;
+
+    // with the cache, the first rank on each node compiles and stores the
+    // program while the others wait, so they all find it cached; without
+    // it there is nothing to wait for. -programcache is the same on every
+    // rank, but program binary support may not be: the split is collective,
+    // so ranks that can't use the cache join it and get no communicator
+    MPI_Comm node_comm = MPI_COMM_NULL;
+    int node_rank = 0;
+    if (!app.program_cache_dir.empty())
+    {
+        MPI_Comm_split_type(MPI_COMM_WORLD, use_cache ? MPI_COMM_TYPE_SHARED : MPI_UNDEFINED, 0, MPI_INFO_NULL,
+                            &node_comm);
+    }
+    if (node_comm != MPI_COMM_NULL)
+    {
+        MPI_Comm_rank(node_comm, &node_rank);
+        if (node_rank != 0)
+        {
+            MPI_Barrier(node_comm);
+        }
+    }
 
-    glBindAttribLocation(shader.program, app.vertex_position_attrib, "aVertexPosition");
-    glBindAttribLocation(shader.program, app.vertex_normal_attrib, "aVertexNormal");
-    glBindAttribLocation(shader.program, app.vertex_texcoord_attrib, "aVertexTexCoord");
-    glBindAttribLocation(shader.program, 0, "FragColor");
+    shader.program = glCreateProgram();
+    bool cached = use_cache && ProgramCacheLoad(app.program_cache_dir.c_str(), key, shader.program);
+    if (!cached)
+    {
+        glDeleteProgram(shader.program);
+        GLint vertex_shader = CompileShader(vertex_src, vertex_src_length, GL_VERTEX_SHADER);
+        GLint fragment_shader = CompileShader(fragment_src, fragment_src_length, GL_FRAGMENT_SHADER);
+        CreateShaderProgram(vertex_shader, fragment_shader, &shader.program);
+
+        glBindAttribLocation(shader.program, app.vertex_position_attrib, "aVertexPosition");
+        glBindAttribLocation(shader.program, app.vertex_normal_attrib, "aVertexNormal");
+        glBindAttribLocation(shader.program, app.vertex_texcoord_attrib, "aVertexTexCoord");
+        glBindAttribLocation(shader.program, app.instance_position_attrib, "aInstancePosition");
+        glBindAttribLocation(shader.program, app.instance_rotation_attrib, "aInstanceRotation");
+        glBindAttribLocation(shader.program, 0, "FragColor");
+        if (use_cache)
+        {
+            glProgramParameteri(shader.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+
+        LinkShaderProgram(shader.program);
+        // the program keeps what it needs once linked
+        glDetachShader(shader.program, vertex_shader);
+        glDetachShader(shader.program, fragment_shader);
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+
+        GLint status;
+        glGetProgramiv(shader.program, GL_LINK_STATUS, &status);
+        if (use_cache && status != 0)
+        {
+            ProgramCacheStore(app.program_cache_dir.c_str(), key, shader.program);
+        }
+    }
+    free(vertex_src);
+    free(fragment_src);
 
-    LinkShaderProgram(shader.program);
+    if (node_comm != MPI_COMM_NULL)
+    {
+        if (node_rank == 0)
+        {
+            MPI_Barrier(node_comm);
+        }
+        MPI_Comm_free(&node_comm);
+    }
+    if (app.rank == 0)
+    {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%s: %s in %.1f ms\n", fragment_file, cached ? "loaded from program cache" : "compiled",
+               elapsed * 1000.0);
+    }
 
-    shader.mv_uniform = glGetUniformLocation(shader.program, "uModelViewMatrix");
-    shader.proj_uniform = glGetUniformLocation(shader.program, "uProjectionMatrix");
-    shader.norm_uniform = glGetUniformLocation(shader.program, "uNormalMatrix");
+    glUniformBlockBinding(shader.program, glGetUniformBlockIndex(shader.program, "FrameTransforms"),
+                          FRAME_TRANSFORMS_BINDING);
     shader.ambientcol_uniform = glGetUniformLocation(shader.program, "uAmbientColor");
     shader.lightdir_uniform = glGetUniformLocation(shader.program, "uLightingDirection");
     shader.lightcol_uniform = glGetUniformLocation(shader.program, "uDirectionalColor");
     shader.img_uniform = glGetUniformLocation(shader.program, "uImage");
+    shader.virtual_uniform = glGetUniformLocation(shader.program, "uVirtual");
+    shader.atlas_uniform = glGetUniformLocation(shader.program, "uAtlas");
+    shader.page_table_uniform = glGetUniformLocation(shader.program, "uPageTable");
+    shader.vt_size_uniform = glGetUniformLocation(shader.program, "uVtSize");
+    shader.vt_page_size_uniform = glGetUniformLocation(shader.program, "uVtPageSize");
+    shader.vt_border_uniform = glGetUniformLocation(shader.program, "uVtBorder");
+    shader.vt_num_levels_uniform = glGetUniformLocation(shader.program, "uVtNumLevels");
+    shader.vt_level_row_uniform = glGetUniformLocation(shader.program, "uVtLevelRow");
+    shader.vt_level_pages_uniform = glGetUniformLocation(shader.program, "uVtLevelPages");
+    shader.vt_lod_bias_uniform = glGetUniformLocation(shader.program, "uVtLodBias");
 
     return shader;
 }
@@ -0,0 +1,206 @@
+#include "mesh.h"
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include "half_float.h"
+
+static uint32_t PackSnorm10(float value);
+static void FlushMeshlet(const MeshData& mesh, MeshletData *meshlets, Meshlet *meshlet, std::vector<int> *local);
+
+uint32_t PackNormal(const float normal[3])
+{
+    return PackSnorm10(normal[0]) | (PackSnorm10(normal[1]) << 10) | (PackSnorm10(normal[2]) << 20);
+}
+
+void UnpackNormal(uint32_t packed, float normal[3])
+{
+    for (int a = 0; a < 3; a++)
+    {
+        // sign-extend the 10-bit field
+        int32_t value = (int32_t)(((packed >> (10 * a)) & 0x3ff) << 22) >> 22;
+        normal[a] = value < -511 ? -1.0f : value / 511.0f;
+    }
+}
+
+void PackMeshVertices(const float *positions, const float *normals, const float *texcoords, size_t count,
+                      MeshVertex *vertices)
+{
+    static const float up[3] = {0.0f, 0.0f, 1.0f};
+    uint32_t default_normal = PackNormal(up);
+    for (size_t i = 0; i < count; i++)
+    {
+        vertices[i].position[0] = positions[3 * i + 0];
+        vertices[i].position[1] = positions[3 * i + 1];
+        vertices[i].position[2] = positions[3 * i + 2];
+        vertices[i].normal = normals != NULL ? PackNormal(&normals[3 * i]) : default_normal;
+        vertices[i].texcoord[0] = 0;
+        vertices[i].texcoord[1] = 0;
+    }
+
+    // texcoords convert in blocks, the vector kernels need a run of floats
+    if (texcoords != NULL)
+    {
+        uint16_t halves[512];
+        for (size_t first = 0; first < count; first += 256)
+        {
+            size_t block = count - first < 256 ? count - first : 256;
+            FloatToHalf(&texcoords[2 * first], halves, 2 * block);
+            for (size_t i = 0; i < block; i++)
+            {
+                vertices[first + i].texcoord[0] = halves[2 * i + 0];
+                vertices[first + i].texcoord[1] = halves[2 * i + 1];
+            }
+        }
+    }
+}
+
+void ComputeMeshBounds(MeshData *mesh)
+{
+    for (int a = 0; a < 3; a++)
+    {
+        mesh->bounds_min[a] = FLT_MAX;
+        mesh->bounds_max[a] = -FLT_MAX;
+    }
+    for (size_t i = 0; i < mesh->vertices.size(); i++)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            mesh->bounds_min[a] = fminf(mesh->bounds_min[a], mesh->vertices[i].position[a]);
+            mesh->bounds_max[a] = fmaxf(mesh->bounds_max[a], mesh->vertices[i].position[a]);
+        }
+    }
+}
+
+float FitMesh(MeshData *mesh, float extent, float *old_center)
+{
+    ComputeMeshBounds(mesh);
+    if (mesh->vertices.empty())
+    {
+        return 1.0f;
+    }
+
+    float center[3];
+    float longest = 0.0f;
+    for (int a = 0; a < 3; a++)
+    {
+        center[a] = 0.5f * (mesh->bounds_min[a] + mesh->bounds_max[a]);
+        longest = fmaxf(longest, mesh->bounds_max[a] - mesh->bounds_min[a]);
+    }
+    float scale = longest > 0.0f ? 2.0f * extent / longest : 1.0f;
+    for (size_t i = 0; i < mesh->vertices.size(); i++)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            mesh->vertices[i].position[a] = (mesh->vertices[i].position[a] - center[a]) * scale;
+        }
+    }
+    for (size_t i = 0; i < mesh->lods.size(); i++)
+    {
+        mesh->lods[i].error *= scale;
+    }
+    for (int a = 0; a < 3; a++)
+    {
+        mesh->bounds_min[a] = (mesh->bounds_min[a] - center[a]) * scale;
+        mesh->bounds_max[a] = (mesh->bounds_max[a] - center[a]) * scale;
+        if (old_center != NULL)
+        {
+            old_center[a] = center[a];
+        }
+    }
+    return scale;
+}
+
+void BuildMeshlets(const MeshData& mesh, MeshletData *meshlets)
+{
+    meshlets->meshlets.clear();
+    meshlets->vertices.clear();
+    meshlets->triangles.clear();
+
+    // mesh vertex -> index in the current meshlet, -1 if not in it
+    std::vector<int> local(mesh.vertices.size(), -1);
+    Meshlet current;
+    memset(&current, 0, sizeof(current));
+    size_t first_index = mesh.lods.empty() ? 0 : mesh.lods[0].first_index;
+    size_t num_indices = mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].num_indices;
+    for (size_t t = first_index; t + 2 < first_index + num_indices; t += 3)
+    {
+        const uint32_t *triangle = &mesh.indices[t];
+        int new_vertices = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            bool repeated = (k > 0 && triangle[0] == triangle[k]) || (k > 1 && triangle[1] == triangle[k]);
+            new_vertices += local[triangle[k]] < 0 && !repeated ? 1 : 0;
+        }
+        if (current.num_vertices + new_vertices > MESHLET_MAX_VERTICES ||
+            current.num_triangles == MESHLET_MAX_TRIANGLES)
+        {
+            FlushMeshlet(mesh, meshlets, &current, &local);
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+            if (local[triangle[k]] < 0)
+            {
+                local[triangle[k]] = (int)current.num_vertices++;
+                meshlets->vertices.push_back(triangle[k]);
+            }
+            meshlets->triangles.push_back((uint8_t)local[triangle[k]]);
+        }
+        current.num_triangles++;
+    }
+    FlushMeshlet(mesh, meshlets, &current, &local);
+}
+
+
+// Auxillary functions
+uint32_t PackSnorm10(float value)
+{
+    // GL maps -511..511 to -1..1 (-512 also reads as -1)
+    float clamped = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+    int32_t quantized = (int32_t)lrintf(clamped * 511.0f);
+    return (uint32_t)quantized & 0x3ff;
+}
+
+void FlushMeshlet(const MeshData& mesh, MeshletData *meshlets, Meshlet *meshlet, std::vector<int> *local)
+{
+    if (meshlet->num_triangles == 0)
+    {
+        return;
+    }
+
+    // sphere around the box of the meshlet's vertices: not the tightest, but
+    // cheap and never far off for clusters this small
+    float box_min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float box_max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    const uint32_t *vertices = &meshlets->vertices[meshlet->vertex_offset];
+    for (uint32_t i = 0; i < meshlet->num_vertices; i++)
+    {
+        const float *p = mesh.vertices[vertices[i]].position;
+        for (int a = 0; a < 3; a++)
+        {
+            box_min[a] = fminf(box_min[a], p[a]);
+            box_max[a] = fmaxf(box_max[a], p[a]);
+        }
+    }
+    for (int a = 0; a < 3; a++)
+    {
+        meshlet->center[a] = 0.5f * (box_min[a] + box_max[a]);
+    }
+    float radius2 = 0.0f;
+    for (uint32_t i = 0; i < meshlet->num_vertices; i++)
+    {
+        const float *p = mesh.vertices[vertices[i]].position;
+        float dx = p[0] - meshlet->center[0];
+        float dy = p[1] - meshlet->center[1];
+        float dz = p[2] - meshlet->center[2];
+        radius2 = fmaxf(radius2, dx * dx + dy * dy + dz * dz);
+        (*local)[vertices[i]] = -1;
+    }
+    meshlet->radius = sqrtf(radius2);
+    meshlets->meshlets.push_back(*meshlet);
+
+    meshlet->vertex_offset = (uint32_t)meshlets->vertices.size();
+    meshlet->triangle_offset = (uint32_t)(meshlets->triangles.size() / 3);
+    meshlet->num_vertices = 0;
+    meshlet->num_triangles = 0;
+}
@@ -0,0 +1,80 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Interleaved vertex format shared by every mesh path.
+//
+// Positions stay 32-bit floats (large meshes need the precision, and cracks
+// from position rounding show), but normals are packed into one signed
+// normalized GL_INT_2_10_10_10_REV word and texture coordinates are half
+// floats (which, unlike normalized shorts, keep repeating coordinates
+// outside [0, 1]). That is 20 bytes a vertex in one stream, instead of 32
+// spread over separate float position, normal and texcoord buffers.
+
+typedef struct MeshVertex {
+    float position[3];
+    uint32_t normal;        // x, y, z in 10 bits each, low bits first
+    uint16_t texcoord[2];   // IEEE half floats
+} MeshVertex;
+
+// one level of detail: an index range of the mesh, indexing from base_vertex
+typedef struct MeshLod {
+    uint32_t first_index;
+    uint32_t num_indices;
+    int32_t base_vertex;
+    float error;            // how far the level strays from the full mesh, in mesh units
+} MeshLod;
+
+// indexed triangle mesh in memory
+typedef struct MeshData {
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<MeshLod> lods;      // finest first; empty until BuildMeshLods, meaning all of it
+    float bounds_min[3];
+    float bounds_max[3];
+} MeshData;
+
+// Meshlets: clusters of at most MESHLET_MAX_VERTICES vertices and
+// MESHLET_MAX_TRIANGLES triangles, with triangles indexing the meshlet's own
+// vertex list in 8 bits. Their bounding spheres allow culling at a finer
+// grain than whole meshes.
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+typedef struct Meshlet {
+    uint32_t vertex_offset;     // into MeshletData::vertices
+    uint32_t triangle_offset;   // into MeshletData::triangles, 3 bytes a triangle
+    uint32_t num_vertices;
+    uint32_t num_triangles;
+    float center[3];            // bounding sphere
+    float radius;
+} Meshlet;
+
+typedef struct MeshletData {
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> vertices;   // mesh vertex indices
+    std::vector<uint8_t> triangles;   // meshlet vertex indices
+} MeshletData;
+
+uint32_t PackNormal(const float normal[3]);
+void UnpackNormal(uint32_t packed, float normal[3]);
+
+// packs 'count' vertices from separate float arrays (3, 3 and 2 per vertex);
+// missing normals become +z, missing texcoords (0, 0)
+void PackMeshVertices(const float *positions, const float *normals, const float *texcoords, size_t count,
+                      MeshVertex *vertices);
+
+void ComputeMeshBounds(MeshData *mesh);
+// recomputes the bounds, then centers the mesh on the origin and scales it
+// so its longest side spans -extent to extent; returns the scale, and the
+// old center in 'center' if that isn't NULL
+float FitMesh(MeshData *mesh, float extent, float *center);
+
+// greedy clustering in index order, so it keeps whatever locality the
+// index buffer has (of the finest level of detail)
+void BuildMeshlets(const MeshData& mesh, MeshletData *meshlets);
+
+#endif // MESH_H
@@ -0,0 +1,56 @@
+#include "mesh_buffers.h"
+
+void CreateMeshBuffers(const MeshVertex *vertices, size_t num_vertices, const void *indices, size_t num_indices,
+                       GLenum index_type, MeshBuffers *buffers)
+{
+    glGenBuffers(1, &buffers->vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers->vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(num_vertices * sizeof(MeshVertex)), vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    size_t index_size = index_type == GL_UNSIGNED_SHORT ? 2 : 4;
+    glGenBuffers(1, &buffers->index_buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)(num_indices * index_size), indices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    buffers->index_type = index_type;
+    buffers->num_vertices = (int)num_vertices;
+    buffers->num_indices = (int)num_indices;
+}
+
+void CreateMeshBuffers(const MeshData& mesh, MeshBuffers *buffers)
+{
+    if (mesh.vertices.size() > 65536)
+    {
+        CreateMeshBuffers(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(),
+                          GL_UNSIGNED_INT, buffers);
+        return;
+    }
+
+    // half the index bandwidth when every vertex can be addressed with 16 bits
+    std::vector<uint16_t> short_indices(mesh.indices.begin(), mesh.indices.end());
+    CreateMeshBuffers(mesh.vertices.data(), mesh.vertices.size(), short_indices.data(), short_indices.size(),
+                      GL_UNSIGNED_SHORT, buffers);
+}
+
+void ReleaseMeshBuffers(MeshBuffers *buffers)
+{
+    glDeleteBuffers(1, &buffers->vertex_buffer);
+    glDeleteBuffers(1, &buffers->index_buffer);
+    buffers->num_vertices = 0;
+    buffers->num_indices = 0;
+}
+
+void SetMeshVertexFormat(GLuint position_attrib, GLuint normal_attrib, GLuint texcoord_attrib)
+{
+    glEnableVertexAttribArray(position_attrib);
+    glVertexAttribPointer(position_attrib, 3, GL_FLOAT, false, sizeof(MeshVertex),
+                          (void*)offsetof(MeshVertex, position));
+    glEnableVertexAttribArray(normal_attrib);
+    glVertexAttribPointer(normal_attrib, 4, GL_INT_2_10_10_10_REV, true, sizeof(MeshVertex),
+                          (void*)offsetof(MeshVertex, normal));
+    glEnableVertexAttribArray(texcoord_attrib);
+    glVertexAttribPointer(texcoord_attrib, 2, GL_HALF_FLOAT, false, sizeof(MeshVertex),
+                          (void*)offsetof(MeshVertex, texcoord));
+}
@@ -0,0 +1,28 @@
+#ifndef MESH_BUFFERS_H
+#define MESH_BUFFERS_H
+
+#include <cstddef>
+#include <glad/glad.h>
+#include "mesh.h"
+
+// vertex and index buffers of an uploaded mesh
+typedef struct MeshBuffers {
+    GLuint vertex_buffer;
+    GLuint index_buffer;
+    GLenum index_type;      // GL_UNSIGNED_SHORT, or GL_UNSIGNED_INT for more than 65536 vertices
+    int num_vertices;
+    int num_indices;
+} MeshBuffers;
+
+// uploads 'indices' as they are (of 'index_type')
+void CreateMeshBuffers(const MeshVertex *vertices, size_t num_vertices, const void *indices, size_t num_indices,
+                       GLenum index_type, MeshBuffers *buffers);
+// uploads with 16-bit indices when the vertex count allows
+void CreateMeshBuffers(const MeshData& mesh, MeshBuffers *buffers);
+void ReleaseMeshBuffers(MeshBuffers *buffers);
+
+// points the attributes at MeshVertex data in the bound GL_ARRAY_BUFFER
+// (records into the bound vertex array)
+void SetMeshVertexFormat(GLuint position_attrib, GLuint normal_attrib, GLuint texcoord_attrib);
+
+#endif // MESH_BUFFERS_H
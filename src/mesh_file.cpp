@@ -0,0 +1,242 @@
+#include "mesh_file.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint64_t AlignOffset(uint64_t offset);
+static bool SectionFits(uint64_t offset, uint64_t count, uint64_t item_size, uint64_t file_size);
+static bool WriteSection(FILE *fp, uint64_t offset, const void *data, uint64_t size);
+static uint32_t MaxIndex(const void *indices, uint32_t index_size, uint64_t first, uint64_t count);
+
+bool MeshFileOpen(const char *filename, MeshFile *file)
+{
+    memset(file, 0, sizeof(MeshFile));
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: cannot open %s\n", filename);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MeshFileHeader))
+    {
+        fprintf(stderr, "Error: %s is not a mesh cache\n", filename);
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: cannot map %s\n", filename);
+        return false;
+    }
+    // the whole file is read front to back by the upload, start on it now
+#ifdef MADV_SEQUENTIAL
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_WILLNEED
+    madvise(map, (size_t)st.st_size, MADV_WILLNEED);
+#endif
+    file->map = map;
+    file->map_size = (size_t)st.st_size;
+
+    const MeshFileHeader& header = *(const MeshFileHeader*)map;
+    if (memcmp(header.magic, "MESH", 4) != 0 || header.version != MESH_FILE_VERSION ||
+        header.vertex_size != sizeof(MeshVertex) || (header.index_size != 2 && header.index_size != 4))
+    {
+        fprintf(stderr, "Error: %s is not a version %d mesh cache for this build\n", filename, MESH_FILE_VERSION);
+        MeshFileClose(file);
+        return false;
+    }
+    uint64_t size = file->map_size;
+    if (!SectionFits(header.vertex_offset, header.num_vertices, sizeof(MeshVertex), size) ||
+        !SectionFits(header.index_offset, header.num_indices, header.index_size, size) ||
+        header.num_vertices > UINT32_MAX || header.num_indices > INT32_MAX ||
+        (header.num_lods > 0 && !SectionFits(header.lod_offset, header.num_lods, sizeof(MeshLod), size)) ||
+        (header.num_meshlets > 0 &&
+         (!SectionFits(header.meshlet_offset, header.num_meshlets, sizeof(Meshlet), size) ||
+          !SectionFits(header.meshlet_vertex_offset, header.num_meshlet_vertices, sizeof(uint32_t), size) ||
+          !SectionFits(header.meshlet_triangle_offset, header.num_meshlet_triangles, 3, size))))
+    {
+        fprintf(stderr, "Error: %s is truncated\n", filename);
+        MeshFileClose(file);
+        return false;
+    }
+
+    const uint8_t *data = (const uint8_t*)map;
+    file->header = header;
+    file->vertices = (const MeshVertex*)(data + header.vertex_offset);
+    file->indices = data + header.index_offset;
+    if (header.num_lods > 0)
+    {
+        file->lods = (const MeshLod*)(data + header.lod_offset);
+    }
+    // the index values go to the gpu as they are, so each level's vertices
+    // must lie inside the vertex section; without levels of detail the
+    // whole mesh is the one level
+    MeshLod whole_mesh = {0, (uint32_t)header.num_indices, 0, 0.0f};
+    const MeshLod *lods = header.num_lods > 0 ? file->lods : &whole_mesh;
+    uint64_t num_lods = header.num_lods > 0 ? header.num_lods : 1;
+    for (uint64_t i = 0; i < num_lods; i++)
+    {
+        const MeshLod& lod = lods[i];
+        bool inside = (uint64_t)lod.first_index + lod.num_indices <= header.num_indices && lod.num_indices > 0 &&
+                      lod.base_vertex >= 0 && (uint64_t)lod.base_vertex < header.num_vertices;
+        if (!inside || (uint64_t)lod.base_vertex + MaxIndex(file->indices, header.index_size, lod.first_index,
+                                                            lod.num_indices) >= header.num_vertices)
+        {
+            fprintf(stderr, "Error: %s has a level of detail outside its mesh\n", filename);
+            MeshFileClose(file);
+            return false;
+        }
+    }
+    if (header.num_meshlets > 0)
+    {
+        file->meshlets = (const Meshlet*)(data + header.meshlet_offset);
+        file->meshlet_vertices = (const uint32_t*)(data + header.meshlet_vertex_offset);
+        file->meshlet_triangles = data + header.meshlet_triangle_offset;
+    }
+
+    return true;
+}
+
+void MeshFileClose(MeshFile *file)
+{
+    if (file->map != NULL)
+    {
+        munmap(file->map, file->map_size);
+    }
+    memset(file, 0, sizeof(MeshFile));
+}
+
+bool MeshFileWrite(const char *filename, const MeshData& mesh, const MeshletData *meshlets,
+                   const float fit_center[3], float fit_scale)
+{
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "MESH", 4);
+    header.version = MESH_FILE_VERSION;
+    header.vertex_size = sizeof(MeshVertex);
+    header.index_size = mesh.vertices.size() <= 65536 ? 2 : 4;
+    header.num_vertices = mesh.vertices.size();
+    header.num_indices = mesh.indices.size();
+    header.vertex_offset = AlignOffset(sizeof(MeshFileHeader));
+    header.index_offset = AlignOffset(header.vertex_offset + header.num_vertices * sizeof(MeshVertex));
+    uint64_t end = header.index_offset + header.num_indices * header.index_size;
+    if (!mesh.lods.empty())
+    {
+        header.num_lods = mesh.lods.size();
+        header.lod_offset = AlignOffset(end);
+        end = header.lod_offset + header.num_lods * sizeof(MeshLod);
+    }
+    if (meshlets != NULL && !meshlets->meshlets.empty())
+    {
+        header.num_meshlets = meshlets->meshlets.size();
+        header.num_meshlet_vertices = meshlets->vertices.size();
+        header.num_meshlet_triangles = meshlets->triangles.size() / 3;
+        header.meshlet_offset = AlignOffset(end);
+        header.meshlet_vertex_offset = AlignOffset(header.meshlet_offset + header.num_meshlets * sizeof(Meshlet));
+        header.meshlet_triangle_offset =
+            AlignOffset(header.meshlet_vertex_offset + header.num_meshlet_vertices * sizeof(uint32_t));
+    }
+    memcpy(header.bounds_min, mesh.bounds_min, sizeof(header.bounds_min));
+    memcpy(header.bounds_max, mesh.bounds_max, sizeof(header.bounds_max));
+    memcpy(header.fit_center, fit_center, sizeof(header.fit_center));
+    header.fit_scale = fit_scale;
+
+    FILE *fp = fopen(filename, "wb");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Error: cannot create %s\n", filename);
+        return false;
+    }
+
+    // indices are narrowed here once, so the renderer never has to
+    std::vector<uint16_t> short_indices;
+    const void *indices = mesh.indices.data();
+    if (header.index_size == 2)
+    {
+        short_indices.assign(mesh.indices.begin(), mesh.indices.end());
+        indices = short_indices.data();
+    }
+    bool ok = WriteSection(fp, 0, &header, sizeof(header)) &&
+              WriteSection(fp, header.vertex_offset, mesh.vertices.data(), header.num_vertices * sizeof(MeshVertex)) &&
+              WriteSection(fp, header.index_offset, indices, header.num_indices * header.index_size) &&
+              WriteSection(fp, header.lod_offset, mesh.lods.data(), header.num_lods * sizeof(MeshLod));
+    if (ok && header.num_meshlets > 0)
+    {
+        ok = WriteSection(fp, header.meshlet_offset, meshlets->meshlets.data(), header.num_meshlets * sizeof(Meshlet)) &&
+             WriteSection(fp, header.meshlet_vertex_offset, meshlets->vertices.data(),
+                          header.num_meshlet_vertices * sizeof(uint32_t)) &&
+             WriteSection(fp, header.meshlet_triangle_offset, meshlets->triangles.data(),
+                          header.num_meshlet_triangles * 3);
+    }
+    ok = fclose(fp) == 0 && ok;
+    if (!ok)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", filename);
+    }
+
+    return ok;
+}
+
+bool IsMeshCacheFile(const std::string& filename)
+{
+    return filename.size() > 5 && filename.compare(filename.size() - 5, 5, ".mesh") == 0;
+}
+
+
+// Auxillary functions
+uint64_t AlignOffset(uint64_t offset)
+{
+    return (offset + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+}
+
+bool SectionFits(uint64_t offset, uint64_t count, uint64_t item_size, uint64_t file_size)
+{
+    return offset % 4 == 0 && offset <= file_size && count <= (file_size - offset) / item_size;
+}
+
+bool WriteSection(FILE *fp, uint64_t offset, const void *data, uint64_t size)
+{
+    // zero padding up to the section's start
+    static const uint8_t zeros[MESH_FILE_ALIGNMENT] = {0};
+    uint64_t position = (uint64_t)ftello(fp);
+    while (position < offset)
+    {
+        size_t pad = offset - position < MESH_FILE_ALIGNMENT ? (size_t)(offset - position) : MESH_FILE_ALIGNMENT;
+        if (fwrite(zeros, 1, pad, fp) != pad)
+        {
+            return false;
+        }
+        position += pad;
+    }
+    return size == 0 || fwrite(data, 1, (size_t)size, fp) == size;
+}
+
+uint32_t MaxIndex(const void *indices, uint32_t index_size, uint64_t first, uint64_t count)
+{
+    uint32_t max_index = 0;
+    if (index_size == 2)
+    {
+        const uint16_t *p = (const uint16_t*)indices + first;
+        for (uint64_t i = 0; i < count; i++)
+        {
+            max_index = p[i] > max_index ? p[i] : max_index;
+        }
+    }
+    else
+    {
+        const uint32_t *p = (const uint32_t*)indices + first;
+        for (uint64_t i = 0; i < count; i++)
+        {
+            max_index = p[i] > max_index ? p[i] : max_index;
+        }
+    }
+    return max_index;
+}
@@ -0,0 +1,80 @@
+#ifndef MESH_FILE_H
+#define MESH_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "mesh.h"
+
+// On-disk layout of a binary mesh cache (.mesh), written by tools/meshbuild.
+//
+// A fixed-size header is followed by the sections, each starting on a
+// MESH_FILE_ALIGNMENT boundary:
+//   vertices            num_vertices MeshVertex records (see mesh.h)
+//   indices             num_indices of index_size bytes (2 when the mesh has
+//                       at most 65536 vertices, 4 otherwise)
+//   levels of detail    num_lods MeshLod records (see mesh_lod.h), ranges of
+//                       the vertices and indices above; absent when 0
+//   meshlets            num_meshlets Meshlet records, then their vertex
+//   meshlet vertices    (uint32) and triangle (3 x uint8) lists; all absent
+//   meshlet triangles   when num_meshlets is 0
+// Everything is stored exactly as the renderer uses it, in host byte order
+// (the magic reads wrong on the other kind of host), so a mapped file goes
+// straight to glBufferData with no parsing or conversion.
+//
+// Positions are fitted to -1..1 along the longest side (FitMesh) when the
+// file is written. fit_center and fit_scale recover the original
+// coordinates: original = position / fit_scale + fit_center.
+
+#define MESH_FILE_VERSION 2
+#define MESH_FILE_ALIGNMENT 4096
+
+typedef struct MeshFileHeader {
+    char magic[4];              // "MESH"
+    uint32_t version;
+    uint32_t vertex_size;       // sizeof(MeshVertex) when written
+    uint32_t index_size;
+    uint64_t num_vertices;
+    uint64_t num_indices;
+    uint64_t num_meshlets;
+    uint64_t num_meshlet_vertices;
+    uint64_t num_meshlet_triangles;
+    uint64_t num_lods;
+    uint64_t vertex_offset;     // section offsets from the start of the file
+    uint64_t index_offset;
+    uint64_t meshlet_offset;
+    uint64_t meshlet_vertex_offset;
+    uint64_t meshlet_triangle_offset;
+    uint64_t lod_offset;
+    float bounds_min[3];
+    float bounds_max[3];
+    float fit_center[3];
+    float fit_scale;
+} MeshFileHeader;
+
+// a mapped .mesh file; the pointers are into the mapping
+typedef struct MeshFile {
+    MeshFileHeader header;
+    const MeshVertex *vertices;
+    const void *indices;
+    const MeshLod *lods;                // NULL without levels of detail
+    const Meshlet *meshlets;            // NULL without meshlets
+    const uint32_t *meshlet_vertices;
+    const uint8_t *meshlet_triangles;
+    void *map;
+    size_t map_size;
+} MeshFile;
+
+// maps the file and checks the header, that every section lies inside it
+// and that every level of detail only indexes vertices of the mesh
+bool MeshFileOpen(const char *filename, MeshFile *file);
+void MeshFileClose(MeshFile *file);
+
+// 'meshlets' may be NULL
+bool MeshFileWrite(const char *filename, const MeshData& mesh, const MeshletData *meshlets,
+                   const float fit_center[3], float fit_scale);
+
+// .mesh
+bool IsMeshCacheFile(const std::string& filename);
+
+#endif // MESH_FILE_H
@@ -0,0 +1,1185 @@
+#include "mesh_loader.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define OBJ_ABSENT INT32_MIN
+
+enum PlyType : uint8_t { PlyInt8, PlyUint8, PlyInt16, PlyUint16, PlyInt32, PlyUint32, PlyFloat32, PlyFloat64, PlyNone };
+
+typedef struct MappedFile {
+    const uint8_t *data;
+    size_t size;
+    void *map;                  // NULL when read into 'copy' instead
+    std::vector<uint8_t> copy;
+} MappedFile;
+
+typedef struct ObjCorner {
+    int32_t v;                  // 0-based, or OBJ_ABSENT
+    int32_t vt;
+    int32_t vn;
+    uint32_t relative;          // bits 0-2: v, vt, vn count from the chunk's own start
+} ObjCorner;
+
+typedef struct ObjChunk {
+    const char *begin;
+    const char *end;
+    std::vector<float> positions;
+    std::vector<float> texcoords;
+    std::vector<float> normals;
+    std::vector<ObjCorner> corners;   // 3 per triangle
+    bool failed;
+} ObjChunk;
+
+typedef struct WeldSlot {
+    int32_t v;                  // -1: empty
+    int32_t vt;
+    int32_t vn;
+    uint32_t vertex;
+} WeldSlot;
+
+typedef struct PlyProperty {
+    std::string name;
+    PlyType type;               // item type for lists
+    PlyType count_type;         // PlyNone unless a list
+    size_t offset;              // in a fixed-size record
+} PlyProperty;
+
+typedef struct PlyElement {
+    std::string name;
+    int64_t count;
+    std::vector<PlyProperty> properties;
+    bool fixed_size;
+    size_t record_size;         // fixed-size records only
+    size_t min_record_size;     // a record whose lists are all empty
+} PlyElement;
+
+static bool MapFile(const char *filename, MappedFile *file);
+static void UnmapFile(MappedFile *file);
+static void ParallelFor(int num_threads, const std::function<void(int)>& body);
+static bool LoadObj(const char *filename, const MappedFile& file, int num_threads, MeshData *mesh);
+static void ParseObjChunk(ObjChunk *chunk);
+static bool ParseObjCorner(const char **p, const char *end, const ObjChunk& chunk, ObjCorner *corner);
+static bool ResolveObjIndex(int32_t *index, bool relative, size_t offset, size_t count);
+static void WeldObjCorners(const std::vector<ObjChunk>& chunks, std::vector<ObjCorner> *unique,
+                           std::vector<uint32_t> *indices);
+static uint32_t WeldHash(int32_t v, int32_t vt, int32_t vn);
+static bool LoadPly(const char *filename, const MappedFile& file, int num_threads, MeshData *mesh);
+static bool ParsePlyHeader(const MappedFile& file, std::vector<PlyElement> *elements, bool *swap, size_t *data_start,
+                           std::string *error);
+static PlyType PlyTypeFromName(const std::string& name);
+static size_t PlyTypeSize(PlyType type);
+static double PlyRead(const uint8_t *p, PlyType type, bool swap);
+static size_t PlyRecordSize(const PlyElement& element, const uint8_t *record, const uint8_t *end, bool swap,
+                            int list_property, const uint8_t **list, uint32_t *list_count);
+static int FindPlyProperty(const PlyElement& element, const char *name, const char *alt_name);
+static void SkipBlanks(const char **p, const char *end);
+static bool ParseFloat(const char **p, const char *end, float *value);
+static bool ParseInt(const char **p, const char *end, int64_t *value);
+static void ComputeNormals(const float *positions, size_t num_vertices, const std::vector<uint32_t>& indices,
+                           float *normals);
+static void PackVerticesParallel(const float *positions, const float *normals, const float *texcoords, size_t count,
+                                 int num_threads, MeshVertex *vertices);
+
+bool LoadMesh(const char *filename, int num_threads, MeshData *mesh)
+{
+    MappedFile file;
+    if (!MapFile(filename, &file))
+    {
+        fprintf(stderr, "Error: cannot read mesh %s\n", filename);
+        return false;
+    }
+
+    bool loaded;
+    std::string name = filename;
+    if (name.size() > 4 && (name.compare(name.size() - 4, 4, ".ply") == 0 ||
+                            name.compare(name.size() - 4, 4, ".PLY") == 0))
+    {
+        loaded = LoadPly(filename, file, num_threads > 0 ? num_threads : 1, mesh);
+    }
+    else
+    {
+        loaded = LoadObj(filename, file, num_threads > 0 ? num_threads : 1, mesh);
+    }
+    UnmapFile(&file);
+    if (loaded)
+    {
+        ComputeMeshBounds(mesh);
+    }
+
+    return loaded;
+}
+
+bool IsMeshFile(const std::string& filename)
+{
+    if (filename.size() <= 4)
+    {
+        return false;
+    }
+    std::string extension = filename.substr(filename.size() - 4);
+    return extension == ".obj" || extension == ".OBJ" || extension == ".ply" || extension == ".PLY";
+}
+
+
+// Auxillary functions
+bool MapFile(const char *filename, MappedFile *file)
+{
+    file->data = NULL;
+    file->size = 0;
+    file->map = NULL;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return false;
+    }
+    file->size = (size_t)st.st_size;
+    void *map = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED)
+    {
+#ifdef MADV_WILLNEED
+        madvise(map, file->size, MADV_WILLNEED);
+#endif
+        file->map = map;
+        file->data = (const uint8_t*)map;
+        close(fd);
+        return true;
+    }
+
+    // not mappable (a pipe, some network file systems): read it instead
+    file->copy.resize(file->size);
+    size_t done = 0;
+    while (done < file->size)
+    {
+        ssize_t n = read(fd, &file->copy[done], file->size - done);
+        if (n <= 0)
+        {
+            close(fd);
+            return false;
+        }
+        done += (size_t)n;
+    }
+    close(fd);
+    file->data = file->copy.data();
+    return true;
+}
+
+void UnmapFile(MappedFile *file)
+{
+    if (file->map != NULL)
+    {
+        munmap(file->map, file->size);
+        file->map = NULL;
+    }
+    file->copy.clear();
+}
+
+void ParallelFor(int num_threads, const std::function<void(int)>& body)
+{
+    std::vector<std::thread> threads;
+    for (int t = 1; t < num_threads; t++)
+    {
+        threads.push_back(std::thread(body, t));
+    }
+    body(0);
+    for (size_t t = 0; t < threads.size(); t++)
+    {
+        threads[t].join();
+    }
+}
+
+bool LoadObj(const char *filename, const MappedFile& file, int num_threads, MeshData *mesh)
+{
+    // chunks start at the first line starting at or after an even split
+    const char *text = (const char*)file.data;
+    const char *text_end = text + file.size;
+    if (file.size < (size_t)num_threads * 4096)
+    {
+        num_threads = 1;
+    }
+    std::vector<ObjChunk> chunks(num_threads);
+    const char *begin = text;
+    for (int t = 0; t < num_threads; t++)
+    {
+        const char *end = t == num_threads - 1 ? text_end : text + file.size / num_threads * (t + 1);
+        if (end < begin)
+        {
+            end = begin;
+        }
+        while (end < text_end && end > text && end[-1] != '\n')
+        {
+            end++;
+        }
+        chunks[t].begin = begin;
+        chunks[t].end = end;
+        chunks[t].failed = false;
+        begin = end;
+    }
+    ParallelFor(num_threads, [&chunks](int t) { ParseObjChunk(&chunks[t]); });
+
+    // chunk offsets turn chunk-relative indices into file-wide ones
+    size_t num_v = 0, num_vt = 0, num_vn = 0;
+    std::vector<size_t> v_offsets(num_threads), vt_offsets(num_threads), vn_offsets(num_threads);
+    for (int t = 0; t < num_threads; t++)
+    {
+        if (chunks[t].failed)
+        {
+            fprintf(stderr, "Error: %s is not a valid OBJ file\n", filename);
+            return false;
+        }
+        v_offsets[t] = num_v;
+        vt_offsets[t] = num_vt;
+        vn_offsets[t] = num_vn;
+        num_v += chunks[t].positions.size() / 3;
+        num_vt += chunks[t].texcoords.size() / 2;
+        num_vn += chunks[t].normals.size() / 3;
+    }
+    std::vector<char> valid(num_threads, 1);
+    ParallelFor(num_threads, [&](int t) {
+        std::vector<ObjCorner>& corners = chunks[t].corners;
+        for (size_t i = 0; i < corners.size(); i++)
+        {
+            ObjCorner& c = corners[i];
+            if (!ResolveObjIndex(&c.v, (c.relative & 1) != 0, v_offsets[t], num_v) || c.v == OBJ_ABSENT ||
+                !ResolveObjIndex(&c.vt, (c.relative & 2) != 0, vt_offsets[t], num_vt) ||
+                !ResolveObjIndex(&c.vn, (c.relative & 4) != 0, vn_offsets[t], num_vn))
+            {
+                valid[t] = 0;
+                return;
+            }
+        }
+    });
+    for (int t = 0; t < num_threads; t++)
+    {
+        if (!valid[t])
+        {
+            fprintf(stderr, "Error: %s has a face index out of range\n", filename);
+            return false;
+        }
+    }
+
+    // gather the file-wide attribute lists
+    std::vector<float> positions(num_v * 3), texcoords(num_vt * 2), normals(num_vn * 3);
+    for (int t = 0; t < num_threads; t++)
+    {
+        std::copy(chunks[t].positions.begin(), chunks[t].positions.end(), positions.begin() + v_offsets[t] * 3);
+        std::copy(chunks[t].texcoords.begin(), chunks[t].texcoords.end(), texcoords.begin() + vt_offsets[t] * 2);
+        std::copy(chunks[t].normals.begin(), chunks[t].normals.end(), normals.begin() + vn_offsets[t] * 3);
+    }
+
+    std::vector<ObjCorner> unique;
+    WeldObjCorners(chunks, &unique, &mesh->indices);
+    chunks.clear();
+    if (mesh->indices.empty())
+    {
+        fprintf(stderr, "Error: %s has no faces with three or more corners\n", filename);
+        return false;
+    }
+
+    size_t num_vertices = unique.size();
+    std::vector<float> vertex_positions(num_vertices * 3);
+    std::vector<float> vertex_texcoords(num_vt > 0 ? num_vertices * 2 : 0, 0.0f);
+    std::vector<float> vertex_normals(num_vertices * 3, 0.0f);
+    for (size_t i = 0; i < num_vertices; i++)
+    {
+        const ObjCorner& c = unique[i];
+        memcpy(&vertex_positions[i * 3], &positions[(size_t)c.v * 3], 3 * sizeof(float));
+        if (c.vt != OBJ_ABSENT)
+        {
+            memcpy(&vertex_texcoords[i * 2], &texcoords[(size_t)c.vt * 2], 2 * sizeof(float));
+        }
+        if (c.vn != OBJ_ABSENT)
+        {
+            memcpy(&vertex_normals[i * 3], &normals[(size_t)c.vn * 3], 3 * sizeof(float));
+        }
+        else
+        {
+            vertex_normals[i * 3 + 2] = 1.0f;
+        }
+    }
+    if (num_vn == 0)
+    {
+        ComputeNormals(vertex_positions.data(), num_vertices, mesh->indices, vertex_normals.data());
+    }
+
+    mesh->vertices.resize(num_vertices);
+    PackVerticesParallel(vertex_positions.data(), vertex_normals.data(),
+                         num_vt > 0 ? vertex_texcoords.data() : NULL, num_vertices, num_threads,
+                         mesh->vertices.data());
+    return true;
+}
+
+void ParseObjChunk(ObjChunk *chunk)
+{
+    const char *p = chunk->begin;
+    const char *end = chunk->end;
+    std::vector<ObjCorner> polygon;
+    while (p < end && !chunk->failed)
+    {
+        SkipBlanks(&p, end);
+        // each tag is only looked at once the blank after it is known to be
+        // inside the chunk, so a file ending mid-tag never reads past it
+        bool blank_after_1 = p + 1 < end && (p[1] == ' ' || p[1] == '\t');
+        bool blank_after_2 = p + 2 < end && (p[2] == ' ' || p[2] == '\t');
+        if (blank_after_1 && p[0] == 'v')
+        {
+            // a fourth value (w, or the start of a vertex color) is ignored
+            p += 2;
+            float xyz[3];
+            for (int a = 0; a < 3; a++)
+            {
+                SkipBlanks(&p, end);
+                chunk->failed |= !ParseFloat(&p, end, &xyz[a]);
+            }
+            chunk->positions.insert(chunk->positions.end(), xyz, xyz + 3);
+        }
+        else if (blank_after_2 && p[0] == 'v' && p[1] == 't')
+        {
+            p += 3;
+            float uv[2] = {0.0f, 0.0f};
+            SkipBlanks(&p, end);
+            chunk->failed |= !ParseFloat(&p, end, &uv[0]);
+            SkipBlanks(&p, end);
+            if (p < end && *p != '\n' && *p != '\r')
+            {
+                chunk->failed |= !ParseFloat(&p, end, &uv[1]);
+            }
+            chunk->texcoords.insert(chunk->texcoords.end(), uv, uv + 2);
+        }
+        else if (blank_after_2 && p[0] == 'v' && p[1] == 'n')
+        {
+            p += 3;
+            float xyz[3];
+            for (int a = 0; a < 3; a++)
+            {
+                SkipBlanks(&p, end);
+                chunk->failed |= !ParseFloat(&p, end, &xyz[a]);
+            }
+            chunk->normals.insert(chunk->normals.end(), xyz, xyz + 3);
+        }
+        else if (blank_after_1 && p[0] == 'f')
+        {
+            p += 2;
+            polygon.clear();
+            for (;;)
+            {
+                SkipBlanks(&p, end);
+                if (p >= end || *p == '\n' || *p == '\r' || *p == '#')
+                {
+                    break;
+                }
+                ObjCorner corner;
+                if (!ParseObjCorner(&p, end, *chunk, &corner))
+                {
+                    chunk->failed = true;
+                    break;
+                }
+                polygon.push_back(corner);
+            }
+            // polygons are fanned out from their first corner
+            for (size_t i = 2; i < polygon.size(); i++)
+            {
+                chunk->corners.push_back(polygon[0]);
+                chunk->corners.push_back(polygon[i - 1]);
+                chunk->corners.push_back(polygon[i]);
+            }
+        }
+
+        // anything else (comments, groups, materials, lines, the rest of
+        // this line) is skipped
+        while (p < end && *p != '\n')
+        {
+            p++;
+        }
+        p++;
+    }
+}
+
+bool ParseObjCorner(const char **p, const char *end, const ObjChunk& chunk, ObjCorner *corner)
+{
+    // v, v/vt, v//vn or v/vt/vn, 1-based, or negative to count back from
+    // the last one defined so far
+    int64_t values[3];
+    bool present[3] = {false, false, false};
+    for (int k = 0; k < 3; k++)
+    {
+        if (k > 0)
+        {
+            if (*p >= end || **p != '/')
+            {
+                break;
+            }
+            (*p)++;
+            if (*p < end && **p == '/')
+            {
+                continue;
+            }
+        }
+        if (!ParseInt(p, end, &values[k]) || values[k] == 0)
+        {
+            return false;
+        }
+        present[k] = true;
+    }
+    if (!present[0])
+    {
+        return false;
+    }
+
+    size_t counts[3] = {chunk.positions.size() / 3, chunk.texcoords.size() / 2, chunk.normals.size() / 3};
+    int32_t *indices[3] = {&corner->v, &corner->vt, &corner->vn};
+    corner->relative = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        if (!present[k])
+        {
+            *indices[k] = OBJ_ABSENT;
+        }
+        else if (values[k] > 0)
+        {
+            if (values[k] > INT32_MAX)
+            {
+                return false;
+            }
+            *indices[k] = (int32_t)(values[k] - 1);
+        }
+        else
+        {
+            // chunk-relative until the counts of earlier chunks are known
+            int64_t local = (int64_t)counts[k] + values[k];
+            if (local < INT32_MIN + 1)
+            {
+                return false;
+            }
+            *indices[k] = (int32_t)local;
+            corner->relative |= 1u << k;
+        }
+    }
+    return true;
+}
+
+bool ResolveObjIndex(int32_t *index, bool relative, size_t offset, size_t count)
+{
+    if (*index == OBJ_ABSENT)
+    {
+        return true;
+    }
+    int64_t resolved = relative ? (int64_t)offset + *index : *index;
+    if (resolved < 0 || resolved >= (int64_t)count)
+    {
+        return false;
+    }
+    *index = (int32_t)resolved;
+    return true;
+}
+
+void WeldObjCorners(const std::vector<ObjChunk>& chunks, std::vector<ObjCorner> *unique,
+                    std::vector<uint32_t> *indices)
+{
+    size_t num_corners = 0;
+    size_t num_positions = 0;
+    bool positions_only = true;
+    for (size_t t = 0; t < chunks.size(); t++)
+    {
+        num_corners += chunks[t].corners.size();
+        num_positions += chunks[t].positions.size() / 3;
+        positions_only = positions_only && chunks[t].texcoords.empty() && chunks[t].normals.empty();
+    }
+    indices->resize(num_corners);
+    unique->clear();
+
+    // corners that are only positions already name a unique vertex
+    if (positions_only)
+    {
+        unique->resize(num_positions);
+        for (size_t i = 0; i < num_positions; i++)
+        {
+            (*unique)[i].v = (int32_t)i;
+            (*unique)[i].vt = OBJ_ABSENT;
+            (*unique)[i].vn = OBJ_ABSENT;
+        }
+        size_t n = 0;
+        for (size_t t = 0; t < chunks.size(); t++)
+        {
+            for (size_t i = 0; i < chunks[t].corners.size(); i++)
+            {
+                (*indices)[n++] = (uint32_t)chunks[t].corners[i].v;
+            }
+        }
+        return;
+    }
+
+    // open addressing, kept under half full; most meshes have about as many
+    // vertices as positions, so that's the starting size
+    size_t capacity = 1024;
+    while (capacity < num_positions * 2)
+    {
+        capacity *= 2;
+    }
+    std::vector<WeldSlot> slots(capacity);
+    for (size_t i = 0; i < capacity; i++)
+    {
+        slots[i].v = -1;
+    }
+    size_t n = 0;
+    for (size_t t = 0; t < chunks.size(); t++)
+    {
+        const std::vector<ObjCorner>& corners = chunks[t].corners;
+        for (size_t i = 0; i < corners.size(); i++)
+        {
+            const ObjCorner& c = corners[i];
+            size_t mask = capacity - 1;
+            size_t slot = WeldHash(c.v, c.vt, c.vn) & mask;
+            while (slots[slot].v >= 0 && (slots[slot].v != c.v || slots[slot].vt != c.vt || slots[slot].vn != c.vn))
+            {
+                slot = (slot + 1) & mask;
+            }
+            if (slots[slot].v < 0)
+            {
+                slots[slot].v = c.v;
+                slots[slot].vt = c.vt;
+                slots[slot].vn = c.vn;
+                slots[slot].vertex = (uint32_t)unique->size();
+                unique->push_back(c);
+                if (unique->size() * 2 > capacity)
+                {
+                    // grow: reinsert everything into a table twice the size
+                    capacity *= 2;
+                    mask = capacity - 1;
+                    std::vector<WeldSlot> grown(capacity);
+                    for (size_t k = 0; k < capacity; k++)
+                    {
+                        grown[k].v = -1;
+                    }
+                    for (size_t k = 0; k < slots.size(); k++)
+                    {
+                        if (slots[k].v >= 0)
+                        {
+                            size_t s = WeldHash(slots[k].v, slots[k].vt, slots[k].vn) & mask;
+                            while (grown[s].v >= 0)
+                            {
+                                s = (s + 1) & mask;
+                            }
+                            grown[s] = slots[k];
+                        }
+                    }
+                    slots.swap(grown);
+                    (*indices)[n++] = (uint32_t)(unique->size() - 1);
+                    continue;
+                }
+            }
+            (*indices)[n++] = slots[slot].vertex;
+        }
+    }
+}
+
+uint32_t WeldHash(int32_t v, int32_t vt, int32_t vn)
+{
+    uint32_t h = (uint32_t)v * 0x9e3779b1u ^ (uint32_t)vt * 0x85ebca77u ^ (uint32_t)vn * 0xc2b2ae3du;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+
+bool LoadPly(const char *filename, const MappedFile& file, int num_threads, MeshData *mesh)
+{
+    std::vector<PlyElement> elements;
+    bool swap;
+    size_t offset;
+    std::string error;
+    if (!ParsePlyHeader(file, &elements, &swap, &offset, &error))
+    {
+        fprintf(stderr, "Error: %s: %s\n", filename, error.c_str());
+        return false;
+    }
+
+    std::vector<float> positions, normals, texcoords;
+    size_t num_vertices = 0;
+    bool have_vertices = false, have_faces = false;
+    const uint8_t *file_end = file.data + file.size;
+    for (size_t e = 0; e < elements.size() && !(have_vertices && have_faces); e++)
+    {
+        const PlyElement& element = elements[e];
+        // a count the rest of the file can't hold is rejected before it is
+        // multiplied by anything or used to size an allocation
+        if (element.min_record_size > 0 && (uint64_t)element.count > (file.size - offset) / element.min_record_size)
+        {
+            fprintf(stderr, "Error: %s is truncated\n", filename);
+            return false;
+        }
+        if (element.name == "vertex")
+        {
+            int x = FindPlyProperty(element, "x", NULL);
+            int y = FindPlyProperty(element, "y", NULL);
+            int z = FindPlyProperty(element, "z", NULL);
+            int nx = FindPlyProperty(element, "nx", NULL);
+            int ny = FindPlyProperty(element, "ny", NULL);
+            int nz = FindPlyProperty(element, "nz", NULL);
+            int u = FindPlyProperty(element, "u", "s");
+            int v = FindPlyProperty(element, "v", "t");
+            if (u < 0 || v < 0)
+            {
+                u = FindPlyProperty(element, "texture_u", "texture_s");
+                v = FindPlyProperty(element, "texture_v", "texture_t");
+            }
+            if (!element.fixed_size || x < 0 || y < 0 || z < 0)
+            {
+                fprintf(stderr, "Error: %s: vertices need x, y and z and no list properties\n", filename);
+                return false;
+            }
+            bool has_normals = nx >= 0 && ny >= 0 && nz >= 0;
+            bool has_texcoords = u >= 0 && v >= 0;
+            num_vertices = (size_t)element.count;
+            positions.resize(num_vertices * 3);
+            normals.assign(has_normals ? num_vertices * 3 : 0, 0.0f);
+            texcoords.assign(has_texcoords ? num_vertices * 2 : 0, 0.0f);
+
+            // fixed-size records: each thread converts its own range
+            const uint8_t *records = file.data + offset;
+            ParallelFor(num_threads, [&](int t) {
+                size_t first = num_vertices * t / num_threads;
+                size_t last = num_vertices * (t + 1) / num_threads;
+                const std::vector<PlyProperty>& props = element.properties;
+                for (size_t i = first; i < last; i++)
+                {
+                    const uint8_t *record = records + i * element.record_size;
+                    positions[i * 3 + 0] = (float)PlyRead(record + props[x].offset, props[x].type, swap);
+                    positions[i * 3 + 1] = (float)PlyRead(record + props[y].offset, props[y].type, swap);
+                    positions[i * 3 + 2] = (float)PlyRead(record + props[z].offset, props[z].type, swap);
+                    if (has_normals)
+                    {
+                        normals[i * 3 + 0] = (float)PlyRead(record + props[nx].offset, props[nx].type, swap);
+                        normals[i * 3 + 1] = (float)PlyRead(record + props[ny].offset, props[ny].type, swap);
+                        normals[i * 3 + 2] = (float)PlyRead(record + props[nz].offset, props[nz].type, swap);
+                    }
+                    if (has_texcoords)
+                    {
+                        texcoords[i * 2 + 0] = (float)PlyRead(record + props[u].offset, props[u].type, swap);
+                        texcoords[i * 2 + 1] = (float)PlyRead(record + props[v].offset, props[v].type, swap);
+                    }
+                }
+            });
+            offset += num_vertices * element.record_size;
+            have_vertices = true;
+        }
+        else if (element.name == "face" && have_vertices)
+        {
+            int list = FindPlyProperty(element, "vertex_indices", "vertex_index");
+            if (list < 0 || element.properties[list].count_type == PlyNone)
+            {
+                fprintf(stderr, "Error: %s: faces have no vertex_indices list\n", filename);
+                return false;
+            }
+            PlyType index_type = element.properties[list].type;
+            size_t index_size = PlyTypeSize(index_type);
+
+            // records vary in size, so one pass finds where each thread's
+            // share starts and how many triangles come before it
+            std::vector<size_t> chunk_offsets(num_threads + 1), chunk_triangles(num_threads + 1);
+            size_t num_triangles = 0;
+            int chunk = 0;
+            for (int64_t r = 0; r <= element.count; r++)
+            {
+                while (chunk <= num_threads && r == element.count * chunk / num_threads)
+                {
+                    chunk_offsets[chunk] = offset;
+                    chunk_triangles[chunk] = num_triangles;
+                    chunk++;
+                }
+                if (r == element.count)
+                {
+                    break;
+                }
+                const uint8_t *indices;
+                uint32_t count = 0;
+                size_t size = PlyRecordSize(element, file.data + offset, file_end, swap, list, &indices, &count);
+                if (size == 0)
+                {
+                    fprintf(stderr, "Error: %s is truncated\n", filename);
+                    return false;
+                }
+                num_triangles += count > 2 ? count - 2 : 0;
+                offset += size;
+            }
+
+            mesh->indices.resize(num_triangles * 3);
+            std::vector<char> valid(num_threads, 1);
+            ParallelFor(num_threads, [&](int t) {
+                size_t record_offset = chunk_offsets[t];
+                uint32_t *out = mesh->indices.data() + chunk_triangles[t] * 3;
+                int64_t first = element.count * t / num_threads;
+                int64_t last = element.count * (t + 1) / num_threads;
+                for (int64_t r = first; r < last; r++)
+                {
+                    const uint8_t *indices;
+                    uint32_t count = 0;
+                    record_offset += PlyRecordSize(element, file.data + record_offset, file_end, swap, list,
+                                                   &indices, &count);
+                    double first_index = count > 0 ? PlyRead(indices, index_type, swap) : 0.0;
+                    for (uint32_t k = 2; k < count; k++)
+                    {
+                        double previous = PlyRead(indices + (k - 1) * index_size, index_type, swap);
+                        double current = PlyRead(indices + k * index_size, index_type, swap);
+                        // written so that NaN float indices fail too
+                        if (!(first_index >= 0 && previous >= 0 && current >= 0 && first_index < num_vertices &&
+                              previous < num_vertices && current < num_vertices))
+                        {
+                            valid[t] = 0;
+                            return;
+                        }
+                        *out++ = (uint32_t)first_index;
+                        *out++ = (uint32_t)previous;
+                        *out++ = (uint32_t)current;
+                    }
+                }
+            });
+            for (int t = 0; t < num_threads; t++)
+            {
+                if (!valid[t])
+                {
+                    fprintf(stderr, "Error: %s has a face index out of range\n", filename);
+                    return false;
+                }
+            }
+            have_faces = true;
+        }
+        else
+        {
+            // some other element: step over it
+            if (element.fixed_size)
+            {
+                offset += (size_t)element.count * element.record_size;
+            }
+            else
+            {
+                for (int64_t r = 0; r < element.count; r++)
+                {
+                    const uint8_t *list;
+                    uint32_t count;
+                    size_t size = PlyRecordSize(element, file.data + offset, file_end, swap, -1, &list, &count);
+                    if (size == 0)
+                    {
+                        break;
+                    }
+                    offset += size;
+                }
+            }
+            if (offset > file.size)
+            {
+                fprintf(stderr, "Error: %s is truncated\n", filename);
+                return false;
+            }
+        }
+    }
+    if (!have_vertices || !have_faces)
+    {
+        fprintf(stderr, "Error: %s has no vertex or face element\n", filename);
+        return false;
+    }
+
+    if (normals.empty())
+    {
+        normals.resize(num_vertices * 3);
+        ComputeNormals(positions.data(), num_vertices, mesh->indices, normals.data());
+    }
+    mesh->vertices.resize(num_vertices);
+    PackVerticesParallel(positions.data(), normals.data(), texcoords.empty() ? NULL : texcoords.data(), num_vertices,
+                         num_threads, mesh->vertices.data());
+    return true;
+}
+
+bool ParsePlyHeader(const MappedFile& file, std::vector<PlyElement> *elements, bool *swap, size_t *data_start,
+                    std::string *error)
+{
+    const char *text = (const char*)file.data;
+    size_t pos = 0;
+    bool format_known = false;
+    bool big_endian = false;
+    bool first_line = true;
+    for (;;)
+    {
+        size_t line_end = pos;
+        while (line_end < file.size && text[line_end] != '\n')
+        {
+            line_end++;
+        }
+        if (line_end == file.size)
+        {
+            *error = "no end_header in the PLY header";
+            return false;
+        }
+        std::string line(text + pos, line_end - pos);
+        if (!line.empty() && line[line.size() - 1] == '\r')
+        {
+            line.resize(line.size() - 1);
+        }
+        pos = line_end + 1;
+
+        std::vector<std::string> tokens;
+        size_t start = 0;
+        while (start < line.size())
+        {
+            size_t stop = line.find_first_of(" \t", start);
+            if (stop == std::string::npos)
+            {
+                stop = line.size();
+            }
+            if (stop > start)
+            {
+                tokens.push_back(line.substr(start, stop - start));
+            }
+            start = stop + 1;
+        }
+
+        if (first_line)
+        {
+            if (tokens.size() != 1 || tokens[0] != "ply")
+            {
+                *error = "not a PLY file";
+                return false;
+            }
+            first_line = false;
+        }
+        else if (tokens.empty() || tokens[0] == "comment" || tokens[0] == "obj_info")
+        {
+            continue;
+        }
+        else if (tokens[0] == "format" && tokens.size() >= 2)
+        {
+            if (tokens[1] == "ascii")
+            {
+                *error = "ASCII PLY files aren't supported, only binary ones";
+                return false;
+            }
+            big_endian = tokens[1] == "binary_big_endian";
+            format_known = big_endian || tokens[1] == "binary_little_endian";
+        }
+        else if (tokens[0] == "element" && tokens.size() == 3)
+        {
+            PlyElement element;
+            element.name = tokens[1];
+            element.count = atoll(tokens[2].c_str());
+            element.fixed_size = true;
+            element.record_size = 0;
+            element.min_record_size = 0;
+            if (element.count < 0)
+            {
+                *error = "negative element count";
+                return false;
+            }
+            elements->push_back(element);
+        }
+        else if (tokens[0] == "property" && !elements->empty())
+        {
+            PlyElement& element = elements->back();
+            PlyProperty property;
+            property.offset = element.record_size;
+            if (tokens.size() == 5 && tokens[1] == "list")
+            {
+                property.count_type = PlyTypeFromName(tokens[2]);
+                property.type = PlyTypeFromName(tokens[3]);
+                property.name = tokens[4];
+                element.fixed_size = false;
+                element.min_record_size += PlyTypeSize(property.count_type);
+                if (property.count_type == PlyNone || property.count_type == PlyFloat32 ||
+                    property.count_type == PlyFloat64)
+                {
+                    *error = "bad list count type " + tokens[2];
+                    return false;
+                }
+            }
+            else if (tokens.size() == 3)
+            {
+                property.count_type = PlyNone;
+                property.type = PlyTypeFromName(tokens[1]);
+                property.name = tokens[2];
+                element.record_size += PlyTypeSize(property.type);
+                element.min_record_size += PlyTypeSize(property.type);
+            }
+            else
+            {
+                *error = "bad property line '" + line + "'";
+                return false;
+            }
+            if (property.type == PlyNone)
+            {
+                *error = "unknown property type in '" + line + "'";
+                return false;
+            }
+            element.properties.push_back(property);
+        }
+        else if (tokens[0] == "end_header")
+        {
+            break;
+        }
+    }
+    if (!format_known)
+    {
+        *error = "unknown PLY format";
+        return false;
+    }
+
+    uint16_t probe = 1;
+    bool host_big_endian = *(uint8_t*)&probe == 0;
+    *swap = big_endian != host_big_endian;
+    *data_start = pos;
+    return true;
+}
+
+PlyType PlyTypeFromName(const std::string& name)
+{
+    if (name == "char" || name == "int8") return PlyInt8;
+    if (name == "uchar" || name == "uint8") return PlyUint8;
+    if (name == "short" || name == "int16") return PlyInt16;
+    if (name == "ushort" || name == "uint16") return PlyUint16;
+    if (name == "int" || name == "int32") return PlyInt32;
+    if (name == "uint" || name == "uint32") return PlyUint32;
+    if (name == "float" || name == "float32") return PlyFloat32;
+    if (name == "double" || name == "float64") return PlyFloat64;
+    return PlyNone;
+}
+
+size_t PlyTypeSize(PlyType type)
+{
+    static const size_t sizes[9] = {1, 1, 2, 2, 4, 4, 4, 8, 0};
+    return sizes[type];
+}
+
+double PlyRead(const uint8_t *p, PlyType type, bool swap)
+{
+    uint8_t bytes[8];
+    size_t size = PlyTypeSize(type);
+    for (size_t i = 0; i < size; i++)
+    {
+        bytes[i] = swap ? p[size - 1 - i] : p[i];
+    }
+    switch (type)
+    {
+        case PlyInt8:    { int8_t v; memcpy(&v, bytes, 1); return v; }
+        case PlyUint8:   { uint8_t v; memcpy(&v, bytes, 1); return v; }
+        case PlyInt16:   { int16_t v; memcpy(&v, bytes, 2); return v; }
+        case PlyUint16:  { uint16_t v; memcpy(&v, bytes, 2); return v; }
+        case PlyInt32:   { int32_t v; memcpy(&v, bytes, 4); return v; }
+        case PlyUint32:  { uint32_t v; memcpy(&v, bytes, 4); return v; }
+        case PlyFloat32: { float v; memcpy(&v, bytes, 4); return v; }
+        case PlyFloat64: { double v; memcpy(&v, bytes, 8); return v; }
+        default:         return 0.0;
+    }
+}
+
+size_t PlyRecordSize(const PlyElement& element, const uint8_t *record, const uint8_t *end, bool swap,
+                     int list_property, const uint8_t **list, uint32_t *list_count)
+{
+    // 0 if the record runs past the end of the file
+    const uint8_t *p = record;
+    for (size_t i = 0; i < element.properties.size(); i++)
+    {
+        const PlyProperty& property = element.properties[i];
+        if (property.count_type == PlyNone)
+        {
+            p += PlyTypeSize(property.type);
+            continue;
+        }
+        size_t count_size = PlyTypeSize(property.count_type);
+        if (p + count_size > end)
+        {
+            return 0;
+        }
+        double count = PlyRead(p, property.count_type, swap);
+        p += count_size;
+        if (count < 0 || count * PlyTypeSize(property.type) > (double)(end - p))
+        {
+            return 0;
+        }
+        if ((int)i == list_property)
+        {
+            *list = p;
+            *list_count = (uint32_t)count;
+        }
+        p += (size_t)count * PlyTypeSize(property.type);
+    }
+    return p > end ? 0 : (size_t)(p - record);
+}
+
+int FindPlyProperty(const PlyElement& element, const char *name, const char *alt_name)
+{
+    for (size_t i = 0; i < element.properties.size(); i++)
+    {
+        if (element.properties[i].name == name || (alt_name != NULL && element.properties[i].name == alt_name))
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+void SkipBlanks(const char **p, const char *end)
+{
+    while (*p < end && (**p == ' ' || **p == '\t'))
+    {
+        (*p)++;
+    }
+}
+
+bool ParseFloat(const char **p, const char *end, float *value)
+{
+    // [sign] digits [. digits] [e [sign] digits]; much faster than strtof,
+    // and independent of the locale
+    static const double powers[23] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const char *s = *p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+    {
+        negative = *s == '-';
+        s++;
+    }
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    while (s < end && *s >= '0' && *s <= '9')
+    {
+        if (mantissa < 100000000000000000ull)
+        {
+            mantissa = mantissa * 10 + (*s - '0');
+        }
+        else
+        {
+            exponent++;
+        }
+        s++;
+        digits++;
+    }
+    if (s < end && *s == '.')
+    {
+        s++;
+        while (s < end && *s >= '0' && *s <= '9')
+        {
+            if (mantissa < 100000000000000000ull)
+            {
+                mantissa = mantissa * 10 + (*s - '0');
+                exponent--;
+            }
+            s++;
+            digits++;
+        }
+    }
+    if (digits == 0)
+    {
+        return false;
+    }
+    if (s < end && (*s == 'e' || *s == 'E'))
+    {
+        s++;
+        int64_t e;
+        if (!ParseInt(&s, end, &e))
+        {
+            return false;
+        }
+        exponent += (int)(e > 1000 ? 1000 : (e < -1000 ? -1000 : e));
+    }
+
+    double result = (double)mantissa;
+    if (exponent < 0)
+    {
+        result = exponent >= -22 ? result / powers[-exponent] : result * pow(10.0, exponent);
+    }
+    else if (exponent > 0)
+    {
+        result = exponent <= 22 ? result * powers[exponent] : result * pow(10.0, exponent);
+    }
+    *value = (float)(negative ? -result : result);
+    *p = s;
+    return true;
+}
+
+bool ParseInt(const char **p, const char *end, int64_t *value)
+{
+    const char *s = *p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+    {
+        negative = *s == '-';
+        s++;
+    }
+    if (s >= end || *s < '0' || *s > '9')
+    {
+        return false;
+    }
+    int64_t result = 0;
+    while (s < end && *s >= '0' && *s <= '9')
+    {
+        if (result < 100000000000000000ll)
+        {
+            result = result * 10 + (*s - '0');
+        }
+        s++;
+    }
+    *value = negative ? -result : result;
+    *p = s;
+    return true;
+}
+
+void ComputeNormals(const float *positions, size_t num_vertices, const std::vector<uint32_t>& indices,
+                    float *normals)
+{
+    // sum of the (area-weighted) normals of the faces around each vertex
+    memset(normals, 0, num_vertices * 3 * sizeof(float));
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        const float *a = &positions[(size_t)indices[i] * 3];
+        const float *b = &positions[(size_t)indices[i + 1] * 3];
+        const float *c = &positions[(size_t)indices[i + 2] * 3];
+        float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+        float ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+        float n[3] = {ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0]};
+        for (int k = 0; k < 3; k++)
+        {
+            float *vertex_normal = &normals[(size_t)indices[i + k] * 3];
+            vertex_normal[0] += n[0];
+            vertex_normal[1] += n[1];
+            vertex_normal[2] += n[2];
+        }
+    }
+    for (size_t i = 0; i < num_vertices; i++)
+    {
+        float *n = &normals[i * 3];
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 0.0f)
+        {
+            n[0] /= length;
+            n[1] /= length;
+            n[2] /= length;
+        }
+        else
+        {
+            n[2] = 1.0f;
+        }
+    }
+}
+
+void PackVerticesParallel(const float *positions, const float *normals, const float *texcoords, size_t count,
+                          int num_threads, MeshVertex *vertices)
+{
+    ParallelFor(num_threads, [&](int t) {
+        size_t first = count * t / num_threads;
+        size_t last = count * (t + 1) / num_threads;
+        PackMeshVertices(positions + first * 3, normals != NULL ? normals + first * 3 : NULL,
+                         texcoords != NULL ? texcoords + first * 2 : NULL, last - first, vertices + first);
+    });
+}
@@ -0,0 +1,30 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "mesh.h"
+
+// Loader for Wavefront .obj and binary .ply meshes.
+//
+// The file is memory-mapped and cut into one chunk per thread. OBJ chunks
+// start at line boundaries; each thread parses its lines into its own
+// position, texcoord and normal lists and fan-triangulated face corners,
+// and relative (negative) indices are resolved once every chunk's counts
+// are known. Corners are then welded into unique vertices with a hash map
+// keyed on their (position, texcoord, normal) indices. PLY vertex records
+// have a fixed size, so threads convert ranges of them directly; face
+// records are located with one quick scan of their vertex counts and then
+// triangulated in parallel. Meshes without normals get area-weighted vertex
+// normals. Materials, groups and any other PLY properties are ignored.
+//
+// Indices are 32-bit in MeshData; CreateMeshBuffers narrows them to 16 bits
+// when the mesh is small enough.
+
+bool LoadMesh(const char *filename, int num_threads, MeshData *mesh);
+
+// .obj or .ply
+bool IsMeshFile(const std::string& filename);
+
+#endif // MESH_LOADER_H
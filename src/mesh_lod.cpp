@@ -0,0 +1,224 @@
+#include "mesh_lod.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+
+static bool BuildLevel(MeshData *mesh, const MeshLod& full, int resolution, const float *min, float longest,
+                       uint32_t max_triangles);
+static int NormalDirection(uint32_t packed);
+
+void BuildMeshLods(MeshData *mesh, int max_levels)
+{
+    // start over from the full mesh, which always comes first
+    MeshLod full;
+    full.first_index = 0;
+    full.base_vertex = 0;
+    full.error = 0.0f;
+    if (!mesh->lods.empty())
+    {
+        full.num_indices = mesh->lods[0].num_indices;
+        if (mesh->lods.size() > 1)
+        {
+            mesh->vertices.resize(mesh->lods[1].base_vertex);
+        }
+        mesh->indices.resize(full.num_indices);
+    }
+    full.num_indices = (uint32_t)mesh->indices.size();
+    mesh->lods.assign(1, full);
+
+    size_t num_vertices = mesh->vertices.size();
+    if (num_vertices == 0 || full.num_indices < 3)
+    {
+        return;
+    }
+    float min[3], max[3];
+    for (int a = 0; a < 3; a++)
+    {
+        min[a] = FLT_MAX;
+        max[a] = -FLT_MAX;
+    }
+    for (size_t i = 0; i < num_vertices; i++)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            min[a] = std::min(min[a], mesh->vertices[i].position[a]);
+            max[a] = std::max(max[a], mesh->vertices[i].position[a]);
+        }
+    }
+    float longest = std::max(max[0] - min[0], std::max(max[1] - min[1], max[2] - min[2]));
+    if (longest <= 0.0f)
+    {
+        return;
+    }
+
+    // a surface crosses roughly a few times resolution^2 cells, so the first
+    // grid has about as many cells as there are vertices; grids that don't
+    // shrink the previous level enough are skipped
+    int resolution = 1;
+    while ((size_t)(2 * resolution) * (2 * resolution) * 2 <= num_vertices)
+    {
+        resolution *= 2;
+    }
+    uint32_t num_triangles = full.num_indices / 3;
+    for (; resolution >= 1 && (int)mesh->lods.size() < max_levels; resolution /= 2)
+    {
+        if (BuildLevel(mesh, full, resolution, min, longest, (uint32_t)(num_triangles * MESH_LOD_REDUCTION)))
+        {
+            num_triangles = mesh->lods.back().num_indices / 3;
+        }
+    }
+}
+
+int SelectMeshLod(const MeshLod *lods, int num_lods, float pixels_per_unit, float max_pixels)
+{
+    int level = num_lods - 1;
+    while (level > 0 && lods[level].error * pixels_per_unit > max_pixels)
+    {
+        level--;
+    }
+    return level;
+}
+
+
+// Auxillary functions
+bool BuildLevel(MeshData *mesh, const MeshLod& full, int resolution, const float *min, float longest,
+                uint32_t max_triangles)
+{
+    size_t num_vertices = mesh->lods.size() > 1 ? (size_t)mesh->lods[1].base_vertex : mesh->vertices.size();
+    const MeshVertex *vertices = mesh->vertices.data();
+    float cells_per_unit = resolution / longest;
+
+    // cluster of every vertex, and each cluster's mean position
+    std::unordered_map<uint64_t, uint32_t> cells;
+    cells.reserve(num_vertices / 2);
+    std::vector<uint32_t> cluster_of(num_vertices);
+    std::vector<double> sums;
+    std::vector<uint32_t> counts;
+    for (size_t i = 0; i < num_vertices; i++)
+    {
+        uint64_t key = 0;
+        for (int a = 0; a < 3; a++)
+        {
+            int cell = (int)((vertices[i].position[a] - min[a]) * cells_per_unit);
+            key = key * resolution + (uint64_t)std::min(std::max(cell, 0), resolution - 1);
+        }
+        key = key * 6 + NormalDirection(vertices[i].normal);
+        std::unordered_map<uint64_t, uint32_t>::iterator it =
+            cells.insert(std::make_pair(key, (uint32_t)counts.size())).first;
+        uint32_t cluster = it->second;
+        if (cluster == counts.size())
+        {
+            counts.push_back(0);
+            sums.insert(sums.end(), 3, 0.0);
+        }
+        cluster_of[i] = cluster;
+        counts[cluster]++;
+        for (int a = 0; a < 3; a++)
+        {
+            sums[3 * cluster + a] += vertices[i].position[a];
+        }
+    }
+    size_t num_clusters = counts.size();
+
+    // representatives: the vertex nearest each mean
+    std::vector<uint32_t> representatives(num_clusters, 0);
+    std::vector<float> nearest(num_clusters, FLT_MAX);
+    for (size_t i = 0; i < num_vertices; i++)
+    {
+        uint32_t cluster = cluster_of[i];
+        float distance = 0.0f;
+        for (int a = 0; a < 3; a++)
+        {
+            float d = vertices[i].position[a] - (float)(sums[3 * cluster + a] / counts[cluster]);
+            distance += d * d;
+        }
+        if (distance < nearest[cluster])
+        {
+            nearest[cluster] = distance;
+            representatives[cluster] = (uint32_t)i;
+        }
+    }
+
+    // surviving triangles, each set of three clusters once, in the winding
+    // it first appears with; very fine grids are too many clusters to key
+    // a triple in 64 bits and are left with their duplicates
+    std::vector<uint32_t> indices;
+    std::unordered_set<uint64_t> seen;
+    bool dedupe = num_clusters < (1u << 21);
+    for (uint32_t t = full.first_index; t + 2 < full.first_index + full.num_indices; t += 3)
+    {
+        uint32_t c[3];
+        for (int k = 0; k < 3; k++)
+        {
+            c[k] = cluster_of[mesh->indices[t + k]];
+        }
+        if (c[0] == c[1] || c[1] == c[2] || c[2] == c[0])
+        {
+            continue;
+        }
+        if (dedupe)
+        {
+            uint64_t sorted[3] = {c[0], c[1], c[2]};
+            std::sort(sorted, sorted + 3);
+            if (!seen.insert((sorted[0] << 42) | (sorted[1] << 21) | sorted[2]).second)
+            {
+                continue;
+            }
+        }
+        indices.insert(indices.end(), c, c + 3);
+        if (indices.size() / 3 > max_triangles)
+        {
+            return false;
+        }
+    }
+    if (indices.empty())
+    {
+        return false;
+    }
+
+    float error = 0.0f;
+    for (size_t i = 0; i < num_vertices; i++)
+    {
+        const float *position = vertices[i].position;
+        const float *target = vertices[representatives[cluster_of[i]]].position;
+        float distance = 0.0f;
+        for (int a = 0; a < 3; a++)
+        {
+            distance += (position[a] - target[a]) * (position[a] - target[a]);
+        }
+        error = std::max(error, distance);
+    }
+
+    MeshLod level;
+    level.first_index = (uint32_t)mesh->indices.size();
+    level.num_indices = (uint32_t)indices.size();
+    level.base_vertex = (int32_t)mesh->vertices.size();
+    level.error = sqrtf(error);
+    mesh->vertices.reserve(mesh->vertices.size() + num_clusters);
+    for (size_t c = 0; c < num_clusters; c++)
+    {
+        mesh->vertices.push_back(mesh->vertices[representatives[c]]);
+    }
+    mesh->indices.insert(mesh->indices.end(), indices.begin(), indices.end());
+    mesh->lods.push_back(level);
+
+    return true;
+}
+
+int NormalDirection(uint32_t packed)
+{
+    // the axis the normal points most along, and which way
+    float normal[3];
+    UnpackNormal(packed, normal);
+    int axis = 0;
+    for (int a = 1; a < 3; a++)
+    {
+        if (fabsf(normal[a]) > fabsf(normal[axis]))
+        {
+            axis = a;
+        }
+    }
+    return 2 * axis + (normal[axis] < 0.0f ? 1 : 0);
+}
@@ -0,0 +1,31 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include "mesh.h"
+
+// Level-of-detail chains by vertex clustering.
+//
+// Every coarser level snaps the full mesh's vertices to a grid half as fine
+// as the one before, one cluster per grid cell and dominant normal direction
+// (so the two sides of a crease don't melt into each other), and keeps the
+// vertex nearest each cluster's mean as its representative, normal and
+// texture coordinates included. Triangles left with fewer than three
+// distinct clusters disappear, as do duplicates. A level's error is the
+// furthest any vertex moved onto its representative.
+//
+// Levels are appended to the mesh's own vertex and index arrays, so the
+// whole chain lives in one pair of buffers and a level is only an index
+// range and a base vertex to draw with.
+
+#define MESH_MAX_LODS 8
+#define MESH_LOD_REDUCTION 0.6f     // a level keeps at most this share of the previous one's triangles
+
+// replaces mesh->lods with the full mesh followed by up to max_levels - 1
+// coarser levels (fewer when the mesh stops shrinking)
+void BuildMeshLods(MeshData *mesh, int max_levels);
+
+// the coarsest level whose error stays within max_pixels when one mesh unit
+// covers pixels_per_unit pixels on screen
+int SelectMeshLod(const MeshLod *lods, int num_lods, float pixels_per_unit, float max_pixels);
+
+#endif // MESH_LOD_H
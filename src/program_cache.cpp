@@ -0,0 +1,140 @@
+#include "program_cache.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint64_t HashBytes(uint64_t hash, const void *data, size_t length);
+static std::string CachePath(const char *directory, uint64_t key);
+
+bool ProgramCacheAvailable()
+{
+    if (!GLAD_GL_VERSION_4_1 && !GLAD_GL_ARB_get_program_binary)
+    {
+        return false;
+    }
+    GLint num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    return num_formats > 0;
+}
+
+uint64_t ProgramCacheKey(const char *const *sources, const size_t *lengths, int count)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < count; i++)
+    {
+        // lengths too, so moving text between sources changes the key
+        uint64_t length = lengths[i];
+        hash = HashBytes(hash, &length, sizeof(length));
+        hash = HashBytes(hash, sources[i], lengths[i]);
+    }
+    static const GLenum driver_strings[4] = {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION};
+    for (int i = 0; i < 4; i++)
+    {
+        const char *value = (const char*)glGetString(driver_strings[i]);
+        if (value != NULL)
+        {
+            hash = HashBytes(hash, value, strlen(value) + 1);
+        }
+    }
+
+    return hash;
+}
+
+bool ProgramCacheLoad(const char *directory, uint64_t key, GLuint program)
+{
+    FILE *fp = fopen(CachePath(directory, key).c_str(), "rb");
+    if (fp == NULL)
+    {
+        return false;
+    }
+    ProgramCacheHeader header;
+    std::vector<uint8_t> binary;
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1 && memcmp(header.magic, "PBIN", 4) == 0 &&
+              header.version == PROGRAM_CACHE_VERSION && header.key == key && header.length > 0;
+    if (ok)
+    {
+        binary.resize(header.length);
+        ok = fread(binary.data(), 1, binary.size(), fp) == binary.size();
+    }
+    fclose(fp);
+    if (!ok)
+    {
+        return false;
+    }
+
+    glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+    GLint status = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+    return status != 0;
+}
+
+bool ProgramCacheStore(const char *directory, uint64_t key, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return false;
+    }
+    std::vector<uint8_t> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Error: cannot create program cache directory %s\n", directory);
+        return false;
+    }
+    ProgramCacheHeader header;
+    memcpy(header.magic, "PBIN", 4);
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+    header.format = format;
+    header.length = (uint32_t)length;
+
+    // renamed into place once complete; rename replaces atomically
+    std::string path = CachePath(directory, key);
+    std::string temporary = path + "." + std::to_string((long long)getpid());
+    FILE *fp = fopen(temporary.c_str(), "wb");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", temporary.c_str());
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(binary.data(), 1, (size_t)length, fp) == (size_t)length;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", path.c_str());
+        remove(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+
+// Auxillary functions
+uint64_t HashBytes(uint64_t hash, const void *data, size_t length)
+{
+    // FNV-1a
+    const uint8_t *bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string CachePath(const char *directory, uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+    return std::string(directory) + name;
+}
@@ -0,0 +1,40 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+
+// Linked shader programs cached on disk with glGetProgramBinary.
+//
+// A program is keyed by a 64-bit FNV-1a hash of its shader sources and
+// link-time settings, together with the GL vendor, renderer and version
+// strings, so a driver update or another GPU never loads a stale binary.
+// Each binary is a file named after its key in a node-local directory,
+// written to a temporary name and renamed into place so that ranks sharing
+// the node never read one half-written. The driver may still reject any
+// binary it is given (glProgramBinary leaves the program unlinked); the
+// caller then compiles from source as usual and stores the result.
+// Needs GL 4.1 or ARB_get_program_binary and at least one binary format.
+
+#define PROGRAM_CACHE_VERSION 1
+
+typedef struct ProgramCacheHeader {
+    char magic[4];      // "PBIN"
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;    // as returned by glGetProgramBinary
+    uint32_t length;    // bytes of binary after the header
+} ProgramCacheHeader;
+
+bool ProgramCacheAvailable();
+
+// hash of 'count' sources (with their lengths) and the current context's driver
+uint64_t ProgramCacheKey(const char *const *sources, const size_t *lengths, int count);
+
+// true when 'program' is linked from the cached binary
+bool ProgramCacheLoad(const char *directory, uint64_t key, GLuint program);
+// 'program' must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+bool ProgramCacheStore(const char *directory, uint64_t key, GLuint program);
+
+#endif // PROGRAM_CACHE_H
@@ -0,0 +1,346 @@
+#include "scene_bvh.h"
+#include <algorithm>
+#include <cfloat>
+
+static void Build(SceneBvh *bvh, const SceneBounds *bounds, int count);
+static uint32_t BuildNode(SceneBvh *bvh, int first, int count);
+static float TreeCost(const SceneBvh& bvh);
+static float HalfArea(const float *min, const float *max);
+static void ResetBounds(SceneBounds *bounds);
+static void GrowBounds(SceneBounds *bounds, const float *min, const float *max);
+
+void SceneBvhInit(SceneBvh *bvh, float rebuild_ratio)
+{
+    bvh->rebuild_ratio = rebuild_ratio;
+    bvh->nodes.clear();
+    bvh->objects.clear();
+    bvh->built_cost = 0.0f;
+    bvh->stats.num_builds = 0;
+    bvh->stats.num_refits = 0;
+    bvh->stats.num_visited = 0;
+    bvh->stats.num_visible = 0;
+}
+
+void SceneBvhUpdate(SceneBvh *bvh, const SceneBounds *bounds, int count)
+{
+    if ((int)bvh->objects.size() != count || bvh->nodes.empty())
+    {
+        Build(bvh, bounds, count);
+        return;
+    }
+
+    // children come after their parent, so walking backwards refits every
+    // node after both of its children
+    for (size_t i = bvh->nodes.size(); i-- > 0;)
+    {
+        SceneBvhNode& node = bvh->nodes[i];
+        SceneBounds box;
+        ResetBounds(&box);
+        if (node.count > 0)
+        {
+            for (uint32_t k = 0; k < node.count; k++)
+            {
+                const SceneBounds& object = bounds[bvh->objects[node.offset + k]];
+                GrowBounds(&box, object.min, object.max);
+            }
+        }
+        else
+        {
+            GrowBounds(&box, bvh->nodes[i + 1].min, bvh->nodes[i + 1].max);
+            GrowBounds(&box, bvh->nodes[node.offset].min, bvh->nodes[node.offset].max);
+        }
+        std::copy(box.min, box.min + 3, node.min);
+        std::copy(box.max, box.max + 3, node.max);
+    }
+    bvh->stats.num_refits++;
+
+    if (TreeCost(*bvh) > bvh->built_cost * bvh->rebuild_ratio)
+    {
+        Build(bvh, bounds, count);
+    }
+}
+
+void SceneBvhCull(SceneBvh *bvh, const SceneFrustum& frustum, std::vector<int> *visible)
+{
+    visible->clear();
+    bvh->stats.num_visited = 0;
+    bvh->stats.num_visible = 0;
+    if (bvh->nodes.empty())
+    {
+        return;
+    }
+
+    // entries are (node, mask of the planes still to test)
+    std::vector<int>& stack = bvh->stack;
+    stack.clear();
+    stack.push_back(0);
+    stack.push_back(0x3f);
+    while (!stack.empty())
+    {
+        int mask = stack.back();
+        stack.pop_back();
+        int index = stack.back();
+        stack.pop_back();
+        const SceneBvhNode& node = bvh->nodes[index];
+        bvh->stats.num_visited++;
+
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; p++)
+        {
+            if ((mask & (1 << p)) == 0)
+            {
+                continue;
+            }
+            // the box corners furthest along and against the plane normal
+            const float *plane = frustum.planes[p];
+            float far_distance = plane[3];
+            float near_distance = plane[3];
+            for (int a = 0; a < 3; a++)
+            {
+                far_distance += plane[a] * (plane[a] >= 0.0f ? node.max[a] : node.min[a]);
+                near_distance += plane[a] * (plane[a] >= 0.0f ? node.min[a] : node.max[a]);
+            }
+            outside = far_distance < 0.0f;
+            if (near_distance >= 0.0f)
+            {
+                mask &= ~(1 << p);
+            }
+        }
+        if (outside)
+        {
+            continue;
+        }
+
+        if (node.count > 0)
+        {
+            visible->insert(visible->end(), bvh->objects.begin() + node.offset,
+                            bvh->objects.begin() + node.offset + node.count);
+        }
+        else
+        {
+            // first child on top, so it is visited next
+            stack.push_back((int)node.offset);
+            stack.push_back(mask);
+            stack.push_back(index + 1);
+            stack.push_back(mask);
+        }
+    }
+    bvh->stats.num_visible = (int)visible->size();
+}
+
+void SceneFrustumFromMatrix(const float *matrix, SceneFrustum *frustum)
+{
+    // clip space -w <= x, y, z <= w, written with the matrix rows
+    // (Gribb and Hartmann)
+    float rows[4][4];
+    for (int r = 0; r < 4; r++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            rows[r][c] = matrix[c * 4 + r];
+        }
+    }
+    for (int p = 0; p < 6; p++)
+    {
+        float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+        for (int c = 0; c < 4; c++)
+        {
+            frustum->planes[p][c] = rows[3][c] + sign * rows[p / 2][c];
+        }
+    }
+}
+
+
+// Auxillary functions
+void Build(SceneBvh *bvh, const SceneBounds *bounds, int count)
+{
+    // the build partitions copies of the bounds, so it reads them in order
+    // rather than jumping around the caller's array
+    bvh->refs.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        SceneBvhRef& ref = bvh->refs[i];
+        ref.bounds = bounds[i];
+        ref.object = i;
+        for (int a = 0; a < 3; a++)
+        {
+            ref.center[a] = 0.5f * (bounds[i].min[a] + bounds[i].max[a]);
+        }
+    }
+    bvh->nodes.clear();
+    if (count > 0)
+    {
+        bvh->nodes.reserve(2 * (count / SCENE_BVH_LEAF_SIZE) + 1);
+        BuildNode(bvh, 0, count);
+    }
+    bvh->objects.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        bvh->objects[i] = bvh->refs[i].object;
+    }
+    bvh->built_cost = TreeCost(*bvh);
+    bvh->stats.num_builds++;
+}
+
+uint32_t BuildNode(SceneBvh *bvh, int first, int count)
+{
+    uint32_t index = (uint32_t)bvh->nodes.size();
+    bvh->nodes.push_back(SceneBvhNode());
+    SceneBvhRef *refs = &bvh->refs[first];
+
+    SceneBounds box, centers;
+    ResetBounds(&box);
+    ResetBounds(&centers);
+    for (int i = 0; i < count; i++)
+    {
+        GrowBounds(&box, refs[i].bounds.min, refs[i].bounds.max);
+        GrowBounds(&centers, refs[i].center, refs[i].center);
+    }
+    std::copy(box.min, box.min + 3, bvh->nodes[index].min);
+    std::copy(box.max, box.max + 3, bvh->nodes[index].max);
+
+    // cheapest of the bin boundaries on every axis; costs are in units of
+    // visiting an object, relative to this node's area. All three axes are
+    // binned in one pass over the objects.
+    int best_axis = -1;
+    int best_split = 0;
+    float best_cost = FLT_MAX;
+    float bin_scales[3];
+    if (count > SCENE_BVH_LEAF_SIZE)
+    {
+        SceneBounds bins[3][SCENE_BVH_BINS];
+        int bin_counts[3][SCENE_BVH_BINS] = {{0}};
+        // large nodes are only split across the longest axis of their
+        // centers, which is nearly always the best one anyway, to keep
+        // rebuilds of big scenes short
+        int longest = 0;
+        for (int a = 0; a < 3; a++)
+        {
+            float extent = centers.max[a] - centers.min[a];
+            bin_scales[a] = extent > 0.0f ? SCENE_BVH_BINS / extent : 0.0f;
+            longest = extent > centers.max[longest] - centers.min[longest] ? a : longest;
+            for (int b = 0; b < SCENE_BVH_BINS; b++)
+            {
+                ResetBounds(&bins[a][b]);
+            }
+        }
+        int first_axis = count > SCENE_BVH_SINGLE_AXIS ? longest : 0;
+        int last_axis = count > SCENE_BVH_SINGLE_AXIS ? longest : 2;
+        for (int i = 0; i < count; i++)
+        {
+            for (int a = first_axis; a <= last_axis; a++)
+            {
+                int b = std::min(SCENE_BVH_BINS - 1, (int)((refs[i].center[a] - centers.min[a]) * bin_scales[a]));
+                bin_counts[a][b]++;
+                GrowBounds(&bins[a][b], refs[i].bounds.min, refs[i].bounds.max);
+            }
+        }
+
+        for (int a = first_axis; a <= last_axis; a++)
+        {
+            if (bin_scales[a] == 0.0f)
+            {
+                continue;
+            }
+            // sweep from the right for the areas right of each boundary,
+            // then from the left to finish each candidate's cost
+            float right_areas[SCENE_BVH_BINS];
+            SceneBounds right;
+            ResetBounds(&right);
+            for (int b = SCENE_BVH_BINS - 1; b > 0; b--)
+            {
+                GrowBounds(&right, bins[a][b].min, bins[a][b].max);
+                right_areas[b] = HalfArea(right.min, right.max);
+            }
+            SceneBounds left;
+            ResetBounds(&left);
+            int left_count = 0;
+            for (int b = 0; b < SCENE_BVH_BINS - 1; b++)
+            {
+                GrowBounds(&left, bins[a][b].min, bins[a][b].max);
+                left_count += bin_counts[a][b];
+                int right_count = count - left_count;
+                if (left_count == 0 || right_count == 0)
+                {
+                    continue;
+                }
+                float cost = HalfArea(left.min, left.max) * left_count + right_areas[b + 1] * right_count;
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = a;
+                    best_split = b;
+                }
+            }
+        }
+    }
+
+    // a leaf when splitting costs more than visiting every object here,
+    // unless that would make the leaf large
+    float area = HalfArea(box.min, box.max);
+    bool make_leaf = best_axis < 0 || (best_cost + area >= area * count && count <= 4 * SCENE_BVH_LEAF_SIZE);
+    if (make_leaf)
+    {
+        bvh->nodes[index].offset = (uint32_t)first;
+        bvh->nodes[index].count = (uint32_t)count;
+        return index;
+    }
+
+    float bin_scale = bin_scales[best_axis];
+    float min_center = centers.min[best_axis];
+    SceneBvhRef *middle = std::partition(refs, refs + count, [&](const SceneBvhRef& ref) {
+        return std::min(SCENE_BVH_BINS - 1, (int)((ref.center[best_axis] - min_center) * bin_scale)) <= best_split;
+    });
+    int left_count = (int)(middle - refs);
+
+    BuildNode(bvh, first, left_count);
+    uint32_t second = BuildNode(bvh, first + left_count, count - left_count);
+    bvh->nodes[index].offset = second;
+    bvh->nodes[index].count = 0;
+
+    return index;
+}
+
+float TreeCost(const SceneBvh& bvh)
+{
+    // SAH: expected nodes plus objects visited by a random ray (or small
+    // frustum), relative to the root
+    if (bvh.nodes.empty())
+    {
+        return 0.0f;
+    }
+    float cost = 0.0f;
+    for (size_t i = 0; i < bvh.nodes.size(); i++)
+    {
+        const SceneBvhNode& node = bvh.nodes[i];
+        cost += HalfArea(node.min, node.max) * (node.count > 0 ? (float)node.count : 1.0f);
+    }
+    float root_area = HalfArea(bvh.nodes[0].min, bvh.nodes[0].max);
+    return root_area > 0.0f ? cost / root_area : 0.0f;
+}
+
+float HalfArea(const float *min, const float *max)
+{
+    float dx = max[0] - min[0];
+    float dy = max[1] - min[1];
+    float dz = max[2] - min[2];
+    return dx * dy + dy * dz + dz * dx;
+}
+
+void ResetBounds(SceneBounds *bounds)
+{
+    for (int a = 0; a < 3; a++)
+    {
+        bounds->min[a] = FLT_MAX;
+        bounds->max[a] = -FLT_MAX;
+    }
+}
+
+void GrowBounds(SceneBounds *bounds, const float *min, const float *max)
+{
+    for (int a = 0; a < 3; a++)
+    {
+        bounds->min[a] = std::min(bounds->min[a], min[a]);
+        bounds->max[a] = std::max(bounds->max[a], max[a]);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef SCENE_BVH_H
+#define SCENE_BVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "scene_partition.h"
+
+// Bounding volume hierarchy over scene objects for view frustum culling.
+//
+// The tree is built top-down with the surface area heuristic, choosing
+// each split among SCENE_BVH_BINS candidate planes per axis over the
+// objects' centers (along the longest axis only, for large nodes), and
+// stored flattened in depth-first order: a node's first child directly
+// follows it and only the second child's index is stored, so nodes are 32
+// bytes, two to a cache line, and a traversal mostly walks forward through
+// memory.
+//
+// When objects move, the tree keeps its topology and only the boxes are
+// refit (bottom-up, by walking the array backwards). That is much cheaper
+// than a rebuild but lets boxes grow and overlap, so the tree is rebuilt
+// once its SAH cost exceeds rebuild_ratio times the cost it had when built.
+// Culling tests boxes against the six frustum planes, dropping planes
+// that a box is entirely inside of for the rest of its subtree.
+
+#define SCENE_BVH_BINS 16
+#define SCENE_BVH_LEAF_SIZE 4
+#define SCENE_BVH_SINGLE_AXIS 1024   // nodes with more objects only try their longest axis
+
+typedef struct SceneFrustum {
+    float planes[6][4];     // a x + b y + c z + d >= 0 inside
+} SceneFrustum;
+
+typedef struct SceneBvhNode {
+    float min[3];
+    uint32_t offset;        // inner: second child's index; leaf: first entry in objects
+    float max[3];
+    uint32_t count;         // objects in a leaf, 0 for inner nodes
+} SceneBvhNode;
+
+typedef struct SceneBvhRef {
+    SceneBounds bounds;
+    float center[3];
+    int object;
+} SceneBvhRef;
+
+typedef struct SceneBvhStats {
+    uint64_t num_builds;
+    uint64_t num_refits;
+    int num_visited;        // nodes visited by the last cull
+    int num_visible;        // objects it returned
+} SceneBvhStats;
+
+typedef struct SceneBvh {
+    float rebuild_ratio;               // e.g. 1.5: rebuild at 150% of the built tree's cost
+    std::vector<SceneBvhNode> nodes;   // nodes[0] is the root
+    std::vector<int> objects;          // object indices, grouped by leaf
+    float built_cost;
+    SceneBvhStats stats;
+
+    std::vector<SceneBvhRef> refs;     // scratch for builds
+    std::vector<int> stack;
+} SceneBvh;
+
+void SceneBvhInit(SceneBvh *bvh, float rebuild_ratio);
+
+// builds the tree on the first call (or when the object count changes) and
+// refits it after that, rebuilding when the refit tree has become too poor
+void SceneBvhUpdate(SceneBvh *bvh, const SceneBounds *bounds, int count);
+
+// indices of the objects whose bounds intersect the frustum (conservatively:
+// boxes near a frustum corner may be reported without touching it)
+void SceneBvhCull(SceneBvh *bvh, const SceneFrustum& frustum, std::vector<int> *visible);
+
+// planes of a column-major view-projection matrix (as glm stores it), in
+// the space the matrix transforms from
+void SceneFrustumFromMatrix(const float *matrix, SceneFrustum *frustum);
+
+#endif // SCENE_BVH_H
@@ -0,0 +1,271 @@
+#include "scene_occlusion.h"
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64)
+#define SCENE_OCCLUSION_SSE2
+#include <emmintrin.h>
+#endif
+
+static bool Project(const SceneOcclusion& occlusion, const float *point, float *screen);
+
+void SceneOcclusionInit(SceneOcclusion *occlusion, int width, int height)
+{
+    occlusion->width = std::max(4, (width + 3) & ~3);
+    occlusion->height = std::max(1, height);
+    occlusion->levels.clear();
+    occlusion->level_widths.clear();
+    occlusion->level_heights.clear();
+    int level_width = occlusion->width;
+    int level_height = occlusion->height;
+    while (true)
+    {
+        occlusion->levels.push_back(std::vector<float>((size_t)level_width * level_height, 1.0f));
+        occlusion->level_widths.push_back(level_width);
+        occlusion->level_heights.push_back(level_height);
+        if (level_width == 1 && level_height == 1)
+        {
+            break;
+        }
+        level_width = (level_width + 1) / 2;
+        level_height = (level_height + 1) / 2;
+    }
+    occlusion->stats.num_quads = 0;
+    occlusion->stats.num_tested = 0;
+    occlusion->stats.num_hidden = 0;
+}
+
+void SceneOcclusionBegin(SceneOcclusion *occlusion, const float *view_projection)
+{
+    std::copy(view_projection, view_projection + 16, occlusion->matrix);
+    std::fill(occlusion->levels[0].begin(), occlusion->levels[0].end(), 1.0f);
+    occlusion->stats.num_quads = 0;
+    occlusion->stats.num_tested = 0;
+    occlusion->stats.num_hidden = 0;
+}
+
+void SceneOcclusionAddQuad(SceneOcclusion *occlusion, const float corners[4][3])
+{
+    float screen[4][3];
+    for (int k = 0; k < 4; k++)
+    {
+        if (!Project(*occlusion, corners[k], screen[k]))
+        {
+            return;
+        }
+    }
+    float area = 0.0f;
+    for (int k = 0; k < 4; k++)
+    {
+        const float *p = screen[k];
+        const float *q = screen[(k + 1) % 4];
+        area += p[0] * q[1] - q[0] * p[1];
+    }
+    if (fabsf(area) < 1e-6f)
+    {
+        return;
+    }
+    float orientation = area > 0.0f ? 1.0f : -1.0f;
+
+    // edge functions a x + b y + c, positive inside, moved in by half a
+    // pixel's reach so only pixels the quad covers entirely pass all four
+    float edge_a[4], edge_b[4], edge_c[4];
+    for (int k = 0; k < 4; k++)
+    {
+        const float *p = screen[k];
+        const float *q = screen[(k + 1) % 4];
+        edge_a[k] = -(q[1] - p[1]) * orientation;
+        edge_b[k] = (q[0] - p[0]) * orientation;
+        edge_c[k] = -(edge_a[k] * p[0] + edge_b[k] * p[1]) - 0.5f * (fabsf(edge_a[k]) + fabsf(edge_b[k]));
+    }
+
+    // depth plane z = za x + zb y + zc, from whichever half of the quad is
+    // less edge-on, raised to the farthest it gets within a pixel
+    float normal[2][3];
+    for (int t = 0; t < 2; t++)
+    {
+        const float *o = screen[0];
+        const float *u = screen[1 + t];
+        const float *v = screen[2 + t];
+        float du[3] = {u[0] - o[0], u[1] - o[1], u[2] - o[2]};
+        float dv[3] = {v[0] - o[0], v[1] - o[1], v[2] - o[2]};
+        normal[t][0] = du[1] * dv[2] - du[2] * dv[1];
+        normal[t][1] = du[2] * dv[0] - du[0] * dv[2];
+        normal[t][2] = du[0] * dv[1] - du[1] * dv[0];
+    }
+    const float *n = fabsf(normal[0][2]) >= fabsf(normal[1][2]) ? normal[0] : normal[1];
+    if (fabsf(n[2]) < 1e-9f)
+    {
+        return;
+    }
+    float za = -n[0] / n[2];
+    float zb = -n[1] / n[2];
+    float zc = screen[0][2] - za * screen[0][0] - zb * screen[0][1] + 0.5f * (fabsf(za) + fabsf(zb));
+
+    float min_x = screen[0][0], max_x = screen[0][0], min_y = screen[0][1], max_y = screen[0][1];
+    for (int k = 1; k < 4; k++)
+    {
+        min_x = std::min(min_x, screen[k][0]);
+        max_x = std::max(max_x, screen[k][0]);
+        min_y = std::min(min_y, screen[k][1]);
+        max_y = std::max(max_y, screen[k][1]);
+    }
+    int x0 = std::max(0, (int)floorf(min_x)) & ~3;
+    int x1 = std::min(occlusion->width - 1, (int)ceilf(max_x));
+    int y0 = std::max(0, (int)floorf(min_y));
+    int y1 = std::min(occlusion->height - 1, (int)ceilf(max_y));
+    if (x0 > x1 || y0 > y1)
+    {
+        return;
+    }
+    occlusion->stats.num_quads++;
+
+    float *depth = occlusion->levels[0].data();
+    for (int y = y0; y <= y1; y++)
+    {
+        float *row = depth + (size_t)y * occlusion->width;
+        float cy = y + 0.5f;
+        float cx = x0 + 0.5f;
+#ifdef SCENE_OCCLUSION_SSE2
+        // four pixels a step; the width is a multiple of 4, so a step
+        // starting on the row never runs past its end
+        const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        __m128 edges[4], edge_steps[4];
+        for (int k = 0; k < 4; k++)
+        {
+            edges[k] = _mm_add_ps(_mm_set1_ps(edge_a[k] * cx + edge_b[k] * cy + edge_c[k]),
+                                  _mm_mul_ps(_mm_set1_ps(edge_a[k]), lanes));
+            edge_steps[k] = _mm_set1_ps(4.0f * edge_a[k]);
+        }
+        __m128 z = _mm_add_ps(_mm_set1_ps(za * cx + zb * cy + zc), _mm_mul_ps(_mm_set1_ps(za), lanes));
+        __m128 z_step = _mm_set1_ps(4.0f * za);
+        __m128 zero = _mm_setzero_ps();
+        for (int x = x0; x <= x1; x += 4)
+        {
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edges[0], zero), _mm_cmpge_ps(edges[1], zero)),
+                                       _mm_and_ps(_mm_cmpge_ps(edges[2], zero), _mm_cmpge_ps(edges[3], zero)));
+            __m128 old = _mm_loadu_ps(row + x);
+            __m128 nearest = _mm_min_ps(old, z);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+            for (int k = 0; k < 4; k++)
+            {
+                edges[k] = _mm_add_ps(edges[k], edge_steps[k]);
+            }
+            z = _mm_add_ps(z, z_step);
+        }
+#else
+        for (int x = x0; x <= x1; x++)
+        {
+            float px = x + 0.5f;
+            bool inside = true;
+            for (int k = 0; k < 4 && inside; k++)
+            {
+                inside = edge_a[k] * px + edge_b[k] * cy + edge_c[k] >= 0.0f;
+            }
+            if (inside)
+            {
+                row[x] = std::min(row[x], za * px + zb * cy + zc);
+            }
+        }
+#endif
+    }
+}
+
+void SceneOcclusionEnd(SceneOcclusion *occlusion)
+{
+    for (size_t level = 1; level < occlusion->levels.size(); level++)
+    {
+        const float *fine = occlusion->levels[level - 1].data();
+        int fine_width = occlusion->level_widths[level - 1];
+        int fine_height = occlusion->level_heights[level - 1];
+        float *coarse = occlusion->levels[level].data();
+        int width = occlusion->level_widths[level];
+        int height = occlusion->level_heights[level];
+        for (int y = 0; y < height; y++)
+        {
+            const float *row0 = fine + (size_t)(2 * y) * fine_width;
+            const float *row1 = fine + (size_t)std::min(2 * y + 1, fine_height - 1) * fine_width;
+            for (int x = 0; x < width; x++)
+            {
+                int x0 = 2 * x;
+                int x1 = std::min(2 * x + 1, fine_width - 1);
+                coarse[(size_t)y * width + x] = std::max(std::max(row0[x0], row0[x1]), std::max(row1[x0], row1[x1]));
+            }
+        }
+    }
+}
+
+bool SceneOcclusionTest(SceneOcclusion *occlusion, const SceneBounds& bounds)
+{
+    occlusion->stats.num_tested++;
+    float min_x = 1e30f, max_x = -1e30f, min_y = 1e30f, max_y = -1e30f, nearest = 1e30f;
+    for (int k = 0; k < 8; k++)
+    {
+        float corner[3] = {(k & 1) ? bounds.max[0] : bounds.min[0], (k & 2) ? bounds.max[1] : bounds.min[1],
+                           (k & 4) ? bounds.max[2] : bounds.min[2]};
+        float screen[3];
+        if (!Project(*occlusion, corner, screen))
+        {
+            return false;
+        }
+        min_x = std::min(min_x, screen[0]);
+        max_x = std::max(max_x, screen[0]);
+        min_y = std::min(min_y, screen[1]);
+        max_y = std::max(max_y, screen[1]);
+        nearest = std::min(nearest, screen[2]);
+    }
+    if (max_x < 0.0f || max_y < 0.0f || min_x >= occlusion->width || min_y >= occlusion->height)
+    {
+        return false;
+    }
+    int x0 = std::max(0, (int)min_x);
+    int x1 = std::min(occlusion->width - 1, (int)max_x);
+    int y0 = std::max(0, (int)min_y);
+    int y1 = std::min(occlusion->height - 1, (int)max_y);
+
+    // the level where the rectangle spans at most two texels each way
+    int level = 0;
+    int extent = std::max(x1 - x0, y1 - y0) + 1;
+    while ((1 << level) < extent && level + 1 < (int)occlusion->levels.size())
+    {
+        level++;
+    }
+    const float *depth = occlusion->levels[level].data();
+    int width = occlusion->level_widths[level];
+    float farthest = 0.0f;
+    for (int y = y0 >> level; y <= (y1 >> level); y++)
+    {
+        for (int x = x0 >> level; x <= (x1 >> level); x++)
+        {
+            farthest = std::max(farthest, depth[(size_t)y * width + x]);
+        }
+    }
+    bool hidden = nearest > farthest;
+    if (hidden)
+    {
+        occlusion->stats.num_hidden++;
+    }
+
+    return hidden;
+}
+
+
+// Auxillary functions
+bool Project(const SceneOcclusion& occlusion, const float *point, float *screen)
+{
+    // false in front of the near plane (z < -w)
+    const float *m = occlusion.matrix;
+    float clip[4];
+    for (int r = 0; r < 4; r++)
+    {
+        clip[r] = m[r] * point[0] + m[4 + r] * point[1] + m[8 + r] * point[2] + m[12 + r];
+    }
+    if (clip[2] < -clip[3] || clip[3] <= 0.0f)
+    {
+        return false;
+    }
+    float inverse_w = 1.0f / clip[3];
+    screen[0] = (clip[0] * inverse_w * 0.5f + 0.5f) * occlusion.width;
+    screen[1] = (clip[1] * inverse_w * 0.5f + 0.5f) * occlusion.height;
+    screen[2] = clip[2] * inverse_w;
+    return true;
+}
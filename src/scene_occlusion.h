@@ -0,0 +1,59 @@
+#ifndef SCENE_OCCLUSION_H
+#define SCENE_OCCLUSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "scene_partition.h"
+
+// Software occlusion culling against a hierarchical depth buffer.
+//
+// Each frame a few large occluders are rasterized on the CPU into a small
+// depth buffer covering the same frustum as the rank's image. Occluders are
+// convex planar quads, and a quad only writes the pixels it covers entirely,
+// each with the farthest depth it reaches inside that pixel, so the buffer
+// never claims a pixel is nearer than the real image has it. Rows are
+// filled four pixels at a time with SSE2 where available. Depths are NDC z,
+// which is affine in screen space, so one plane equation gives a quad's
+// depth at every pixel.
+//
+// A pyramid of 2x2 maxima is then built over the buffer. An object's box is
+// tested on the level where its screen rectangle spans at most two texels
+// each way: it is hidden when its nearest depth lies behind the farthest
+// depth of all of them. Boxes reaching in front of the near plane are never
+// hidden.
+
+#define SCENE_OCCLUSION_WIDTH 256          // buffer width; the height follows the image's aspect
+#define SCENE_OCCLUSION_MAX_OCCLUDERS 512  // objects rasterized per frame, the largest on screen
+
+typedef struct SceneOcclusionStats {
+    int num_quads;      // occluder quads rasterized in the last frame
+    int num_tested;
+    int num_hidden;
+} SceneOcclusionStats;
+
+typedef struct SceneOcclusion {
+    int width;                              // a multiple of 4
+    int height;
+    std::vector<std::vector<float> > levels;   // levels[0] is the depth buffer, then 2x2 maxima down to 1x1
+    std::vector<int> level_widths;
+    std::vector<int> level_heights;
+    float matrix[16];                       // this frame's view-projection, column-major
+    SceneOcclusionStats stats;
+} SceneOcclusion;
+
+void SceneOcclusionInit(SceneOcclusion *occlusion, int width, int height);
+
+// clears the depth buffer for a frame seen through a column-major
+// view-projection matrix (as glm stores it)
+void SceneOcclusionBegin(SceneOcclusion *occlusion, const float *view_projection);
+// rasterizes a convex planar quad given by its corners in order, either
+// winding; quads reaching in front of the near plane are skipped
+void SceneOcclusionAddQuad(SceneOcclusion *occlusion, const float corners[4][3]);
+// builds the pyramid once the occluders are in
+void SceneOcclusionEnd(SceneOcclusion *occlusion);
+
+// whether the box is certainly hidden behind the occluders
+bool SceneOcclusionTest(SceneOcclusion *occlusion, const SceneBounds& bounds);
+
+#endif // SCENE_OCCLUSION_H
@@ -0,0 +1,252 @@
+#include "scene_partition.h"
+#include <algorithm>
+#include <cfloat>
+
+static void Rebuild(ScenePartition *partition, const SceneBounds *bounds, int count);
+static int BuildNode(ScenePartition *partition, int *objects, int count, int first_rank, int num_ranks,
+                     const SceneBounds& cell);
+static int FindRank(const ScenePartition& partition, const float *center);
+static void AppendVisibilityOrder(const ScenePartition& partition, int node, const float eye[3], std::vector<int> *ranks);
+static void ResetBounds(SceneBounds *bounds);
+static void GrowBounds(SceneBounds *bounds, const SceneBounds& other);
+
+void ScenePartitionInit(ScenePartition *partition, int num_ranks, float imbalance_tolerance)
+{
+    partition->num_ranks = num_ranks;
+    partition->imbalance_tolerance = imbalance_tolerance;
+    partition->nodes.clear();
+    partition->owners.clear();
+    partition->regions.resize(num_ranks);
+    partition->stats.num_rebuilds = 0;
+    partition->stats.num_migrated = 0;
+    partition->stats.max_objects = 0;
+}
+
+void ScenePartitionUpdate(ScenePartition *partition, const SceneBounds *bounds, int count)
+{
+    partition->centers.resize((size_t)count * 3);
+    for (int i = 0; i < count; i++)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            partition->centers[3 * i + a] = 0.5f * (bounds[i].min[a] + bounds[i].max[a]);
+        }
+    }
+
+    bool first = (int)partition->owners.size() != count;
+    if (first)
+    {
+        partition->owners.assign(count, -1);
+        Rebuild(partition, bounds, count);
+    }
+
+    // objects go to the leaf their center is in; only if that leaves some
+    // rank too busy are the planes moved
+    std::vector<int> loads(partition->num_ranks, 0);
+    int num_migrated = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        std::fill(loads.begin(), loads.end(), 0);
+        num_migrated = 0;
+        for (int i = 0; i < count; i++)
+        {
+            int rank = FindRank(*partition, &partition->centers[3 * i]);
+            num_migrated += rank != partition->owners[i] ? 1 : 0;
+            partition->owners[i] = rank;
+            loads[rank]++;
+        }
+        int max_objects = *std::max_element(loads.begin(), loads.end());
+        double average = (double)count / partition->num_ranks;
+        if (pass == 1 || first || max_objects <= average * (1.0 + partition->imbalance_tolerance) + 1.0)
+        {
+            break;
+        }
+        Rebuild(partition, bounds, count);
+    }
+    partition->stats.num_migrated = first ? 0 : num_migrated;
+    partition->stats.max_objects = *std::max_element(loads.begin(), loads.end());
+
+    for (int r = 0; r < partition->num_ranks; r++)
+    {
+        ResetBounds(&partition->regions[r].objects);
+        partition->regions[r].num_objects = loads[r];
+    }
+    for (int i = 0; i < count; i++)
+    {
+        GrowBounds(&partition->regions[partition->owners[i]].objects, bounds[i]);
+    }
+}
+
+void ScenePartitionOwned(const ScenePartition& partition, int rank, std::vector<int> *objects)
+{
+    objects->clear();
+    objects->reserve(partition.regions[rank].num_objects);
+    for (size_t i = 0; i < partition.owners.size(); i++)
+    {
+        if (partition.owners[i] == rank)
+        {
+            objects->push_back((int)i);
+        }
+    }
+}
+
+void ScenePartitionVisibilityOrder(const ScenePartition& partition, const float eye[3], std::vector<int> *ranks)
+{
+    ranks->clear();
+    if (!partition.nodes.empty())
+    {
+        AppendVisibilityOrder(partition, 0, eye, ranks);
+    }
+}
+
+
+// Auxillary functions
+void Rebuild(ScenePartition *partition, const SceneBounds *bounds, int count)
+{
+    SceneBounds root;
+    ResetBounds(&root);
+    for (int i = 0; i < count; i++)
+    {
+        GrowBounds(&root, bounds[i]);
+    }
+    if (count == 0)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            root.min[a] = 0.0f;
+            root.max[a] = 0.0f;
+        }
+    }
+
+    partition->order.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        partition->order[i] = i;
+    }
+    partition->nodes.clear();
+    partition->nodes.reserve(2 * partition->num_ranks - 1);
+    BuildNode(partition, partition->order.data(), count, 0, partition->num_ranks, root);
+    partition->stats.num_rebuilds++;
+}
+
+int BuildNode(ScenePartition *partition, int *objects, int count, int first_rank, int num_ranks,
+              const SceneBounds& cell)
+{
+    int index = (int)partition->nodes.size();
+    partition->nodes.push_back(SceneKdNode());
+    if (num_ranks == 1)
+    {
+        partition->nodes[index].axis = -1;
+        partition->nodes[index].rank = first_rank;
+        partition->regions[first_rank].cell = cell;
+        return index;
+    }
+
+    // split along the longest extent of the centers (of the cell when there
+    // are no objects), at the count that gives each half its share
+    const float *centers = partition->centers.data();
+    SceneBounds spread;
+    ResetBounds(&spread);
+    for (int i = 0; i < count; i++)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            spread.min[a] = std::min(spread.min[a], centers[3 * objects[i] + a]);
+            spread.max[a] = std::max(spread.max[a], centers[3 * objects[i] + a]);
+        }
+    }
+    const SceneBounds& extent = count > 0 ? spread : cell;
+    int axis = 0;
+    for (int a = 1; a < 3; a++)
+    {
+        if (extent.max[a] - extent.min[a] > extent.max[axis] - extent.min[axis])
+        {
+            axis = a;
+        }
+    }
+
+    int left_ranks = num_ranks / 2;
+    int split_count = (int)((int64_t)count * left_ranks / num_ranks);
+    float split;
+    if (count == 0)
+    {
+        split = 0.5f * (cell.min[axis] + cell.max[axis]);
+    }
+    else
+    {
+        std::nth_element(objects, objects + split_count, objects + count, [centers, axis](int a, int b) {
+            return centers[3 * a + axis] < centers[3 * b + axis];
+        });
+        // halfway between the halves, so small moves don't cross the plane
+        float right_min = centers[3 * objects[split_count] + axis];
+        split = right_min;
+        if (split_count > 0)
+        {
+            float left_max = -FLT_MAX;
+            for (int i = 0; i < split_count; i++)
+            {
+                left_max = std::max(left_max, centers[3 * objects[i] + axis]);
+            }
+            split = 0.5f * (left_max + right_min);
+        }
+    }
+
+    SceneBounds left_cell = cell;
+    SceneBounds right_cell = cell;
+    left_cell.max[axis] = split;
+    right_cell.min[axis] = split;
+    int left = BuildNode(partition, objects, split_count, first_rank, left_ranks, left_cell);
+    int right = BuildNode(partition, objects + split_count, count - split_count, first_rank + left_ranks,
+                          num_ranks - left_ranks, right_cell);
+    SceneKdNode& node = partition->nodes[index];
+    node.axis = axis;
+    node.split = split;
+    node.children[0] = left;
+    node.children[1] = right;
+    node.rank = -1;
+
+    return index;
+}
+
+int FindRank(const ScenePartition& partition, const float *center)
+{
+    int node = 0;
+    while (partition.nodes[node].axis >= 0)
+    {
+        const SceneKdNode& kd = partition.nodes[node];
+        node = kd.children[center[kd.axis] < kd.split ? 0 : 1];
+    }
+    return partition.nodes[node].rank;
+}
+
+void AppendVisibilityOrder(const ScenePartition& partition, int node, const float eye[3], std::vector<int> *ranks)
+{
+    const SceneKdNode& kd = partition.nodes[node];
+    if (kd.axis < 0)
+    {
+        ranks->push_back(kd.rank);
+        return;
+    }
+    // the side of the plane the eye is on can't be hidden by the other side
+    int near_side = eye[kd.axis] < kd.split ? 0 : 1;
+    AppendVisibilityOrder(partition, kd.children[near_side], eye, ranks);
+    AppendVisibilityOrder(partition, kd.children[1 - near_side], eye, ranks);
+}
+
+void ResetBounds(SceneBounds *bounds)
+{
+    for (int a = 0; a < 3; a++)
+    {
+        bounds->min[a] = FLT_MAX;
+        bounds->max[a] = -FLT_MAX;
+    }
+}
+
+void GrowBounds(SceneBounds *bounds, const SceneBounds& other)
+{
+    for (int a = 0; a < 3; a++)
+    {
+        bounds->min[a] = std::min(bounds->min[a], other.min[a]);
+        bounds->max[a] = std::max(bounds->max[a], other.max[a]);
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef SCENE_PARTITION_H
+#define SCENE_PARTITION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Assignment of scene objects to ranks for sort-last rendering.
+//
+// A k-d tree with one leaf per rank splits the objects by the centers of
+// their bounds, halving the rank range at every level (splitting along the
+// longest axis of the centers at the object count that balances the two
+// halves), so each rank owns a compact, spatially coherent group. Leaves'
+// cells tile space without overlapping, which gives a front-to-back order
+// of the ranks for any eye position (ScenePartitionVisibilityOrder).
+//
+// Objects that move are reassigned to the leaf their center now falls in;
+// the split planes are only recomputed when that leaves some rank more than
+// the tolerance above the average load. Every rank runs the same update on
+// the same (replicated) object bounds, so they agree on ownership without
+// communicating.
+
+typedef struct SceneBounds {
+    float min[3];
+    float max[3];
+} SceneBounds;
+
+typedef struct SceneRegion {
+    SceneBounds cell;       // k-d cell, disjoint from the other ranks' cells
+    SceneBounds objects;    // union of the owned objects' bounds (may reach past the cell)
+    int num_objects;
+} SceneRegion;
+
+typedef struct SceneKdNode {
+    int axis;               // -1 for a leaf
+    float split;            // centers below go to children[0]
+    int children[2];
+    int rank;               // leaf only
+} SceneKdNode;
+
+typedef struct ScenePartitionStats {
+    uint64_t num_rebuilds;
+    int num_migrated;       // objects that changed rank in the last update
+    int max_objects;        // load of the busiest rank
+} ScenePartitionStats;
+
+typedef struct ScenePartition {
+    int num_ranks;
+    float imbalance_tolerance;         // e.g. 0.1: rebuild above 110% of the average load
+    std::vector<SceneKdNode> nodes;    // nodes[0] is the root
+    std::vector<int> owners;           // rank of each object
+    std::vector<SceneRegion> regions;  // one per rank
+    ScenePartitionStats stats;
+
+    std::vector<float> centers;        // scratch, 3 per object
+    std::vector<int> order;
+} ScenePartition;
+
+void ScenePartitionInit(ScenePartition *partition, int num_ranks, float imbalance_tolerance);
+
+// assigns every object to a rank; call whenever objects have moved (the
+// tree is built on the first call, or when the object count changes)
+void ScenePartitionUpdate(ScenePartition *partition, const SceneBounds *bounds, int count);
+
+// indices of the objects a rank owns, in increasing order
+void ScenePartitionOwned(const ScenePartition& partition, int rank, std::vector<int> *objects);
+
+// ranks ordered nearest first as seen from 'eye' (in the objects' space)
+void ScenePartitionVisibilityOrder(const ScenePartition& partition, const float eye[3], std::vector<int> *ranks);
+
+#endif // SCENE_PARTITION_H
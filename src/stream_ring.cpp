@@ -0,0 +1,126 @@
+#include "stream_ring.h"
+#include <chrono>
+
+void StreamRingInit(StreamRing *ring, size_t region_size)
+{
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    ring->alignment = alignment > 16 ? (size_t)alignment : 16;
+    ring->region_size = (region_size + ring->alignment - 1) / ring->alignment * ring->alignment;
+    ring->region = 0;
+    ring->used = 0;
+    ring->wait_time = 0.0;
+    for (int i = 0; i < STREAM_RING_FRAMES; i++)
+    {
+        ring->fences[i] = NULL;
+    }
+
+    glGenBuffers(1, &ring->buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, ring->buffer);
+    ring->mapped = NULL;
+    if (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage)
+    {
+        // coherent, so writes need no explicit flush before the draws
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLsizeiptr size = (GLsizeiptr)(STREAM_RING_FRAMES * ring->region_size);
+        glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+        ring->mapped = (uint8_t*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    }
+    if (ring->mapped == NULL)
+    {
+        // immutable storage can't be respecified, so start over with a
+        // buffer the fallback can orphan
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDeleteBuffers(1, &ring->buffer);
+        glGenBuffers(1, &ring->buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, ring->buffer);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)ring->region_size, NULL, GL_STREAM_DRAW);
+        ring->staging.resize(ring->region_size);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void StreamRingRelease(StreamRing *ring)
+{
+    for (int i = 0; i < STREAM_RING_FRAMES; i++)
+    {
+        if (ring->fences[i] != NULL)
+        {
+            glDeleteSync(ring->fences[i]);
+            ring->fences[i] = NULL;
+        }
+    }
+    if (ring->mapped != NULL)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, ring->buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        ring->mapped = NULL;
+    }
+    glDeleteBuffers(1, &ring->buffer);
+    ring->staging.clear();
+}
+
+void StreamRingBegin(StreamRing *ring)
+{
+    ring->used = 0;
+    ring->wait_time = 0.0;
+    if (ring->mapped == NULL)
+    {
+        return;
+    }
+
+    ring->region = (ring->region + 1) % STREAM_RING_FRAMES;
+    GLsync fence = ring->fences[ring->region];
+    if (fence != NULL)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        while (status == GL_TIMEOUT_EXPIRED)
+        {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        }
+        glDeleteSync(fence);
+        ring->fences[ring->region] = NULL;
+        ring->wait_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+void *StreamRingAlloc(StreamRing *ring, size_t size, size_t *offset)
+{
+    size_t start = (ring->used + ring->alignment - 1) / ring->alignment * ring->alignment;
+    if (start + size > ring->region_size)
+    {
+        return NULL;
+    }
+    ring->used = start + size;
+    if (ring->mapped == NULL)
+    {
+        *offset = start;
+        return ring->staging.data() + start;
+    }
+    *offset = ring->region * ring->region_size + start;
+    return ring->mapped + *offset;
+}
+
+void StreamRingFlush(StreamRing *ring)
+{
+    if (ring->mapped != NULL || ring->used == 0)
+    {
+        return;
+    }
+    // orphan the old storage so the driver doesn't stall on draws that
+    // still read last frame's data
+    glBindBuffer(GL_ARRAY_BUFFER, ring->buffer);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)ring->region_size, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)ring->used, ring->staging.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void StreamRingFence(StreamRing *ring)
+{
+    if (ring->mapped != NULL)
+    {
+        ring->fences[ring->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef STREAM_RING_H
+#define STREAM_RING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+
+// Per-frame data streamed through one persistently mapped buffer.
+//
+// The buffer is split into STREAM_RING_FRAMES regions and each frame writes
+// the next one in turn: its uniform blocks and instance data are written
+// straight into the mapping, where the GPU reads them with no copy and no
+// buffer respecification. A fence after a frame's last draw guards its
+// region; by the time the ring comes round to it again the fence has
+// nearly always passed, so the wait is free. Every allocation is aligned
+// for binding as a uniform block.
+//
+// Without GL 4.4 or ARB_buffer_storage the frame is written to memory
+// instead and uploaded in one call into orphaned storage before the draws.
+
+#define STREAM_RING_FRAMES 3
+
+typedef struct StreamRing {
+    GLuint buffer;
+    uint8_t *mapped;                // the whole buffer, or NULL when it is orphaned every frame
+    std::vector<uint8_t> staging;   // the frame's data when not mapped
+    size_t region_size;             // bytes a frame may allocate
+    size_t alignment;
+    int region;
+    size_t used;                    // bytes of the current region handed out
+    GLsync fences[STREAM_RING_FRAMES];
+    double wait_time;               // seconds the last StreamRingBegin waited for the gpu
+} StreamRing;
+
+void StreamRingInit(StreamRing *ring, size_t region_size);
+void StreamRingRelease(StreamRing *ring);
+
+// moves on to the next region, waiting for the frame that last used it
+void StreamRingBegin(StreamRing *ring);
+// 'size' bytes to write this frame's data to, at *offset in ring->buffer;
+// NULL when the frame's region is full
+void *StreamRingAlloc(StreamRing *ring, size_t size, size_t *offset);
+// makes the frame's writes visible to the gpu; call before the draws that read them
+void StreamRingFlush(StreamRing *ring);
+// call after the frame's last draw reading the ring
+void StreamRingFence(StreamRing *ring);
+
+#endif // STREAM_RING_H
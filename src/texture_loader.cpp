@@ -0,0 +1,245 @@
+#include "texture_loader.h"
+#include <cstdlib>
+#include "stb_image.h"
+#include "half_float.h"
+
+static void WorkerMain(TextureLoader *loader, ImageArena *arena);
+static void DecodeJob(TextureJob *job, ImageArena *arena);
+static void DecodeHdrJob(TextureJob *job);
+
+void TextureLoaderInit(TextureLoader *loader, int num_threads)
+{
+    if (num_threads <= 0)
+    {
+        num_threads = (int)std::thread::hardware_concurrency();
+        if (num_threads <= 0) num_threads = 1;
+    }
+
+    loader->shutdown = false;
+    // sized up front: workers hold pointers into it
+    loader->arenas.resize(num_threads);
+    for (int i = 0; i < num_threads; i++)
+    {
+        ImageArenaInit(&loader->arenas[i], 4 * 1024 * 1024);
+    }
+    for (int i = 0; i < num_threads; i++)
+    {
+        loader->workers.push_back(std::thread(WorkerMain, loader, &loader->arenas[i]));
+    }
+}
+
+void TextureLoaderShutdown(TextureLoader *loader)
+{
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        loader->shutdown = true;
+    }
+    loader->job_ready.notify_all();
+    for (size_t i = 0; i < loader->workers.size(); i++)
+    {
+        loader->workers[i].join();
+    }
+    for (size_t i = 0; i < loader->arenas.size(); i++)
+    {
+        ImageArenaRelease(&loader->arenas[i]);
+    }
+    loader->workers.clear();
+    loader->arenas.clear();
+}
+
+void TextureJobInit(TextureJob *job, const char *filename)
+{
+    job->filename = filename;
+    job->scale_denom = 1;
+    job->max_extent = 0;
+    job->flip = true;
+    job->dest = NULL;
+    job->dest_size = 0;
+    job->done = false;
+    job->loaded = false;
+    job->hdr = false;
+    job->pixels = NULL;
+    job->width = 0;
+    job->height = 0;
+    job->failure_reason = NULL;
+}
+
+void TextureJobRelease(TextureJob *job)
+{
+    if (job->pixels != NULL && job->pixels != job->dest)
+    {
+        free(job->pixels);
+    }
+    job->pixels = NULL;
+}
+
+void TextureLoaderSubmit(TextureLoader *loader, TextureJob *job)
+{
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        job->done = false;
+        job->failure_reason = NULL;
+        loader->queue.push_back(job);
+    }
+    loader->job_ready.notify_one();
+}
+
+bool TextureLoaderPoll(TextureLoader *loader, TextureJob *job)
+{
+    std::lock_guard<std::mutex> lock(loader->mutex);
+    return job->done;
+}
+
+void TextureLoaderWait(TextureLoader *loader, TextureJob *job)
+{
+    std::unique_lock<std::mutex> lock(loader->mutex);
+    loader->job_done.wait(lock, [job] { return job->done; });
+}
+
+int TextureBytesPerTexel(const char *filename)
+{
+    return stbi_is_hdr(filename) ? 8 : 4;
+}
+
+int TextureScaleDenom(int width, int height, int max_extent)
+{
+    int extent = width > height ? width : height;
+    int scale_denom = 1;
+    while (max_extent > 0 && scale_denom < 8 && extent / (scale_denom * 2) >= max_extent)
+    {
+        scale_denom *= 2;
+    }
+    return scale_denom;
+}
+
+
+// Auxillary functions
+void WorkerMain(TextureLoader *loader, ImageArena *arena)
+{
+    for (;;)
+    {
+        TextureJob *job;
+        {
+            std::unique_lock<std::mutex> lock(loader->mutex);
+            loader->job_ready.wait(lock, [loader] { return loader->shutdown || !loader->queue.empty(); });
+            if (loader->queue.empty())
+            {
+                return;
+            }
+            job = loader->queue.front();
+            loader->queue.pop_front();
+        }
+
+        if (stbi_is_hdr(job->filename.c_str()))
+        {
+            DecodeHdrJob(job);
+        }
+        else
+        {
+            DecodeJob(job, arena);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(loader->mutex);
+            job->done = true;
+        }
+        loader->job_done.notify_all();
+    }
+}
+
+void DecodeJob(TextureJob *job, ImageArena *arena)
+{
+    // stb_image settings are per thread here, so concurrent jobs can't see
+    // each other's flip or scale
+    const char *filename = job->filename.c_str();
+    int img_w, img_h, img_c;
+    ImageArenaBind(arena);
+    stbi_set_flip_vertically_on_load_thread(job->flip);
+    stbi_set_jpeg_scale_denom_on_load_thread(1);
+
+    int scale_denom = job->scale_denom;
+    bool ok = true;
+    if (scale_denom == 0)
+    {
+        ok = stbi_info(filename, &img_w, &img_h, &img_c) != 0;
+        scale_denom = ok ? TextureScaleDenom(img_w, img_h, job->max_extent) : 1;
+    }
+    stbi_set_jpeg_scale_denom_on_load_thread(scale_denom);
+
+    uint8_t *pixels = job->dest;
+    size_t size = job->dest_size;
+    if (ok && pixels == NULL)
+    {
+        // stbi_info reports the scaled size, so the buffer fits exactly
+        ok = stbi_info(filename, &img_w, &img_h, &img_c) != 0;
+        size = (size_t)img_w * img_h * 4;
+        pixels = ok ? (uint8_t*)malloc(size) : NULL;
+        if (ok && pixels == NULL)
+        {
+            ok = false;
+            job->failure_reason = "out of memory";
+        }
+    }
+    if (ok)
+    {
+        ok = stbi_load_into(filename, pixels, size, &img_w, &img_h, &img_c, STBI_rgb_alpha) != 0;
+    }
+    if (!ok && job->failure_reason == NULL)
+    {
+        job->failure_reason = stbi_failure_reason();
+    }
+    if (!ok && pixels != job->dest)
+    {
+        free(pixels);
+        pixels = NULL;
+    }
+
+    ImageArenaBind(NULL);
+    ImageArenaReset(arena);
+
+    job->loaded = ok;
+    job->pixels = ok ? pixels : NULL;
+    job->width = ok ? img_w : 0;
+    job->height = ok ? img_h : 0;
+}
+
+void DecodeHdrJob(TextureJob *job)
+{
+    // the float image is as big as the texture will be twice over, so it
+    // comes from the heap rather than growing the worker's arena for good
+    const char *filename = job->filename.c_str();
+    int img_w, img_h, img_c;
+    stbi_set_flip_vertically_on_load_thread(job->flip);
+    float *texels = stbi_loadf(filename, &img_w, &img_h, &img_c, STBI_rgb_alpha);
+    job->hdr = true;
+    if (texels == NULL)
+    {
+        job->failure_reason = stbi_failure_reason();
+        job->loaded = false;
+        job->pixels = NULL;
+        return;
+    }
+
+    size_t count = (size_t)img_w * img_h * 4;
+    uint8_t *pixels = job->dest;
+    if (pixels != NULL && job->dest_size < count * sizeof(uint16_t))
+    {
+        job->failure_reason = "destination buffer too small";
+        pixels = NULL;
+    }
+    else if (pixels == NULL)
+    {
+        pixels = (uint8_t*)malloc(count * sizeof(uint16_t));
+        if (pixels == NULL) job->failure_reason = "out of memory";
+    }
+    if (pixels != NULL)
+    {
+        FloatToHalf(texels, (uint16_t*)pixels, count);
+    }
+    stbi_image_free(texels);
+
+    job->loaded = pixels != NULL;
+    job->pixels = pixels;
+    job->width = pixels != NULL ? img_w : 0;
+    job->height = pixels != NULL ? img_h : 0;
+}
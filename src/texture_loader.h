@@ -0,0 +1,72 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "image_arena.h"
+
+// Pool of worker threads that decode images with stb_image.
+//
+// Jobs are decoded in submission order as workers free up; each worker has
+// its own ImageArena for stb_image's scratch memory and its own (thread-
+// local) stb_image settings, so any number of images decode concurrently.
+// Workers never touch GL: the GL thread waits for (or polls) a job and
+// uploads the pixels itself, which keeps uploads in a deterministic order.
+// Radiance .hdr images decode to float and are converted to half floats, at
+// 8 bytes per texel (see TextureBytesPerTexel).
+
+typedef struct TextureJob {
+    // request
+    std::string filename;
+    int scale_denom;   // JPEG reduced-size decode: 1, 2, 4, 8, or 0 to pick from max_extent
+    int max_extent;    // with scale_denom 0: largest texture size worth decoding
+    bool flip;         // bottom row first, as GL expects
+    uint8_t *dest;     // decode into this buffer (e.g. a mapped PBO), or NULL to allocate
+    size_t dest_size;
+
+    // result, valid once the job is done
+    bool done;
+    bool loaded;
+    bool hdr;          // pixels are RGBA half floats (GL_HALF_FLOAT), not RGBA8
+    uint8_t *pixels;   // dest, or allocated (free with TextureJobRelease)
+    int width;
+    int height;
+    const char *failure_reason;
+} TextureJob;
+
+typedef struct TextureLoader {
+    std::vector<std::thread> workers;
+    std::vector<ImageArena> arenas;
+    std::deque<TextureJob*> queue;
+    std::mutex mutex;
+    std::condition_variable job_ready;  // signals workers
+    std::condition_variable job_done;   // signals waiting callers
+    bool shutdown;
+} TextureLoader;
+
+// num_threads <= 0 uses one worker per hardware thread
+void TextureLoaderInit(TextureLoader *loader, int num_threads);
+void TextureLoaderShutdown(TextureLoader *loader);
+
+void TextureJobInit(TextureJob *job, const char *filename);
+void TextureJobRelease(TextureJob *job);
+
+// the job must stay alive (and untouched) until it is done
+void TextureLoaderSubmit(TextureLoader *loader, TextureJob *job);
+bool TextureLoaderPoll(TextureLoader *loader, TextureJob *job);
+void TextureLoaderWait(TextureLoader *loader, TextureJob *job);
+
+// 8 for HDR images (RGBA half floats), 4 for everything else (RGBA8)
+int TextureBytesPerTexel(const char *filename);
+
+// smallest power-of-two JPEG downscale (up to 1/8) that still leaves the
+// image at least max_extent pixels along its longer side
+int TextureScaleDenom(int width, int height, int max_extent);
+
+#endif // TEXTURE_LOADER_H
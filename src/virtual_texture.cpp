@@ -0,0 +1,502 @@
+#include "virtual_texture.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#define VT_MAX_READS 32
+
+static void ReaderMain(VirtualTexture *vt);
+static bool CreateFeedbackTarget(VirtualTexture *vt, int viewport_width, int viewport_height);
+static void ProcessFeedback(VirtualTexture *vt, const uint16_t *texels);
+static void RequestPage(VirtualTexture *vt, int level, int x, int y);
+static void UploadPage(VirtualTexture *vt, VirtualPageRead *read);
+static void CopyToSlot(VirtualTexture *vt, int slot, const uint8_t *pixels);
+static void RebuildPageTable(VirtualTexture *vt);
+static void LruUnlink(VirtualTexture *vt, int slot);
+static void LruPushFront(VirtualTexture *vt, int slot);
+
+bool VirtualTextureInit(VirtualTexture *vt, const char *filename, int cache_pages, int viewport_width,
+                        int viewport_height, int feedback_scale)
+{
+    vt->atlas_tex = 0;
+    vt->page_table_tex = 0;
+    vt->feedback_fbo = 0;
+    vt->feedback_color = 0;
+    vt->feedback_depth = 0;
+    vt->feedback_pbo[0] = vt->feedback_pbo[1] = 0;
+    vt->feedback_fence[0] = vt->feedback_fence[1] = 0;
+    vt->file = VirtualTextureFileOpen(filename, &vt->layout);
+    if (vt->file == NULL)
+    {
+        return false;
+    }
+    const VirtualTextureLayout& layout = vt->layout;
+    int top = layout.num_levels - 1;
+    int num_pinned = layout.pages_x[top] * layout.pages_y[top];
+
+    // atlas: as square as possible, within the GL size limit
+    GLint max_size;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    int max_per_row = std::min((int)(max_size / layout.slot_size), 255);
+    vt->slots_per_row = std::min((int)ceil(sqrt((double)cache_pages)), max_per_row);
+    int slot_rows = std::min((cache_pages + vt->slots_per_row - 1) / vt->slots_per_row, max_per_row);
+    vt->num_slots = std::min(cache_pages, vt->slots_per_row * slot_rows);
+    if (vt->num_slots <= num_pinned)
+    {
+        fprintf(stderr, "Error: %s needs more than %d cached pages\n", filename, num_pinned);
+        fclose(vt->file);
+        return false;
+    }
+    glGenTextures(1, &vt->atlas_tex);
+    glBindTexture(GL_TEXTURE_2D, vt->atlas_tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, vt->slots_per_row * layout.slot_size, slot_rows * layout.slot_size, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    vt->page_state.assign(layout.num_pages, PageAbsent);
+    vt->page_slot.assign(layout.num_pages, -1);
+    vt->page_requested.assign(layout.num_pages, 0);
+    vt->slot_page.assign(vt->num_slots, -1);
+    vt->lru_prev.assign(vt->num_slots, -1);
+    vt->lru_next.assign(vt->num_slots, -1);
+    vt->lru_head = -1;
+    vt->lru_tail = -1;
+    vt->stats.num_reads = 0;
+    vt->stats.num_evictions = 0;
+    vt->stats.num_dropped = 0;
+    vt->stats.num_resident = 0;
+    vt->read_buffer.resize(VT_MAX_READS * layout.page_bytes);
+    vt->reads.resize(VT_MAX_READS);
+    for (int i = 0; i < VT_MAX_READS; i++)
+    {
+        vt->reads[i].pixels = vt->read_buffer.data() + i * layout.page_bytes;
+        vt->free_reads.push_back(&vt->reads[i]);
+    }
+
+    // the last level is read now and pinned to the first slots
+    int first_top = layout.first_page[top];
+    for (int i = 0; i < num_pinned; i++)
+    {
+        if (!VirtualTextureFileReadPage(vt->file, layout, first_top + i, vt->reads[0].pixels))
+        {
+            fprintf(stderr, "Error: cannot read page %d of %s\n", first_top + i, filename);
+            VirtualTextureRelease(vt);
+            return false;
+        }
+        CopyToSlot(vt, i, vt->reads[0].pixels);
+        vt->page_state[first_top + i] = PagePinned;
+        vt->page_slot[first_top + i] = i;
+        vt->slot_page[i] = first_top + i;
+    }
+    for (int i = num_pinned; i < vt->num_slots; i++)
+    {
+        LruPushFront(vt, i);
+    }
+
+    int rows = 0;
+    for (int l = 0; l < layout.num_levels; l++)
+    {
+        vt->level_row[l] = rows;
+        rows += layout.pages_y[l];
+    }
+    vt->page_table_height = rows;
+    vt->page_table.assign((size_t)layout.pages_x[0] * rows * 4, 0);
+    glGenTextures(1, &vt->page_table_tex);
+    glBindTexture(GL_TEXTURE_2D, vt->page_table_tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8UI, layout.pages_x[0], rows, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    vt->page_table_dirty = true;
+
+    vt->feedback_scale = feedback_scale;
+    vt->feedback_frame = 0;
+    if (!CreateFeedbackTarget(vt, viewport_width, viewport_height))
+    {
+        fprintf(stderr, "Error: cannot create virtual texture feedback framebuffer\n");
+        VirtualTextureRelease(vt);
+        return false;
+    }
+
+    vt->max_uploads_per_frame = 16;
+    vt->shutdown = false;
+    vt->reader = std::thread(ReaderMain, vt);
+
+    // page table for the pinned level, before the first frame draws
+    VirtualTextureUpdate(vt);
+
+    return true;
+}
+
+void VirtualTextureRelease(VirtualTexture *vt)
+{
+    if (vt->reader.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(vt->mutex);
+            vt->shutdown = true;
+        }
+        vt->read_ready.notify_all();
+        vt->reader.join();
+    }
+    if (vt->file != NULL)
+    {
+        fclose(vt->file);
+        vt->file = NULL;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (vt->feedback_fence[i] != 0)
+        {
+            glDeleteSync(vt->feedback_fence[i]);
+            vt->feedback_fence[i] = 0;
+        }
+    }
+    glDeleteBuffers(2, vt->feedback_pbo);
+    glDeleteRenderbuffers(1, &vt->feedback_color);
+    glDeleteRenderbuffers(1, &vt->feedback_depth);
+    glDeleteFramebuffers(1, &vt->feedback_fbo);
+    glDeleteTextures(1, &vt->page_table_tex);
+    glDeleteTextures(1, &vt->atlas_tex);
+
+    vt->read_queue.clear();
+    vt->read_done.clear();
+    vt->free_reads.clear();
+    vt->reads.clear();
+    vt->read_buffer.clear();
+}
+
+void VirtualTextureUpdate(VirtualTexture *vt)
+{
+    // finished feedback readbacks, oldest first; one that isn't ready yet is
+    // left for a later frame rather than waited on
+    for (int i = 0; i < 2; i++)
+    {
+        int index = (vt->feedback_index + i) % 2;
+        if (vt->feedback_fence[index] == 0)
+        {
+            continue;
+        }
+        GLenum status = glClientWaitSync(vt->feedback_fence[index], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            break;
+        }
+        glDeleteSync(vt->feedback_fence[index]);
+        vt->feedback_fence[index] = 0;
+
+        GLsizeiptr size = (GLsizeiptr)vt->feedback_width * vt->feedback_height * 4 * sizeof(uint16_t);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, vt->feedback_pbo[index]);
+        const uint16_t *texels = (const uint16_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if (texels != NULL)
+        {
+            ProcessFeedback(vt, texels);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // pages the reader has finished, a bounded number per frame
+    VirtualPageRead *done[VT_MAX_READS];
+    int num_done = 0;
+    {
+        std::lock_guard<std::mutex> lock(vt->mutex);
+        while (!vt->read_done.empty() && num_done < vt->max_uploads_per_frame)
+        {
+            done[num_done++] = vt->read_done.back();
+            vt->read_done.pop_back();
+        }
+    }
+    for (int i = 0; i < num_done; i++)
+    {
+        UploadPage(vt, done[i]);
+        vt->free_reads.push_back(done[i]);
+    }
+
+    if (vt->page_table_dirty)
+    {
+        RebuildPageTable(vt);
+        glBindTexture(GL_TEXTURE_2D, vt->page_table_tex);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vt->layout.pages_x[0], vt->page_table_height, GL_RGBA_INTEGER,
+                        GL_UNSIGNED_BYTE, vt->page_table.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+        vt->page_table_dirty = false;
+    }
+}
+
+void VirtualTextureBeginFeedback(VirtualTexture *vt)
+{
+    const GLuint no_page[4] = {0, 0, 0, 0};
+    glGetIntegerv(GL_VIEWPORT, vt->saved_viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, vt->feedback_fbo);
+    glViewport(0, 0, vt->feedback_width, vt->feedback_height);
+    glClearBufferuiv(GL_COLOR, 0, no_page);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void VirtualTextureEndFeedback(VirtualTexture *vt)
+{
+    // skipped while the buffer's previous readback is still unprocessed
+    int index = vt->feedback_index;
+    if (vt->feedback_fence[index] == 0)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, vt->feedback_pbo[index]);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glReadPixels(0, 0, vt->feedback_width, vt->feedback_height, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        vt->feedback_fence[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        vt->feedback_index = 1 - index;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(vt->saved_viewport[0], vt->saved_viewport[1], vt->saved_viewport[2], vt->saved_viewport[3]);
+}
+
+void VirtualTextureBind(VirtualTexture *vt, GLenum atlas_unit, GLenum page_table_unit)
+{
+    glActiveTexture(atlas_unit);
+    glBindTexture(GL_TEXTURE_2D, vt->atlas_tex);
+    glActiveTexture(page_table_unit);
+    glBindTexture(GL_TEXTURE_2D, vt->page_table_tex);
+}
+
+float VirtualTextureFeedbackLodBias(const VirtualTexture& vt)
+{
+    // a feedback pixel spans feedback_scale screen pixels in each direction
+    return -log2((float)vt.feedback_scale);
+}
+
+
+// Auxillary functions
+void ReaderMain(VirtualTexture *vt)
+{
+    for (;;)
+    {
+        VirtualPageRead *read;
+        {
+            std::unique_lock<std::mutex> lock(vt->mutex);
+            vt->read_ready.wait(lock, [vt] { return vt->shutdown || !vt->read_queue.empty(); });
+            if (vt->shutdown)
+            {
+                return;
+            }
+            read = vt->read_queue.front();
+            vt->read_queue.pop_front();
+        }
+
+        read->ok = VirtualTextureFileReadPage(vt->file, vt->layout, read->page, read->pixels);
+
+        {
+            std::lock_guard<std::mutex> lock(vt->mutex);
+            vt->read_done.push_back(read);
+        }
+    }
+}
+
+bool CreateFeedbackTarget(VirtualTexture *vt, int viewport_width, int viewport_height)
+{
+    vt->feedback_width = std::max((viewport_width + vt->feedback_scale - 1) / vt->feedback_scale, 1);
+    vt->feedback_height = std::max((viewport_height + vt->feedback_scale - 1) / vt->feedback_scale, 1);
+
+    // page x, page y, level, valid
+    glGenRenderbuffers(1, &vt->feedback_color);
+    glBindRenderbuffer(GL_RENDERBUFFER, vt->feedback_color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA16UI, vt->feedback_width, vt->feedback_height);
+    glGenRenderbuffers(1, &vt->feedback_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, vt->feedback_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, vt->feedback_width, vt->feedback_height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &vt->feedback_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, vt->feedback_fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, vt->feedback_color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, vt->feedback_depth);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    GLsizeiptr size = (GLsizeiptr)vt->feedback_width * vt->feedback_height * 4 * sizeof(uint16_t);
+    glGenBuffers(2, vt->feedback_pbo);
+    for (int i = 0; i < 2; i++)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, vt->feedback_pbo[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        vt->feedback_fence[i] = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    vt->feedback_index = 0;
+
+    return complete;
+}
+
+void ProcessFeedback(VirtualTexture *vt, const uint16_t *texels)
+{
+    vt->feedback_frame++;
+    vt->missing.clear();
+    size_t count = (size_t)vt->feedback_width * vt->feedback_height;
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint16_t *texel = texels + i * 4;
+        if (texel[3] != 0)
+        {
+            RequestPage(vt, texel[2], texel[0], texel[1]);
+        }
+    }
+
+    // coarse levels have the highest page ids: reading them first gets a
+    // usable fallback on screen soonest
+    std::sort(vt->missing.begin(), vt->missing.end(), [](int32_t a, int32_t b) { return a > b; });
+    size_t num_queued = 0;
+    {
+        std::lock_guard<std::mutex> lock(vt->mutex);
+        while (num_queued < vt->missing.size() && !vt->free_reads.empty())
+        {
+            VirtualPageRead *read = vt->free_reads.back();
+            vt->free_reads.pop_back();
+            read->page = vt->missing[num_queued++];
+            vt->page_state[read->page] = PageLoading;
+            vt->read_queue.push_back(read);
+        }
+    }
+    if (num_queued > 0)
+    {
+        vt->read_ready.notify_one();
+    }
+}
+
+void RequestPage(VirtualTexture *vt, int level, int x, int y)
+{
+    const VirtualTextureLayout& layout = vt->layout;
+    if (level >= layout.num_levels || x >= layout.pages_x[level] || y >= layout.pages_y[level])
+    {
+        return;
+    }
+
+    // the page and every coarser page covering it, so fallbacks stay cached
+    for (int l = level; l < layout.num_levels; l++)
+    {
+        int page = VirtualTexturePageId(layout, l, x >> (l - level), y >> (l - level));
+        if (vt->page_requested[page] == vt->feedback_frame)
+        {
+            break;
+        }
+        vt->page_requested[page] = vt->feedback_frame;
+        if (vt->page_state[page] == PageResident)
+        {
+            LruUnlink(vt, vt->page_slot[page]);
+            LruPushFront(vt, vt->page_slot[page]);
+        }
+        else if (vt->page_state[page] == PageAbsent)
+        {
+            vt->missing.push_back(page);
+        }
+    }
+}
+
+void UploadPage(VirtualTexture *vt, VirtualPageRead *read)
+{
+    int page = read->page;
+    if (!read->ok)
+    {
+        fprintf(stderr, "Error: cannot read virtual texture page %d\n", page);
+        vt->page_state[page] = PageFailed;
+        return;
+    }
+    vt->stats.num_reads++;
+
+    // least recently requested slot; if even that one is on screen the
+    // cache is too small for the view and the new page has to wait
+    int slot = vt->lru_tail;
+    int old_page = vt->slot_page[slot];
+    if (old_page >= 0 && vt->page_requested[old_page] == vt->feedback_frame)
+    {
+        vt->page_state[page] = PageAbsent;
+        vt->stats.num_dropped++;
+        return;
+    }
+    if (old_page >= 0)
+    {
+        vt->page_state[old_page] = PageAbsent;
+        vt->page_slot[old_page] = -1;
+        vt->stats.num_evictions++;
+        vt->stats.num_resident--;
+    }
+
+    CopyToSlot(vt, slot, read->pixels);
+    vt->slot_page[slot] = page;
+    vt->page_slot[page] = slot;
+    vt->page_state[page] = PageResident;
+    vt->stats.num_resident++;
+    LruUnlink(vt, slot);
+    LruPushFront(vt, slot);
+    vt->page_table_dirty = true;
+}
+
+void CopyToSlot(VirtualTexture *vt, int slot, const uint8_t *pixels)
+{
+    int slot_size = vt->layout.slot_size;
+    glBindTexture(GL_TEXTURE_2D, vt->atlas_tex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % vt->slots_per_row) * slot_size, (slot / vt->slots_per_row) * slot_size,
+                    slot_size, slot_size, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void RebuildPageTable(VirtualTexture *vt)
+{
+    // coarse to fine: a page that isn't resident inherits its parent's entry,
+    // which already points at the finest resident ancestor
+    const VirtualTextureLayout& layout = vt->layout;
+    int width = layout.pages_x[0];
+    for (int l = layout.num_levels - 1; l >= 0; l--)
+    {
+        for (int y = 0; y < layout.pages_y[l]; y++)
+        {
+            uint8_t *entry = vt->page_table.data() + ((size_t)(vt->level_row[l] + y) * width) * 4;
+            for (int x = 0; x < layout.pages_x[l]; x++)
+            {
+                int page = VirtualTexturePageId(layout, l, x, y);
+                if (vt->page_state[page] == PageResident || vt->page_state[page] == PagePinned)
+                {
+                    int slot = vt->page_slot[page];
+                    entry[x * 4 + 0] = (uint8_t)(slot % vt->slots_per_row);
+                    entry[x * 4 + 1] = (uint8_t)(slot / vt->slots_per_row);
+                    entry[x * 4 + 2] = (uint8_t)l;
+                    entry[x * 4 + 3] = 255;
+                }
+                else
+                {
+                    const uint8_t *parent = vt->page_table.data() +
+                                            ((size_t)(vt->level_row[l + 1] + (y >> 1)) * width + (x >> 1)) * 4;
+                    memcpy(entry + x * 4, parent, 4);
+                }
+            }
+        }
+    }
+}
+
+void LruUnlink(VirtualTexture *vt, int slot)
+{
+    int prev = vt->lru_prev[slot];
+    int next = vt->lru_next[slot];
+    if (prev >= 0) vt->lru_next[prev] = next;
+    else vt->lru_head = next;
+    if (next >= 0) vt->lru_prev[next] = prev;
+    else vt->lru_tail = prev;
+    vt->lru_prev[slot] = -1;
+    vt->lru_next[slot] = -1;
+}
+
+void LruPushFront(VirtualTexture *vt, int slot)
+{
+    vt->lru_prev[slot] = -1;
+    vt->lru_next[slot] = vt->lru_head;
+    if (vt->lru_head >= 0) vt->lru_prev[vt->lru_head] = slot;
+    else vt->lru_tail = slot;
+    vt->lru_head = slot;
+}
@@ -0,0 +1,118 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <glad/glad.h>
+#include "virtual_texture_file.h"
+
+// Sparse virtual texture streamed from a .vtex page file.
+//
+// Residency is per rank: each rank renders a low resolution feedback pass of
+// its own tile that records, per pixel, the page and mip level the main pass
+// will sample. Pages named there (and their coarser ancestors) are read from
+// disk on a reader thread and copied into slots of a physical atlas texture;
+// when the atlas is full the least recently requested page is evicted. A page
+// table texture maps every virtual page to the atlas slot of the finest
+// resident page covering it, so the fragment shader falls back to a blurrier
+// level until the exact page arrives. The last mip level is read at init and
+// never evicted, so every lookup resolves to something.
+
+enum VirtualPageState : uint8_t { PageAbsent, PageLoading, PageResident, PagePinned, PageFailed };
+
+typedef struct VirtualPageRead {
+    int page;
+    bool ok;
+    uint8_t *pixels;   // layout.page_bytes
+} VirtualPageRead;
+
+typedef struct VirtualTextureStats {
+    uint64_t num_reads;
+    uint64_t num_evictions;
+    uint64_t num_dropped;    // reads thrown away because every slot was in use
+    int num_resident;
+} VirtualTextureStats;
+
+typedef struct VirtualTexture {
+    VirtualTextureLayout layout;
+    FILE *file;                              // only used by the reader thread after init
+
+    // per virtual page
+    std::vector<VirtualPageState> page_state;
+    std::vector<int32_t> page_slot;          // atlas slot, -1 when not resident
+    std::vector<uint32_t> page_requested;    // feedback frame that last asked for the page
+
+    // physical atlas; unpinned slots form an LRU list, most recent at the head
+    GLuint atlas_tex;
+    int slots_per_row;
+    int num_slots;
+    std::vector<int32_t> slot_page;          // -1 when free
+    std::vector<int32_t> lru_prev;
+    std::vector<int32_t> lru_next;
+    int lru_head;
+    int lru_tail;
+
+    // page table: one RGBA8UI texel per virtual page (slot x, slot y, resident
+    // level), levels stacked vertically starting at level_row
+    GLuint page_table_tex;
+    int level_row[VTEX_MAX_LEVELS];
+    int page_table_height;
+    std::vector<uint8_t> page_table;
+    bool page_table_dirty;
+
+    // feedback pass, read back through a pair of pixel pack buffers so the
+    // GL thread never waits on it
+    int feedback_scale;
+    int feedback_width;
+    int feedback_height;
+    GLuint feedback_fbo;
+    GLuint feedback_color;
+    GLuint feedback_depth;
+    GLuint feedback_pbo[2];
+    GLsync feedback_fence[2];
+    int feedback_index;
+    GLint saved_viewport[4];
+    uint32_t feedback_frame;
+    std::vector<int32_t> missing;
+
+    // page reader thread
+    std::thread reader;
+    std::vector<VirtualPageRead> reads;
+    std::vector<uint8_t> read_buffer;
+    std::vector<VirtualPageRead*> free_reads;   // GL thread only
+    std::deque<VirtualPageRead*> read_queue;
+    std::vector<VirtualPageRead*> read_done;
+    std::mutex mutex;
+    std::condition_variable read_ready;
+    bool shutdown;
+    int max_uploads_per_frame;
+
+    VirtualTextureStats stats;
+} VirtualTexture;
+
+// cache_pages sizes the atlas; the feedback pass runs at 1/feedback_scale of
+// the viewport
+bool VirtualTextureInit(VirtualTexture *vt, const char *filename, int cache_pages, int viewport_width,
+                        int viewport_height, int feedback_scale);
+void VirtualTextureRelease(VirtualTexture *vt);
+
+// once per frame before rendering: reads back finished feedback, queues page
+// reads, uploads pages that have arrived and refreshes the page table
+void VirtualTextureUpdate(VirtualTexture *vt);
+
+// draw the scene with the feedback shader between these two calls
+void VirtualTextureBeginFeedback(VirtualTexture *vt);
+void VirtualTextureEndFeedback(VirtualTexture *vt);
+
+void VirtualTextureBind(VirtualTexture *vt, GLenum atlas_unit, GLenum page_table_unit);
+
+// mip bias that makes the feedback pass pick the main pass's levels
+float VirtualTextureFeedbackLodBias(const VirtualTexture& vt);
+
+#endif // VIRTUAL_TEXTURE_H
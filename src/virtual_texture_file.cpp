@@ -0,0 +1,93 @@
+#include "virtual_texture_file.h"
+#include <cstring>
+
+bool VirtualTextureLayoutInit(VirtualTextureLayout *layout, int width, int height, int page_size, int border)
+{
+    if (width <= 0 || height <= 0 || page_size <= 0 || border < 0 || border >= page_size)
+    {
+        return false;
+    }
+
+    // halve until the whole level fits in one page
+    int num_levels = 0;
+    int num_pages = 0;
+    int level_w = width;
+    int level_h = height;
+    for (;;)
+    {
+        layout->pages_x[num_levels] = (level_w + page_size - 1) / page_size;
+        layout->pages_y[num_levels] = (level_h + page_size - 1) / page_size;
+        layout->first_page[num_levels] = num_pages;
+        num_pages += layout->pages_x[num_levels] * layout->pages_y[num_levels];
+        num_levels++;
+        if ((level_w <= page_size && level_h <= page_size) || num_levels == VTEX_MAX_LEVELS)
+        {
+            break;
+        }
+        level_w = (level_w + 1) / 2;
+        level_h = (level_h + 1) / 2;
+    }
+
+    memcpy(layout->header.magic, "VTEX", 4);
+    layout->header.version = VTEX_VERSION;
+    layout->header.width = width;
+    layout->header.height = height;
+    layout->header.page_size = page_size;
+    layout->header.border = border;
+    layout->header.num_levels = num_levels;
+    layout->num_levels = num_levels;
+    layout->page_size = page_size;
+    layout->border = border;
+    layout->slot_size = page_size + 2 * border;
+    layout->page_bytes = (size_t)layout->slot_size * layout->slot_size * 4;
+    layout->num_pages = num_pages;
+
+    return true;
+}
+
+FILE *VirtualTextureFileOpen(const char *filename, VirtualTextureLayout *layout)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Error: cannot open %s\n", filename);
+        return NULL;
+    }
+
+    VirtualTextureHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, "VTEX", 4) != 0 ||
+        header.version != VTEX_VERSION)
+    {
+        fprintf(stderr, "Error: %s is not a virtual texture\n", filename);
+        fclose(fp);
+        return NULL;
+    }
+    if (!VirtualTextureLayoutInit(layout, header.width, header.height, header.page_size, header.border) ||
+        layout->header.num_levels != header.num_levels)
+    {
+        fprintf(stderr, "Error: %s has an invalid page layout\n", filename);
+        fclose(fp);
+        return NULL;
+    }
+
+    return fp;
+}
+
+bool VirtualTextureFileReadPage(FILE *fp, const VirtualTextureLayout& layout, int page, uint8_t *pixels)
+{
+    if (fseeko(fp, (off_t)VirtualTexturePageOffset(layout, page), SEEK_SET) != 0)
+    {
+        return false;
+    }
+    return fread(pixels, layout.page_bytes, 1, fp) == 1;
+}
+
+int VirtualTexturePageId(const VirtualTextureLayout& layout, int level, int x, int y)
+{
+    return layout.first_page[level] + y * layout.pages_x[level] + x;
+}
+
+uint64_t VirtualTexturePageOffset(const VirtualTextureLayout& layout, int page)
+{
+    return VTEX_HEADER_SIZE + (uint64_t)page * layout.page_bytes;
+}
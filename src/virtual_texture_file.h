@@ -0,0 +1,59 @@
+#ifndef VIRTUAL_TEXTURE_FILE_H
+#define VIRTUAL_TEXTURE_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// On-disk layout of a virtual texture (.vtex), written by tools/vtexbuild.
+//
+// The image and its mip chain are cut into square pages of page_size texels.
+// Every page is stored with a border of its neighbours' texels on each side,
+// so bilinear filtering is seamless once pages sit in arbitrary atlas slots.
+// Level l is ceil(width / 2^l) x ceil(height / 2^l) texels, padded up to
+// whole pages. Page boundaries line up across levels, so page (x, y) of
+// level l lies inside page (x/2, y/2) of level l+1. The last level fits in a
+// single page.
+//
+// Pages are raw RGBA8, bottom row first (as GL expects), stored level by
+// level in row-major order after a fixed-size header. A page's offset in the
+// file is computed from its id, so there is no page index to read.
+
+#define VTEX_VERSION 1
+#define VTEX_MAX_LEVELS 16
+#define VTEX_HEADER_SIZE 4096
+
+typedef struct VirtualTextureHeader {
+    char magic[4];         // "VTEX"
+    uint32_t version;
+    uint32_t width;        // image size at level 0
+    uint32_t height;
+    uint32_t page_size;    // texels per page side, not counting the border
+    uint32_t border;
+    uint32_t num_levels;
+} VirtualTextureHeader;
+
+typedef struct VirtualTextureLayout {
+    VirtualTextureHeader header;
+    int num_levels;
+    int page_size;
+    int border;
+    int slot_size;                        // page_size + 2 * border
+    size_t page_bytes;                    // slot_size^2 RGBA texels
+    int pages_x[VTEX_MAX_LEVELS];         // level size in pages
+    int pages_y[VTEX_MAX_LEVELS];
+    int first_page[VTEX_MAX_LEVELS];      // id of each level's page (0, 0)
+    int num_pages;
+} VirtualTextureLayout;
+
+// computes the page grid for a width x height image
+bool VirtualTextureLayoutInit(VirtualTextureLayout *layout, int width, int height, int page_size, int border);
+
+// opens a .vtex file and reads its layout from the header
+FILE *VirtualTextureFileOpen(const char *filename, VirtualTextureLayout *layout);
+bool VirtualTextureFileReadPage(FILE *fp, const VirtualTextureLayout& layout, int page, uint8_t *pixels);
+
+int VirtualTexturePageId(const VirtualTextureLayout& layout, int level, int x, int y);
+uint64_t VirtualTexturePageOffset(const VirtualTextureLayout& layout, int page);
+
+#endif // VIRTUAL_TEXTURE_FILE_H
@@ -0,0 +1,78 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include "mesh.h"
+#include "mesh_file.h"
+#include "mesh_loader.h"
+#include "mesh_lod.h"
+
+// Converts an OBJ or binary PLY mesh into a binary mesh cache (.mesh) for
+// texturecube.
+//
+// usage: meshbuild <mesh file> <output.mesh> [meshlets]
+//
+// The text is parsed once here instead of on every rank at every launch;
+// loading the cache is then one mapping and one upload per buffer. The
+// levels of detail (see mesh_lod.h) are built here too.
+// 'meshlets' also stores the mesh cut into meshlets (see mesh.h).
+
+static double Seconds();
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s <mesh file> <output.mesh> [meshlets]\n", argv[0]);
+        return 1;
+    }
+    bool with_meshlets = argc >= 4 && strcmp(argv[3], "meshlets") == 0;
+
+    double start = Seconds();
+    MeshData mesh;
+    int num_threads = std::thread::hardware_concurrency();
+    if (!IsMeshFile(argv[1]) || !LoadMesh(argv[1], num_threads > 0 ? num_threads : 1, &mesh))
+    {
+        fprintf(stderr, "Error: cannot load mesh %s (.obj or binary .ply)\n", argv[1]);
+        return 1;
+    }
+    if (mesh.indices.empty())
+    {
+        // texturecube would reject the cache it makes
+        fprintf(stderr, "Error: %s has no triangles\n", argv[1]);
+        return 1;
+    }
+    double parsed = Seconds();
+
+    float fit_center[3];
+    float fit_scale = FitMesh(&mesh, 1.0f, fit_center);
+    BuildMeshLods(&mesh, MESH_MAX_LODS);
+    MeshletData meshlets;
+    if (with_meshlets)
+    {
+        BuildMeshlets(mesh, &meshlets);
+    }
+    if (!MeshFileWrite(argv[2], mesh, with_meshlets ? &meshlets : NULL, fit_center, fit_scale))
+    {
+        return 1;
+    }
+
+    size_t num_vertices = mesh.lods.size() > 1 ? (size_t)mesh.lods[1].base_vertex : mesh.vertices.size();
+    printf("%s: %zu vertices, %u triangles, %zu levels of detail", argv[2], num_vertices,
+           mesh.lods[0].num_indices / 3, mesh.lods.size());
+    if (with_meshlets)
+    {
+        printf(", %zu meshlets", meshlets.meshlets.size());
+    }
+    printf(" (parsed in %.1f ms, written in %.1f ms)\n", (parsed - start) * 1000.0, (Seconds() - parsed) * 1000.0);
+
+    return 0;
+}
+
+
+// Auxillary functions
+double Seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,144 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include "virtual_texture_file.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// Converts an image into a paged virtual texture (.vtex) for texturecube.
+//
+// usage: vtexbuild <image file> <output.vtex> [page size] [border]
+//
+// The whole image is decoded up front, so the machine running the converter
+// needs memory for it (plus a third more for the mip chain); the renderer
+// only ever holds the pages its ranks are looking at.
+
+typedef struct MipLevel {
+    int width;     // texels holding image data; the page grid pads past them
+    int height;
+    std::vector<uint8_t> texels;
+} MipLevel;
+
+static void Downsample(const MipLevel& src, MipLevel *dst);
+static void CopyPage(const MipLevel& level, const VirtualTextureLayout& layout, int page_x, int page_y, uint8_t *page);
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s <image file> <output.vtex> [page size] [border]\n", argv[0]);
+        return 1;
+    }
+    int page_size = argc >= 4 ? atoi(argv[3]) : 128;
+    int border = argc >= 5 ? atoi(argv[4]) : 1;
+
+    int img_w, img_h, img_c;
+    stbi_set_flip_vertically_on_load(true);
+    uint8_t *pixels = stbi_load(argv[1], &img_w, &img_h, &img_c, STBI_rgb_alpha);
+    if (pixels == NULL)
+    {
+        fprintf(stderr, "Error: cannot decode image %s (%s)\n", argv[1], stbi_failure_reason());
+        return 1;
+    }
+
+    VirtualTextureLayout layout;
+    if (!VirtualTextureLayoutInit(&layout, img_w, img_h, page_size, border))
+    {
+        fprintf(stderr, "Error: invalid page size %d / border %d\n", page_size, border);
+        stbi_image_free(pixels);
+        return 1;
+    }
+
+    std::vector<MipLevel> levels(layout.num_levels);
+    levels[0].width = img_w;
+    levels[0].height = img_h;
+    levels[0].texels.assign(pixels, pixels + (size_t)img_w * img_h * 4);
+    stbi_image_free(pixels);
+    for (int l = 1; l < layout.num_levels; l++)
+    {
+        Downsample(levels[l - 1], &levels[l]);
+    }
+
+    FILE *fp = fopen(argv[2], "wb");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Error: cannot create %s\n", argv[2]);
+        return 1;
+    }
+
+    std::vector<uint8_t> header(VTEX_HEADER_SIZE, 0);
+    memcpy(header.data(), &layout.header, sizeof(layout.header));
+    bool written = fwrite(header.data(), header.size(), 1, fp) == 1;
+
+    std::vector<uint8_t> page(layout.page_bytes);
+    for (int l = 0; written && l < layout.num_levels; l++)
+    {
+        for (int y = 0; written && y < layout.pages_y[l]; y++)
+        {
+            for (int x = 0; written && x < layout.pages_x[l]; x++)
+            {
+                CopyPage(levels[l], layout, x, y, page.data());
+                written = fwrite(page.data(), page.size(), 1, fp) == 1;
+            }
+        }
+    }
+    written = fclose(fp) == 0 && written;
+    if (!written)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", argv[2]);
+        remove(argv[2]);
+        return 1;
+    }
+
+    printf("%s: %dx%d, %d levels, %d pages of %d texels (+%d border), %.1f MB\n", argv[2], img_w, img_h,
+           layout.num_levels, layout.num_pages, page_size, border,
+           (VTEX_HEADER_SIZE + (double)layout.num_pages * layout.page_bytes) / (1024.0 * 1024.0));
+
+    return 0;
+}
+
+
+// Auxillary functions
+void Downsample(const MipLevel& src, MipLevel *dst)
+{
+    // 2x2 box filter; an odd last row / column is averaged with itself
+    dst->width = (src.width + 1) / 2;
+    dst->height = (src.height + 1) / 2;
+    dst->texels.resize((size_t)dst->width * dst->height * 4);
+    for (int y = 0; y < dst->height; y++)
+    {
+        const uint8_t *row0 = src.texels.data() + (size_t)(2 * y) * src.width * 4;
+        const uint8_t *row1 = src.texels.data() + (size_t)std::min(2 * y + 1, src.height - 1) * src.width * 4;
+        uint8_t *out = dst->texels.data() + (size_t)y * dst->width * 4;
+        for (int x = 0; x < dst->width; x++)
+        {
+            int x0 = 2 * x * 4;
+            int x1 = std::min(2 * x + 1, src.width - 1) * 4;
+            for (int c = 0; c < 4; c++)
+            {
+                out[x * 4 + c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+            }
+        }
+    }
+}
+
+void CopyPage(const MipLevel& level, const VirtualTextureLayout& layout, int page_x, int page_y, uint8_t *page)
+{
+    // border and padding texels repeat the nearest image texel, which is the
+    // neighbouring page's content inside the image and clamp-to-edge outside
+    int origin_x = page_x * layout.page_size - layout.border;
+    int origin_y = page_y * layout.page_size - layout.border;
+    for (int j = 0; j < layout.slot_size; j++)
+    {
+        int y = std::min(std::max(origin_y + j, 0), level.height - 1);
+        const uint8_t *row = level.texels.data() + (size_t)y * level.width * 4;
+        uint8_t *out = page + (size_t)j * layout.slot_size * 4;
+        for (int i = 0; i < layout.slot_size; i++)
+        {
+            int x = std::min(std::max(origin_x + i, 0), level.width - 1);
+            memcpy(out + i * 4, row + x * 4, 4);
+        }
+    }
+}